@@ -1,10 +1,12 @@
 #pragma once
 #include <deque>
+#include <functional>
 #define _USE_MATH_DEFINES
 #define INTEGRAL_CURVE_POINTS	10000
 
 #include <math.h>
 #include <PeriodicalMode.h>
+#include <RodWorthCurve.h>
 #include <Settings.h>
 
 using std::deque;
@@ -38,13 +40,15 @@ protected:
 	const float fire_acc = 50.f;
 	bool fireing;
 	float parameters[2] = { 0.f, 1.f };
-	float* stepData;
-	double* derivativeTable;
+	RodWorthCurve curve;
+	// Replaces the fit of the rod when not empty
+	RodWorthCurve::Points measuredCurve;
 	double scramTime;
 	double timeSinceScram;
 	float positionAtScram;
 	float scramDuration;
 	string name = "Control Rod";
+	Settings::RodKind kind;
 	CommandType rodCommand = CommandType::None;
 
 	OperationModes mode = OperationModes::Manual;
@@ -58,75 +62,35 @@ protected:
 
 	double fireTimer = 0.;
 	float holdPcm;
-	bool hasData = false;
-	int maxIndex = 0;
+
+	// Called after the operation mode changed
+	std::function<void()> modeChangedCallback;
 public:
 	static const size_t dataPoints = INTEGRAL_CURVE_POINTS + 1;
 
-	void recalculateStepData(int rodIndex) {
-		double stepSize = 1.0 / rod_steps;
-	
-		if (hasData) {
-			delete[] stepData;
-			delete[] derivativeTable;
-			hasData = false;
-		}
-	
-		stepData = new float[rod_steps + 1];
-		derivativeTable = new double[rod_steps + 1];
-		hasData = true;
-		stepData[0] = 0.0f;
-		derivativeTable[0] = 0.0f;
-		maxIndex = 0;
-	
-		for (size_t i = 1; i <= rod_steps; ++i) {
-			float CR = static_cast<float>(i) * stepSize;  // CR ∈ [0,1]
-	
-			float reactivity = 0.0f;
-	
-			if (rodIndex == 0 || rodIndex == 1) {
-				// Polynomial function for rods 1 and 2
-				reactivity = (-192.39f * pow(CR, 6)
-						   + 1690.9f * pow(CR, 5)
-						   - 3473.6f * pow(CR, 4)
-						   + 2363.3f * pow(CR, 3)
-						   - 260.91f * pow(CR, 2)
-						   + 37.974f * CR
-						   - 0.001f)/rod_worth;
-			} else if (rodIndex == 2) {
-				if (CR < 0.8f){
-					// Extrapolated linear curve for water level from 0 to 800mm
-					float m = 9.38232899520517;
-					float q = -8785.47016144056;
-					reactivity = (m*CR*1000 + q + rod_worth) / rod_worth;
-				}
-				else {
-					// Fitted quadratic curve from 800 to 1000mm (data from experiments 9/5/2025)
-					float A = -0.0149964531096730;
-					float B = 33.3916504237934;
-					float C = -18395.1973141205;
-					reactivity = ((A*pow(CR*1000,2) + B*CR*1000 + C) + rod_worth)/rod_worth;
-				}
-			}
-	
-			stepData[i] = reactivity;
-			derivativeTable[i] = static_cast<double>(stepData[i] - stepData[i - 1]) * 10.0f;
-			if (derivativeTable[i] > derivativeTable[maxIndex]) {
-				maxIndex = static_cast<int>(i);
-			}
-		}
+	void recalculateStepData() {
+		if (!measuredCurve.empty()) curve.fromPoints(measuredCurve, rod_steps, rod_worth);
+		else if (kind == Settings::RodKind::WaterLevel) curve.fromFit(crocusWaterLevelFit(), rod_steps, rod_worth);
+		else curve.fromFit(crocusRodFit(), rod_steps, rod_worth);
 	}
-	
 
-	size_t maxDerivative() { return (size_t)maxIndex; }
+	// Uses a measured S-curve instead of the fit, an empty one goes back to the fit
+	void setMeasuredCurve(const RodWorthCurve::Points& points) {
+		measuredCurve = points;
+		recalculateStepData();
+	}
+	const RodWorthCurve::Points& getMeasuredCurve() { return measuredCurve; }
+	const RodWorthCurve& worthCurve() { return curve; }
+
+	size_t maxDerivative() { return curve.maxDerivative(); }
 
 	float *stepDataArray() {
-		if(hasData) return stepData;
+		if (!curve.empty()) return curve.data();
 		return nullptr;
 	}
 
 	double *derivativeArray() {
-		if (hasData) return derivativeTable;
+		if (!curve.empty()) return curve.derivativeData();
 		return nullptr;
 	}
 
@@ -149,15 +113,15 @@ public:
 		return nullptr;
 	}
 
-	ControlRod(int i, bool recalculateSteps = true) {
+	// The step data is calculated once the rod has its steps and worth
+	ControlRod(Settings::RodKind kind_ = Settings::RodKind::Absorber) : kind(kind_) {
 		resetRod();
-		if (recalculateSteps) recalculateStepData(i);
 		sqw = new SquareWave(SIMULATION_MODE_PERIOD_DEFAULT, SIMULATION_MODE_AMPLITUDE_DEFAULT);
 		sinMode = new Sine(SIMULATION_MODE_PERIOD_DEFAULT, SIMULATION_MODE_AMPLITUDE_DEFAULT);
 		saw = new SawTooth(SIMULATION_MODE_PERIOD_DEFAULT, SIMULATION_MODE_AMPLITUDE_DEFAULT);
 	}
 
-	~ControlRod() { delete sqw; delete sinMode; delete saw; if(hasData) delete [] stepData, derivativeTable; }
+	~ControlRod() { delete sqw; delete sinMode; delete saw; }
 
 	// Sets control rod to initial state
 	void resetRod() {
@@ -176,12 +140,18 @@ public:
 		scramTime = -1.;
 	}
 
-	void setRodSteps(size_t steps, int rodIndex, bool recalculateSteps = true) { rod_steps = steps; if (recalculateSteps) recalculateStepData(rodIndex); }
+	void setRodSteps(size_t steps, bool recalculateSteps = true) { rod_steps = steps; if (recalculateSteps) recalculateStepData(); }
 	size_t * const getRodSteps() { return &rod_steps; }
 	void commandMove(size_t destination) { commandMove((float)destination); }
 	void commandMove(float destination) { rod_exact_command = destination; rodCommand = CommandType::Fixed; }
 	void commandToTop() { rodCommand = CommandType::Top; }
 	void commandToBottom() { rodCommand = CommandType::Bottom; }
+	// Step the rod is heading to, with the top and bottom commands resolved
+	float getCommandedPosition() const {
+		if (rodCommand == CommandType::Bottom) return 0.f;
+		if (rodCommand == CommandType::Top) return (float)rod_steps;
+		return rod_exact_command;
+	}
 	void clearCommands(CommandType onlyIf = CommandType::None) {
 		if ((onlyIf != CommandType::None) && (onlyIf != rodCommand)) return;
 		rod_exact_command = rod_exact_position;
@@ -220,20 +190,12 @@ public:
 		else if (position_pcm <= 0.f) {
 			return 0.f;
 		}
-		else {
-			size_t i = 0;
-			while (stepData[i] < position_pcm)i++;
-			if (stepData[i] == position_pcm) {
-				return (float)i;
-			}
-			else {
-				return (position_pcm - stepData[i - 1]) / (stepData[i] - stepData[i - 1]) + i - 1;
-			}
-		}
+		// The curve can end below the nominal worth, the search stops at its last step
+		return curve.positionOf(position_pcm);
 	}
 	void setRodWorth(float worth) { rod_worth = worth; }
 	const float &getRodWorth() { return rod_worth; }
-	void setParameter(size_t index, float value, int rodIndex, bool recalculateSteps = true) { parameters[index] = value; if (recalculateSteps) recalculateStepData(rodIndex); }
+	void setParameter(size_t index, float value, bool recalculateSteps = true) { parameters[index] = value; if (recalculateSteps) recalculateStepData(); }
 	float getPCMat(float position) {
 		position = std::min(position, (float)rod_steps);
 		position = std::max(position, 0.f);
@@ -241,10 +203,10 @@ public:
 		size_t ceilP = (size_t)ceil(position);
 		double pcmRelative;
 		if (floorP == ceilP) {
-			pcmRelative = stepData[floorP];
+			pcmRelative = curve.at(floorP);
 		}
 		else {
-			pcmRelative = static_cast<double>(stepData[floorP] * (ceilP - position) + stepData[ceilP] * (position - floorP));
+			pcmRelative = static_cast<double>(curve.at(floorP) * (ceilP - position) + curve.at(ceilP) * (position - floorP));
 		}
 		return (float)(pcmRelative * rod_worth);
 	}
@@ -273,6 +235,8 @@ public:
 	float * const getActualPosition() { return &rod_actual_position; };
 	const string &getRodName() { return name; }
 	void setRodName(string value) { name = value; }
+	Settings::RodKind getKind() const { return kind; }
+	void setKind(Settings::RodKind value) { kind = value; }
 	const OperationModes &getOperationMode() { return mode; }
 	const float &getAutoPcm() { return holdPcm; }
 	void setAutoPcm(float pcm) { holdPcm = pcm; }
@@ -281,15 +245,7 @@ public:
 		pcm = std::min(pcm, rod_worth);
 		pcm = std::max(0.f, pcm);
 		pcm /= rod_worth;
-		int i = 0;
-		while (stepData[i] < pcm) i++;
-		if (stepData[i] == pcm) {
-			return (float)i;
-		}
-		else {
-			float a = (stepData[i] - pcm) / (stepData[i] - stepData[i - 1]);
-			return (i - 1) * a + i * (1.f - a);
-		}
+		return curve.positionOf(pcm);
 	}
 
 	void scramRod()
@@ -316,9 +272,9 @@ public:
 	const float &getRodSpeed() { return rod_speed; }
 
 	// Void for moving the control rod
-	void refreshRod(int rodIndex, double dt) {
+	void refreshRod(double dt) {
 		// Check if the rod is being scrammed
-		if (scramTime > 0. && rodIndex != 2) {
+		if (scramTime > 0.) {
 			timeSinceScram += dt;
 			timeSinceScram = std::min(timeSinceScram, scramTime);
 		
@@ -352,13 +308,7 @@ public:
 			}
 
 
-			float localCommand = rod_exact_command;
-			if (rodCommand == CommandType::Bottom) {
-				localCommand = 0.f;
-			}
-			else if (rodCommand == CommandType::Top) {
-				localCommand = (float)rod_steps;
-			}
+			const float localCommand = getCommandedPosition();
 			// Move the rod
 			if ((rod_exact_position != localCommand) && (mode == OperationModes::Manual
 				|| mode == OperationModes::Automatic || mode == OperationModes::Pulse))
@@ -411,8 +361,10 @@ public:
 			else {
 				setRodSpeed(10);
 			}
+			if (modeChangedCallback) modeChangedCallback();
 		}
 	}
+	void setModeChangedCallback(const std::function<void()>& callback) { modeChangedCallback = callback; }
 	void setSimulationMode(SimulationModes value) {
 		if (simulationMode != value) {
 			if (mode == OperationModes::Simulation) {
@@ -427,4 +379,16 @@ public:
 		return simulationMode;
 	}
 
+	// Position, commands, SCRAM and waveform state and the measured curve, for checkpoints. The
+	// step data has to be recalculated after loading, the rod may have a different number of steps
+	template<class Archive>
+	void serialize(Archive& archive)
+	{
+		archive(enabled, rod_exact_position, rod_actual_position, manual_command, rod_exact_command,
+			rod_steps, rod_worth, rod_speed, fireing, parameters,
+			scramTime, timeSinceScram, positionAtScram, scramDuration,
+			rodCommand, mode, simulationMode, *sqw, *sinMode, *saw,
+			simulationStartPosition, fireTimer, holdPcm, measuredCurve);
+	}
+
 };
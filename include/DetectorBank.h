@@ -0,0 +1,207 @@
+#pragma once
+/*
+	DetectorBank.h simulates the neutron detectors of the instrumentation rack. Each channel
+	converts the power to a count rate with its own conversion factor and non-paralyzable
+	dead time, and draws the counts of every dwell window from a Poisson (or, above
+	DETECTOR_POISSON_LIMIT expected counts, a normal) distribution.
+
+	The random numbers come from Philox4x32-10, a counter based generator: block k of a
+	channel is a pure function of (seed, channel, k), so the channels have independent
+	streams and a batch of blocks is a plain loop over independent counters. The numbers
+	are generated DETECTOR_BATCH at a time ahead of the kinetics, drawing a count needs
+	no distribution object
+*/
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <Settings.h>
+
+// Expected counts per dwell window above which the counts are drawn from a normal distribution
+constexpr double DETECTOR_POISSON_LIMIT = 100.;
+// Uniform or normal numbers generated at once per channel
+constexpr size_t DETECTOR_BATCH = 64;
+
+// Philox4x32-10 of Salmon et al., "Parallel random numbers: as easy as 1, 2, 3" (SC11)
+inline void philox4x32(std::uint32_t counter[4], std::uint32_t key0, std::uint32_t key1)
+{
+	for (int round = 0; round < 10; round++) {
+		const std::uint64_t p0 = (std::uint64_t)0xD2511F53u * counter[0];
+		const std::uint64_t p1 = (std::uint64_t)0xCD9E8D57u * counter[2];
+		const std::uint32_t c[4] = { counter[0], counter[1], counter[2], counter[3] };
+		counter[0] = (std::uint32_t)(p1 >> 32) ^ c[1] ^ key0;
+		counter[1] = (std::uint32_t)p1;
+		counter[2] = (std::uint32_t)(p0 >> 32) ^ c[3] ^ key1;
+		counter[3] = (std::uint32_t)p0;
+		key0 += 0x9E3779B9u;
+		key1 += 0xBB67AE85u;
+	}
+}
+
+// Uniform and standard normal numbers of one channel
+class CountNoise {
+private:
+	std::uint32_t key[2] = { 0, 0 };
+	// Next Philox block of this stream
+	std::uint64_t block = 0;
+	double uniforms[DETECTOR_BATCH];
+	double normals[DETECTOR_BATCH];
+	size_t nextUniform = DETECTOR_BATCH;
+	size_t nextNormal = DETECTOR_BATCH;
+
+	// Fills 'out' with n uniform numbers in [0, 1), two per Philox block (53 bits each)
+	void generate(double* out, size_t n) {
+		for (size_t i = 0; i < n / 2; i++) {
+			const std::uint64_t k = block + i;
+			std::uint32_t x[4] = { (std::uint32_t)k, (std::uint32_t)(k >> 32), 0, 0 };
+			philox4x32(x, key[0], key[1]);
+			out[2 * i] = ((((std::uint64_t)x[0] << 32) | x[1]) >> 11) * (1. / 9007199254740992.);
+			out[2 * i + 1] = ((((std::uint64_t)x[2] << 32) | x[3]) >> 11) * (1. / 9007199254740992.);
+		}
+		block += n / 2;
+	}
+	void refillNormals() {
+		// Box-Muller, each pair of uniforms gives two normals
+		generate(normals, DETECTOR_BATCH);
+		for (size_t i = 0; i < DETECTOR_BATCH; i += 2) {
+			const double r = std::sqrt(-2. * std::log(1. - normals[i]));
+			const double phi = 6.283185307179586 * normals[i + 1];
+			normals[i] = r * std::cos(phi);
+			normals[i + 1] = r * std::sin(phi);
+		}
+		nextNormal = 0;
+	}
+public:
+	// Streams with the same seed and a different stream index are independent
+	void seed(std::uint32_t seed, std::uint32_t stream) {
+		key[0] = seed;
+		key[1] = stream;
+		block = 0;
+		nextUniform = DETECTOR_BATCH;
+		nextNormal = DETECTOR_BATCH;
+	}
+
+	double uniform() {
+		if (nextUniform == DETECTOR_BATCH) {
+			generate(uniforms, DETECTOR_BATCH);
+			nextUniform = 0;
+		}
+		return uniforms[nextUniform++];
+	}
+	double normal() {
+		if (nextNormal == DETECTOR_BATCH) refillNormals();
+		return normals[nextNormal++];
+	}
+
+	// Counts of a window with 'mean' expected counts
+	double counts(double mean) {
+		if (mean > DETECTOR_POISSON_LIMIT) return mean + std::sqrt(mean) * normal();
+		// Inversion of the Poisson distribution, one uniform per window
+		const double u = uniform();
+		double p = std::exp(-mean);
+		double sum = p;
+		int k = 0;
+		while (u > sum && p > 0.) {
+			k++;
+			p *= mean / k;
+			sum += p;
+		}
+		return k;
+	}
+
+	template<class Archive>
+	void serialize(Archive& archive) { archive(key, block, uniforms, normals, nextUniform, nextNormal); }
+};
+
+struct DetectorChannel {
+	std::string name;
+	double convFactor = 0.;				// CPS/W
+	double deadTime = 0.;				// s, non-paralyzable
+	double dwellTime = DWELLTIME_DEFAULT;	// s
+
+	// History columns written by DetectorBank::step, see HistoryStore::cps and noisyCounts
+	float* cps = nullptr;
+	float* noisyCounts = nullptr;
+
+	// Dwell window in progress and the counts of the last one, held until the next window ends
+	size_t dwellCounter = 0;
+	double dwellSum = 0.;
+	double currentCounts = 0.;
+	CountNoise noise;
+
+	DetectorChannel() {}
+	DetectorChannel(const std::string& name, double convFactor, double deadTime = 0., double dwellTime = DWELLTIME_DEFAULT) {
+		this->name = name;
+		this->convFactor = convFactor;
+		this->deadTime = deadTime;
+		this->dwellTime = dwellTime;
+	}
+
+	// Count rate seen at the given power
+	double rate(double power) const {
+		const double trueRate = power * convFactor;
+		return (deadTime > 0.) ? trueRate / (1. + trueRate * deadTime) : trueRate;
+	}
+
+	// Everything but the columns, for checkpoints
+	template<class Archive>
+	void serialize(Archive& archive) { archive(name, convFactor, deadTime, dwellTime, dwellCounter, dwellSum, currentCounts, noise); }
+};
+
+class DetectorBank {
+private:
+	std::vector<DetectorChannel> channels;
+	std::uint32_t noiseSeed = 5489u;
+public:
+	size_t size() const { return channels.size(); }
+	DetectorChannel& operator[](size_t i) { return channels[i]; }
+	const DetectorChannel& operator[](size_t i) const { return channels[i]; }
+
+	// The columns of the channel are set by the owner of the history
+	void add(const DetectorChannel& channel) {
+		channels.push_back(channel);
+		channels.back().noise.seed(noiseSeed, (std::uint32_t)(channels.size() - 1));
+	}
+	// Restarts the noise of every channel, each channel draws from its own stream of the seed
+	void seed(std::uint32_t seed) {
+		noiseSeed = seed;
+		for (size_t i = 0; i < channels.size(); i++) channels[i].noise.seed(seed, (std::uint32_t)i);
+	}
+	// Empties the dwell windows
+	void resetWindows() {
+		for (DetectorChannel& c : channels) {
+			c.dwellCounter = 0;
+			c.dwellSum = 0.;
+			c.currentCounts = 0.;
+		}
+	}
+
+	// Writes the count rate and the counts of every channel for the sample at 'index'
+	void step(double power, size_t index, double dt) {
+		for (DetectorChannel& c : channels) {
+			const double rate = c.rate(power);
+			c.cps[index] = (float)std::round(rate);
+			c.dwellSum += rate;
+			c.dwellCounter++;
+			if (c.dwellCounter >= (size_t)(c.dwellTime / dt + 0.5)) {
+				// Expected counts in the window, the average rate times its length
+				c.currentCounts = c.noise.counts(c.dwellSum * dt);
+				c.dwellCounter = 0;
+				c.dwellSum = 0.;
+			}
+			c.noisyCounts[index] = (float)std::round(c.currentCounts);
+		}
+	}
+
+	// Repeats the samples of 'from' at 'to' between two steps of a lower detector rate
+	void hold(size_t from, size_t to) {
+		for (DetectorChannel& c : channels) {
+			c.cps[to] = c.cps[from];
+			c.noisyCounts[to] = c.noisyCounts[from];
+		}
+	}
+
+	template<class Archive>
+	void serialize(Archive& archive) { archive(noiseSeed, channels); }
+};
@@ -0,0 +1,105 @@
+#pragma once
+/*
+	HistoryExport.h writes a range of the sample history to a file (text log,
+	detector counts or the binary format of HistoryFile.h). The range is fixed
+	when the export is created, the file can then be written on a worker thread
+	while the simulation keeps stepping.
+
+	The worker copies the history in chunks and afterwards checks the write head
+	of the simulator (seqlock style): a chunk that the simulation may have
+	overwritten in the meantime is never written, the export fails instead.
+	This only happens when the history is full and the simulation laps the writer.
+*/
+#include <atomic>
+#include <string>
+#include <thread>
+
+class Simulator;
+
+enum class ExportFormat {
+	Text,	// dataToFile, every data_division-th sample as a text row
+	Counts,	// CountsToFile, the noisy detector counts once per dwell time of the time column
+	Binary	// dataToBinaryFile, every sample in columns
+};
+
+// Number of samples copied and checked at once
+constexpr size_t EXPORT_CHUNK_SAMPLES = 1 << 16;
+// When the history is full the simulation overwrites the oldest sample with every step, a background
+// export leaves out this many of them so the worker can get ahead of the write head. It counts
+// steps, not time: 10 s at 1 ms steps, up to a day of slow mode steps
+constexpr size_t EXPORT_MARGIN_SAMPLES = 10000;
+
+class HistoryExport {
+public:
+	enum class Status {
+		Running,
+		Finished,
+		Cancelled,
+		Failed
+	};
+private:
+	const Simulator* reactor;
+	ExportFormat format;
+	std::string fileName;
+
+	/* Captured when the export is created */
+	// Iteration number of the first sample and number of samples
+	size_t firstIteration = 0;
+	size_t count = 0;
+	size_t dataPoints = 0;
+	size_t resets = 0;
+	size_t capturedHead = 0;
+	// Text rows: every data_division-th sample
+	size_t division = 1;
+	// Counts rows: the first sample of every dwell time from the acquisition start
+	double dwellTime = 0.;
+	double acquisitionStartTime = 0.;
+	double coreVolume = 1.;
+	// Text header of the file, or the binary header members
+	std::string header;
+	double startTime = 0.;
+	// Spacing of the samples (s), 0 if they are not evenly spaced (after a slow mode)
+	double dt = 0.;
+	std::string settings;
+
+	std::thread worker;
+	std::atomic<size_t> written{ 0 };
+	std::atomic<bool> cancelRequested{ false };
+	std::atomic<int> status{ (int)Status::Running };
+	std::string message;
+
+	// fileName with the extension of the format
+	std::string outputPath() const;
+	// Binary header members of the range
+	void captureRange();
+	// True if the copied samples from 'from' on were not overwritten since the export was created
+	bool unchanged(size_t from) const;
+	Status overrun();
+	Status writeText();
+	Status writeCounts();
+	Status writeBinary();
+public:
+	// Fixes the range to export, call it from the thread that steps the simulator (or while holding its lock)
+	HistoryExport(const Simulator* reactor, ExportFormat format, const std::string& fileName);
+	// Waits for the worker thread
+	~HistoryExport();
+	HistoryExport(const HistoryExport&) = delete;
+	HistoryExport& operator=(const HistoryExport&) = delete;
+
+	// Writes the file on the calling thread
+	void run();
+	// Writes the file on a worker thread
+	void start();
+	// Blocks until the worker thread has finished
+	void wait();
+	// The worker stops after the current chunk and the export ends as Cancelled
+	void cancel() { cancelRequested = true; }
+
+	Status getStatus() const { return (Status)status.load(); }
+	bool isDone() const { return getStatus() != Status::Running; }
+	// Fraction of the samples written, 0 to 1
+	double progress() const { return count ? (double)written.load() / (double)count : 1.; }
+	const std::string& getFileName() const { return fileName; }
+	// Result for the log, only valid once isDone()
+	const std::string& getMessage() const { return message; }
+};
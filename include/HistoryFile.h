@@ -0,0 +1,192 @@
+#pragma once
+/*
+	HistoryFile.h is the binary columnar export of the sample history. The file
+	describes itself, so analysis scripts need nothing but the file:
+		char[8]   magic "CRHIST01"
+		uint32    format version
+		uint32    header length in bytes
+		char[]    JSON header (dt, sample count, channels with units and types, settings)
+		columns   one block of 'samples' values per channel, in header order, starting
+		          right after the header at the "offset" given for the channel
+	Numbers are stored in the byte order of the machine that wrote the file (little
+	endian on every supported platform). HistoryFileWriter writes the header and then
+	the columns in blocks of any size (see HistoryExport), HistoryFileReader loads them back.
+*/
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <limits>
+#include <string>
+#include <vector>
+#include <cereal/external/rapidjson/document.h>
+#include <cereal/external/rapidjson/stringbuffer.h>
+#include <cereal/external/rapidjson/writer.h>
+
+constexpr char HISTORY_FILE_MAGIC[8] = { 'C', 'R', 'H', 'I', 'S', 'T', '0', '1' };
+constexpr std::uint32_t HISTORY_FILE_VERSION = 1;
+
+class HistoryFileWriter {
+private:
+	struct Channel {
+		std::string name;
+		std::string unit;
+		std::string type;
+		size_t elementSize;
+	};
+	std::vector<Channel> channels;
+	// Extra header members, already formatted as JSON values
+	std::vector<std::pair<std::string, std::string>> members;
+	std::ofstream os;
+	size_t sampleCount = 0;
+	size_t dataStart = 0;
+
+public:
+	// Channels are stored in the order they are added, T is double, float or std::uint8_t
+	template <class T>
+	void addChannel(const std::string& name, const std::string& unit);
+	// type is "f64", "f32" or "u8"
+	void addChannel(const std::string& name, const std::string& unit, const std::string& type, size_t elementSize) {
+		channels.push_back({ name, unit, type, elementSize });
+	}
+
+	void setNumber(const std::string& key, double value) {
+		std::ostringstream os;
+		os << std::setprecision(std::numeric_limits<double>::max_digits10) << value;
+		members.push_back({ key, os.str() });
+	}
+	// value must be valid JSON (e.g. the settings archive)
+	void setJson(const std::string& key, const std::string& value) { members.push_back({ key, value }); }
+
+	// Creates the file and writes the header for 'samples' values per channel
+	bool open(const std::string& path, size_t samples) {
+		sampleCount = samples;
+		std::ostringstream header;
+		header << "{\"samples\":" << samples;
+		for (const auto& m : members) header << ",\"" << m.first << "\":" << m.second;
+		header << ",\"channels\":[";
+		size_t offset = 0;
+		for (size_t c = 0; c < channels.size(); c++) {
+			header << (c ? "," : "") << "{\"name\":\"" << channels[c].name << "\",\"unit\":\"" << channels[c].unit
+				<< "\",\"type\":\"" << channels[c].type << "\",\"offset\":" << offset << "}";
+			offset += samples * channels[c].elementSize;
+		}
+		header << "]}";
+		std::string json = header.str();
+		// Keeps the columns 8 byte aligned for memory mapping
+		json.append((8 - (json.size() + 16) % 8) % 8, ' ');
+
+		os.open(path, std::ios::binary);
+		if (!os) return false;
+		const std::uint32_t version = HISTORY_FILE_VERSION;
+		const std::uint32_t headerLength = (std::uint32_t)json.size();
+		os.write(HISTORY_FILE_MAGIC, sizeof(HISTORY_FILE_MAGIC));
+		os.write((const char*)&version, sizeof(version));
+		os.write((const char*)&headerLength, sizeof(headerLength));
+		os.write(json.data(), json.size());
+		dataStart = 16 + json.size();
+		return (bool)os;
+	}
+
+	size_t channelCount() const { return channels.size(); }
+
+	// Writes the values [from, from + count) of one channel
+	bool writeValues(size_t channel, size_t from, const void* values, size_t count) {
+		size_t offset = dataStart;
+		for (size_t c = 0; c < channel; c++) offset += sampleCount * channels[c].elementSize;
+		os.seekp(offset + from * channels[channel].elementSize);
+		os.write((const char*)values, count * channels[channel].elementSize);
+		return (bool)os;
+	}
+
+	bool close() {
+		os.close();
+		return !os.fail();
+	}
+};
+
+template <> inline void HistoryFileWriter::addChannel<double>(const std::string& name, const std::string& unit) { addChannel(name, unit, "f64", sizeof(double)); }
+template <> inline void HistoryFileWriter::addChannel<float>(const std::string& name, const std::string& unit) { addChannel(name, unit, "f32", sizeof(float)); }
+template <> inline void HistoryFileWriter::addChannel<std::uint8_t>(const std::string& name, const std::string& unit) { addChannel(name, unit, "u8", sizeof(std::uint8_t)); }
+
+class HistoryFileReader {
+public:
+	struct Channel {
+		std::string name;
+		std::string unit;
+		std::string type;
+		size_t offset = 0;
+	};
+private:
+	std::ifstream is;
+	CEREAL_RAPIDJSON_NAMESPACE::Document header;
+	std::vector<Channel> channelList;
+	size_t sampleCount = 0;
+	size_t dataStart = 0;
+
+	template <class T>
+	void readColumn(const Channel& channel, std::vector<double>& values) {
+		std::vector<T> raw(sampleCount);
+		is.seekg(dataStart + channel.offset);
+		is.read((char*)raw.data(), sampleCount * sizeof(T));
+		values.assign(raw.begin(), raw.end());
+	}
+public:
+	// Returns false if the file is missing or not a history file
+	bool open(const std::string& path) {
+		is.open(path, std::ios::binary);
+		char magic[8];
+		std::uint32_t version = 0, headerLength = 0;
+		is.read(magic, sizeof(magic));
+		is.read((char*)&version, sizeof(version));
+		is.read((char*)&headerLength, sizeof(headerLength));
+		if (!is || memcmp(magic, HISTORY_FILE_MAGIC, sizeof(magic)) != 0 || version != HISTORY_FILE_VERSION) return false;
+
+		std::string json(headerLength, ' ');
+		is.read(&json[0], headerLength);
+		if (!is || header.Parse(json.c_str()).HasParseError() || !header.IsObject()) return false;
+		dataStart = sizeof(magic) + sizeof(version) + sizeof(headerLength) + headerLength;
+		sampleCount = (size_t)header["samples"].GetUint64();
+		for (const auto& c : header["channels"].GetArray()) {
+			Channel channel;
+			channel.name = c["name"].GetString();
+			channel.unit = c["unit"].GetString();
+			channel.type = c["type"].GetString();
+			channel.offset = (size_t)c["offset"].GetUint64();
+			channelList.push_back(channel);
+		}
+		return true;
+	}
+
+	size_t samples() const { return sampleCount; }
+	const std::vector<Channel>& channels() const { return channelList; }
+
+	// A numeric header member (dt, startTime, ...), NaN if it is missing
+	double number(const char* key) const {
+		auto m = header.FindMember(key);
+		return (m != header.MemberEnd() && m->value.IsNumber()) ? m->value.GetDouble() : std::numeric_limits<double>::quiet_NaN();
+	}
+	// Any header member as JSON text (e.g. "settings"), empty if it is missing
+	std::string json(const char* key) const {
+		auto m = header.FindMember(key);
+		if (m == header.MemberEnd()) return "";
+		CEREAL_RAPIDJSON_NAMESPACE::StringBuffer buffer;
+		CEREAL_RAPIDJSON_NAMESPACE::Writer<CEREAL_RAPIDJSON_NAMESPACE::StringBuffer> writer(buffer);
+		m->value.Accept(writer);
+		return buffer.GetString();
+	}
+
+	// One channel converted to double, empty if there is no channel with this name
+	std::vector<double> read(const std::string& name) {
+		std::vector<double> values;
+		for (const auto& channel : channelList) {
+			if (channel.name != name) continue;
+			if (channel.type == "f64") readColumn<double>(channel, values);
+			else if (channel.type == "f32") readColumn<float>(channel, values);
+			else if (channel.type == "u8") readColumn<std::uint8_t>(channel, values);
+			break;
+		}
+		return values;
+	}
+};
@@ -0,0 +1,93 @@
+#pragma once
+/*
+	HistoryJournal.h extends the history beyond the ring of HistoryStore by copying
+	every sample to memory mapped segment files on disk. A segment holds a fixed
+	number of samples of every file channel (HistoryStore::fileChannels), one block
+	per channel. Only the segment being written stays mapped, older segments are
+	left to the page cache, so the RAM used does not grow with the simulated time.
+
+	Segment k of a journal holds the iterations [k * segmentSamples, (k + 1) * segmentSamples)
+	in the file <directory>/segment_<k>.bin
+*/
+#include <HistoryStore.h>
+#include <string>
+#include <vector>
+
+// 2^20 samples (about 17.5 minutes of simulated time, 66 MB) per segment
+constexpr size_t JOURNAL_SEGMENT_SAMPLES_DEFAULT = 1 << 20;
+
+// A file mapped into memory, the mapping is shared with the file
+class MappedFile {
+private:
+	char* bytes = nullptr;
+	size_t length = 0;
+#if defined(_WIN32)
+	void* file = nullptr;
+	void* mapping = nullptr;
+#else
+	int fd = -1;
+#endif
+public:
+	MappedFile() {}
+	~MappedFile() { close(); }
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// Maps 'length' bytes of the file, a writable file is created (or resized) to that length
+	bool open(const std::string& path, size_t length, bool writable);
+	void close();
+	bool isOpen() const { return bytes != nullptr; }
+	char* data() const { return bytes; }
+};
+
+class HistoryJournal {
+private:
+	const HistoryStore* history;
+	std::vector<HistoryChannel> channels;
+	std::string directory;
+	size_t segmentSamples;
+	// Segments older than the newest maxSegments are deleted, 0 keeps all of them
+	size_t maxSegments = 0;
+
+	// The journal holds the iterations [first, end)
+	size_t first = 0;
+	size_t end = 0;
+	// Segment being written, mapped in 'current'
+	size_t currentSegment = 0;
+	MappedFile current;
+
+	std::string segmentPath(size_t segment) const;
+	// Byte offset of a channel in a segment
+	size_t channelOffset(size_t channel) const;
+	size_t segmentBytes() const { return channelOffset(channels.size()); }
+	bool mapSegment(size_t segment);
+	void deleteSegments(size_t from, size_t to);
+public:
+	// The directory has to exist, segments left in it by an earlier journal are overwritten
+	HistoryJournal(const HistoryStore* history, const std::string& directory, size_t segmentSamples = JOURNAL_SEGMENT_SAMPLES_DEFAULT);
+	~HistoryJournal();
+	HistoryJournal(const HistoryJournal&) = delete;
+	HistoryJournal& operator=(const HistoryJournal&) = delete;
+
+	// Starts the journal at 'iteration', deleting what was journaled before
+	void restart(size_t iteration);
+	// Copies the iterations [getEnd(), endIteration) from the history, they must still be in its ring.
+	// Returns false if a segment could not be created (e.g. the disk is full)
+	bool append(size_t endIteration);
+	void setMaxSegments(size_t segments) { maxSegments = segments; }
+
+	const std::vector<HistoryChannel>& getChannels() const { return channels; }
+	size_t getFirst() const { return first; }
+	size_t getEnd() const { return end; }
+	const std::string& getDirectory() const { return directory; }
+	size_t getSegmentSamples() const { return segmentSamples; }
+	size_t getMaxSegments() const { return maxSegments; }
+	// Journaled iteration closest to the given simulation time
+	size_t iterationAt(double time);
+
+	// Copies the raw values of a channel for the iterations [from, from + count), which must be journaled
+	bool read(size_t channel, size_t from, size_t count, void* out);
+	// Every stride-th value of a channel over a time range, converted to double (for plots). Returns false
+	// if there is no channel with this name, the range is limited to what has been journaled
+	bool read(const std::string& channel, double fromTime, double toTime, std::vector<double>& values, size_t stride = 1);
+};
@@ -0,0 +1,191 @@
+#pragma once
+/*
+	HistoryPyramid.h keeps the minimum, maximum (and where it is) and sum of a history column
+	over blocks of PYRAMID_BLOCK samples, of PYRAMID_BLOCK blocks and so on, so the statistics
+	of any range of the ring are found in O(log(range)) without reading every sample.
+	The plots use it to draw one vertical min-max line per pixel, which keeps short
+	pulses visible in windows of millions of samples, the autoscale and the pulse
+	analysis use it instead of scanning the samples.
+
+	The blocks are aligned to the ring indices (iteration % samples), the last block of
+	each level is shorter when the ring length is not a multiple of the block size
+*/
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+// Samples (or blocks) merged into one block of the next level
+constexpr size_t PYRAMID_BLOCK = 16;
+
+template <class T>
+class ColumnPyramid {
+public:
+	struct Envelope {
+		T min = std::numeric_limits<T>::infinity();
+		T max = -std::numeric_limits<T>::infinity();
+		// Ring index of a sample holding the maximum
+		size_t maxAt = 0;
+		double sum = 0.;
+		size_t count = 0;
+
+		double mean() const { return count ? sum / count : 0.; }
+		// Integral over time of the samples, dt apart
+		double integral(double dt) const { return sum * dt; }
+	};
+private:
+	struct Level {
+		std::vector<T> min;
+		std::vector<T> max;
+		std::vector<size_t> maxAt;
+		std::vector<double> sum;
+	};
+	const T* column;
+	size_t samples;
+	// levels[0] merges PYRAMID_BLOCK samples, levels[l] PYRAMID_BLOCK blocks of levels[l - 1]
+	std::vector<Level> levels;
+	// The blocks are up to date for the iterations before 'end'
+	size_t end = 0;
+
+	// Recomputes the blocks of a level covering the elements [from, to) below it (the samples for level 0)
+	void rebuild(size_t level, size_t from, size_t to) {
+		Level& out = levels[level];
+		const size_t below = (level == 0) ? samples : levels[level - 1].min.size();
+		for (size_t b = from / PYRAMID_BLOCK; b * PYRAMID_BLOCK < to; b++) {
+			const size_t first = b * PYRAMID_BLOCK;
+			const size_t last = std::min(first + PYRAMID_BLOCK, below);
+			Envelope e;
+			for (size_t i = first; i < last; i++) add(e, level, i);
+			out.min[b] = e.min;
+			out.max[b] = e.max;
+			out.maxAt[b] = e.maxAt;
+			out.sum[b] = e.sum;
+		}
+	}
+	// Brings every level up to date with the ring indices [from, to)
+	void rebuildRange(size_t from, size_t to) {
+		for (size_t level = 0; level < levels.size() && from < to; level++) {
+			rebuild(level, from, to);
+			from /= PYRAMID_BLOCK;
+			to = (to + PYRAMID_BLOCK - 1) / PYRAMID_BLOCK;
+		}
+	}
+	// Adds the element i of the level below 'level' (a sample for level 0)
+	void add(Envelope& e, size_t level, size_t i) const {
+		if (level == 0) {
+			const T value = column[i];
+			e.min = std::min(e.min, value);
+			if (value > e.max) {
+				e.max = value;
+				e.maxAt = i;
+			}
+			e.sum += value;
+		}
+		else {
+			const Level& in = levels[level - 1];
+			e.min = std::min(e.min, in.min[i]);
+			if (in.max[i] > e.max) {
+				e.max = in.max[i];
+				e.maxAt = in.maxAt[i];
+			}
+			e.sum += in.sum[i];
+		}
+	}
+	// Envelope of the ring indices [from, to), climbing a level whenever the range is aligned to its blocks
+	void queryRange(size_t from, size_t to, Envelope& e) const {
+		e.count += to - from;
+		size_t level = 0;
+		while (from < to) {
+			const bool top = (level == levels.size());
+			while (from < to && (top || from % PYRAMID_BLOCK)) add(e, level, from++);
+			while (from < to && to % PYRAMID_BLOCK) add(e, level, --to);
+			from /= PYRAMID_BLOCK;
+			to /= PYRAMID_BLOCK;
+			level++;
+		}
+	}
+	// True if the element i of the level below 'level' holds a sample above (or below) the threshold
+	bool crosses(size_t level, size_t i, T threshold, bool above) const {
+		if (level == 0) return above ? column[i] > threshold : column[i] < threshold;
+		return above ? levels[level - 1].max[i] > threshold : levels[level - 1].min[i] < threshold;
+	}
+	// First ring index in [from, to) above (or below) the threshold, 'to' if there is none. Skips the
+	// largest aligned block that holds no crossing at every position
+	size_t findRange(size_t from, size_t to, T threshold, bool above) const {
+		while (from < to) {
+			size_t level = 0;
+			size_t width = 1;
+			while (level < levels.size() && from % (width * PYRAMID_BLOCK) == 0 && from + width * PYRAMID_BLOCK <= to
+				&& !crosses(level + 1, from / (width * PYRAMID_BLOCK), threshold, above)) {
+				width *= PYRAMID_BLOCK;
+				level++;
+			}
+			if (level == 0 && crosses(0, from, threshold, above)) return from;
+			from += width;
+		}
+		return to;
+	}
+public:
+	ColumnPyramid(const T* column, size_t samples) {
+		this->column = column;
+		this->samples = samples;
+		for (size_t n = (samples + PYRAMID_BLOCK - 1) / PYRAMID_BLOCK; ; n = (n + PYRAMID_BLOCK - 1) / PYRAMID_BLOCK) {
+			levels.emplace_back();
+			levels.back().min.resize(n);
+			levels.back().max.resize(n);
+			levels.back().maxAt.resize(n);
+			levels.back().sum.resize(n);
+			if (n <= PYRAMID_BLOCK) break;
+		}
+	}
+
+	const T* getColumn() const { return column; }
+	size_t getEnd() const { return end; }
+	// Starts over at 'iteration', the blocks are rebuilt by the next update
+	void restart(size_t iteration) { end = iteration; }
+
+	// Takes in the iterations [getEnd(), endIteration) written to the column
+	void update(size_t endIteration) {
+		if (endIteration <= end) return;
+		const size_t from = (endIteration - end > samples) ? endIteration - samples : end;
+		const size_t first = from % samples;
+		const size_t n = endIteration - from;
+		if (first + n <= samples) {
+			rebuildRange(first, first + n);
+		}
+		else {
+			rebuildRange(first, samples);
+			rebuildRange(0, first + n - samples);
+		}
+		end = endIteration;
+	}
+
+	// Envelope of the 'count' samples starting at the ring index 'from' (wrapping around the ring)
+	Envelope query(size_t from, size_t count) const {
+		Envelope e;
+		from %= samples;
+		count = std::min(count, samples);
+		if (from + count <= samples) {
+			queryRange(from, from + count, e);
+		}
+		else {
+			queryRange(from, samples, e);
+			queryRange(0, from + count - samples, e);
+		}
+		return e;
+	}
+
+	// Offset from the ring index 'from' of the first of the next 'count' samples above (or below) the
+	// threshold, 'count' if there is none
+	size_t find(size_t from, size_t count, T threshold, bool above) const {
+		from %= samples;
+		count = std::min(count, samples);
+		if (from + count <= samples) return findRange(from, from + count, threshold, above) - from;
+		const size_t first = findRange(from, samples, threshold, above);
+		if (first < samples) return first - from;
+		return samples - from + findRange(0, from + count - samples, threshold, above);
+	}
+};
+
+// The count rates, reactivities and temperatures of the history are floats (see HistoryStore.h)
+using HistoryPyramid = ColumnPyramid<float>;
@@ -0,0 +1,298 @@
+#pragma once
+/*
+	HistoryStore.h holds the per-sample history of the simulation as one column
+	per channel (structure of arrays), shared by the file exports and the GUI plots
+*/
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <Settings.h>
+
+// Boolean channel packed into 64 bit words
+class BitColumn {
+private:
+	uint64_t* words = nullptr;
+	size_t length = 0;
+public:
+	BitColumn(size_t samples) {
+		length = samples;
+		words = new uint64_t[(samples + 63) / 64];
+		memset(words, 0, ((samples + 63) / 64) * sizeof(uint64_t));
+	}
+	~BitColumn() { delete[] words; }
+	BitColumn(const BitColumn&) = delete;
+	BitColumn& operator=(const BitColumn&) = delete;
+
+	void set(size_t index, bool value) {
+		const uint64_t mask = (uint64_t)1 << (index & 63);
+		if (value) words[index >> 6] |= mask;
+		else words[index >> 6] &= ~mask;
+	}
+	bool get(size_t index) const { return (words[index >> 6] >> (index & 63)) & 1; }
+	size_t bytes() const { return ((length + 63) / 64) * sizeof(uint64_t); }
+};
+
+// Write position in a ring of 'length' samples: the ring index of the newest sample and of the next one.
+// It moves along with the iteration count, so the hot path reads the indices without a division
+class RingCursor {
+private:
+	size_t length = 1;
+	size_t current = 0;
+	size_t next = 0;
+public:
+	RingCursor() {}
+	explicit RingCursor(size_t length) { this->length = std::max(length, (size_t)1); }
+
+	// Puts the cursor after 'iterations' samples
+	void reset(size_t iterations) {
+		next = iterations % length;
+		current = iterations ? (iterations - 1) % length : 0;
+	}
+	void advance() {
+		current = next;
+		if (++next == length) next = 0;
+	}
+	size_t getCurrent() const { return current; }
+	size_t getNext() const { return next; }
+	// Index 'shift' samples away from 'index', a shift of less than one lap only compares
+	size_t shift(size_t index, long shift) const {
+		if (shift >= 0) {
+			const size_t i = index + (size_t)shift;
+			return (i < length) ? i : (i - length < length) ? i - length : i % length;
+		}
+		const size_t back = (size_t)(-shift);
+		if (back <= index) return index - back;
+		return (back - index <= length) ? length - (back - index) : length - 1 - (back - index - 1) % length;
+	}
+};
+
+// The samples of a ring range as at most two contiguous pieces, the second one starts at index 0
+template <class T>
+struct RingSpans {
+	const T* first;
+	size_t firstLength;
+	const T* second;
+	size_t secondLength;
+};
+
+// Slow channel stored once every 'division' samples of the ring, a read gives the last stored value
+class DecimatedColumn {
+private:
+	float* values = nullptr;
+	size_t length = 0;
+	size_t division = 1;
+public:
+	DecimatedColumn(size_t samples, size_t division) {
+		this->division = std::max(division, (size_t)1);
+		length = (samples + this->division - 1) / this->division;
+		values = new float[length]();
+	}
+	~DecimatedColumn() { delete[] values; }
+	DecimatedColumn(const DecimatedColumn&) = delete;
+	DecimatedColumn& operator=(const DecimatedColumn&) = delete;
+
+	size_t getDivision() const { return division; }
+	// True for the ring indices at which a value is stored
+	bool due(size_t index) const { return index % division == 0; }
+	void set(size_t index, float value) { values[index / division] = value; }
+	float get(size_t index) const { return values[index / division]; }
+	size_t bytes() const { return length * sizeof(float); }
+};
+
+// A channel of the history as it is written to files (see HistoryFile.h)
+struct HistoryChannel {
+	std::string name;
+	const char* unit;
+	const char* type;			// "f64", "f32" or "u8"
+	size_t elementSize;
+	const char* column;			// nullptr for a flag or a decimated channel
+	const BitColumn* flag;		// flags are written as one byte per sample
+	// Decimated channels are written as one value per sample too, the last stored value
+	const DecimatedColumn* decimated = nullptr;
+};
+
+class HistoryStore {
+private:
+	size_t samples = 0;
+public:
+	/* Numeric channels, the precision is chosen per channel */
+	// Millisecond steps over several hours need more than the 24 bit mantissa of a float
+	double* time;
+	// The kinetics continue from the last stored state, so neutrons and precursors stay double
+	double* neutrons[8];
+	// Reactivities (pcm) and rod positions (mm) are far inside float precision
+	float* reactivity;
+	float* rodReactivity;
+	// One column per rod of the bank (see RodBank.h), the three CROCUS rods first
+	std::vector<float*> rodPositions;
+	// Period and doubling time (s) are only displayed and exported
+	float* period;
+	float* doublingTime;
+	// Detector count rates are whole numbers, exact in a float up to 2^24. One pair of columns
+	// per detector channel (see DetectorBank.h), at least the two control room detectors
+	std::vector<float*> cps;
+	std::vector<float*> noisyCounts;
+
+	/* Boolean channels */
+	BitColumn sourceInserted;
+	BitColumn safetyBladesInserted;
+
+	/* Decimated channels */
+	// Fuel temperature (C), it follows the power with a time constant of about 45 s
+	DecimatedColumn temperature;
+	// Xenon and iodine concentrations (g/m3), they change over hours
+	DecimatedColumn xenon;
+	DecimatedColumn iodine;
+
+	HistoryStore(size_t samples) : sourceInserted(samples), safetyBladesInserted(samples),
+		temperature(samples, TEMPERATURE_DATA_DIVISION),
+		xenon(samples, POISON_DATA_DEL_DIVISION), iodine(samples, POISON_DATA_DEL_DIVISION) {
+		this->samples = samples;
+		time = new double[samples];
+		for (int i = 0; i < 8; i++) neutrons[i] = new double[samples];
+		reactivity = new float[samples];
+		rodReactivity = new float[samples];
+		for (int i = 0; i < NUMBER_OF_CONTROL_RODS; i++) rodPositions.push_back(new float[samples]);
+		period = new float[samples];
+		doublingTime = new float[samples];
+		for (int i = 0; i < 2; i++) {
+			cps.push_back(new float[samples]);
+			noisyCounts.push_back(new float[samples]);
+		}
+	}
+	~HistoryStore() {
+		delete[] time;
+		for (int i = 0; i < 8; i++) delete[] neutrons[i];
+		delete[] reactivity;
+		delete[] rodReactivity;
+		delete[] period;
+		delete[] doublingTime;
+		setRods(0);
+		setDetectors(0);
+	}
+	HistoryStore(const HistoryStore&) = delete;
+	HistoryStore& operator=(const HistoryStore&) = delete;
+
+	size_t size() const { return samples; }
+
+	// Allocates or frees detector columns so there are 'count' pairs, new columns read as zero
+	void setDetectors(size_t count) {
+		while (cps.size() < count) {
+			cps.push_back(new float[samples]());
+			noisyCounts.push_back(new float[samples]());
+		}
+		while (cps.size() > count) {
+			delete[] cps.back();
+			delete[] noisyCounts.back();
+			cps.pop_back();
+			noisyCounts.pop_back();
+		}
+	}
+
+	// Allocates or frees rod position columns so there are 'count', new columns read as zero
+	void setRods(size_t count) {
+		while (rodPositions.size() < count) rodPositions.push_back(new float[samples]());
+		while (rodPositions.size() > count) {
+			delete[] rodPositions.back();
+			rodPositions.pop_back();
+		}
+	}
+
+	// The channels written to files, the delayed neutron precursors are left out
+	std::vector<HistoryChannel> fileChannels() const {
+		std::vector<HistoryChannel> channels = {
+			{ "time", "s", "f64", sizeof(double), (const char*)time, nullptr },
+			{ "neutrons", "1", "f64", sizeof(double), (const char*)neutrons[0], nullptr },
+			{ "reactivity", "pcm", "f32", sizeof(float), (const char*)reactivity, nullptr },
+			{ "rodReactivity", "pcm", "f32", sizeof(float), (const char*)rodReactivity, nullptr },
+			{ "temperature", "C", "f32", sizeof(float), nullptr, nullptr, &temperature },
+			{ "xenon", "g/m3", "f32", sizeof(float), nullptr, nullptr, &xenon },
+			{ "iodine", "g/m3", "f32", sizeof(float), nullptr, nullptr, &iodine }
+		};
+		for (size_t i = 0; i < rodPositions.size(); i++)
+			channels.push_back({ "rodPosition[" + std::to_string(i) + "]", "mm", "f32", sizeof(float), (const char*)rodPositions[i], nullptr });
+		channels.push_back({ "period", "s", "f32", sizeof(float), (const char*)period, nullptr });
+		channels.push_back({ "doublingTime", "s", "f32", sizeof(float), (const char*)doublingTime, nullptr });
+		for (size_t i = 0; i < cps.size(); i++)
+			channels.push_back({ "cps[" + std::to_string(i) + "]", "1/s", "f32", sizeof(float), (const char*)cps[i], nullptr });
+		for (size_t i = 0; i < noisyCounts.size(); i++)
+			channels.push_back({ "noisyCounts[" + std::to_string(i) + "]", "counts", "f32", sizeof(float), (const char*)noisyCounts[i], nullptr });
+		channels.push_back({ "sourceInserted", "bool", "u8", sizeof(std::uint8_t), nullptr, &sourceInserted });
+		channels.push_back({ "safetyBladesInserted", "bool", "u8", sizeof(std::uint8_t), nullptr, &safetyBladesInserted });
+		return channels;
+	}
+
+	// The samples [from, from + n) of a column, 'from' counts iterations and wraps around the store
+	template <class T>
+	RingSpans<T> spans(const T* column, size_t from, size_t n) const {
+		const size_t index = from % samples;
+		const size_t first = std::min(n, samples - index);
+		return { column + index, first, column, n - first };
+	}
+
+	// Copies the samples [from, from + n) of a column, 'from' counts iterations and wraps around the store
+	template <class T>
+	void copySamples(const T* column, size_t from, size_t n, T* out) const {
+		const RingSpans<T> s = spans(column, from, n);
+		memcpy(out, s.first, s.firstLength * sizeof(T));
+		memcpy(out + s.firstLength, s.second, s.secondLength * sizeof(T));
+	}
+	void copySamples(const BitColumn& column, size_t from, size_t n, std::uint8_t* out) const {
+		for (size_t i = 0, index = from % samples; i < n; i++, index = (index + 1 == samples) ? 0 : index + 1)
+			out[i] = column.get(index);
+	}
+	void copySamples(const DecimatedColumn& column, size_t from, size_t n, float* out) const {
+		for (size_t i = 0, index = from % samples; i < n; i++, index = (index + 1 == samples) ? 0 : index + 1)
+			out[i] = column.get(index);
+	}
+	void copySamples(const HistoryChannel& channel, size_t from, size_t n, void* out) const {
+		if (channel.flag) {
+			copySamples(*channel.flag, from, n, (std::uint8_t*)out);
+			return;
+		}
+		if (channel.decimated) {
+			copySamples(*channel.decimated, from, n, (float*)out);
+			return;
+		}
+		const size_t index = from % samples;
+		const size_t first = std::min(n, samples - index);
+		memcpy(out, channel.column + index * channel.elementSize, first * channel.elementSize);
+		memcpy((char*)out + first * channel.elementSize, channel.column, (n - first) * channel.elementSize);
+	}
+
+	/* The iteration whose time is closest to 'time', among the iterations [first, end) held by the ring.
+	The time column grows with the iterations but its steps need not be even: the search guesses by
+	interpolating between the bounds and falls back to halving the range every other probe, so it takes
+	O(log log n) probes for evenly spaced samples and O(log n) at worst */
+	size_t iterationAt(double t, size_t first, size_t end) const {
+		if (end <= first) return first;
+		size_t low = first;
+		size_t high = end - 1;
+		if (t <= time[low % samples]) return low;
+		if (t >= time[high % samples]) return high;
+		bool interpolate = true;
+		while (high - low > 1) {
+			size_t middle = low + (high - low) / 2;
+			if (interpolate) {
+				const double tLow = time[low % samples];
+				const double tHigh = time[high % samples];
+				middle = low + (size_t)((t - tLow) / (tHigh - tLow) * (double)(high - low));
+				middle = std::min(std::max(middle, low + 1), high - 1);
+			}
+			interpolate = !interpolate;
+			if (time[middle % samples] <= t) low = middle;
+			else high = middle;
+		}
+		return (t - time[low % samples] > time[high % samples] - t) ? high : low;
+	}
+
+	// Heap used by all columns, in bytes
+	size_t bytes() const {
+		return samples * (9 * sizeof(double) + (4 + rodPositions.size() + 2 * cps.size()) * sizeof(float))
+			+ sourceInserted.bytes() + safetyBladesInserted.bytes() + temperature.bytes() + xenon.bytes() + iodine.bytes();
+	}
+};
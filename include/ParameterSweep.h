@@ -0,0 +1,95 @@
+#pragma once
+/*
+	ParameterSweep.h runs one script on many independent simulators whose Settings
+	differ in a few parameters (full grid or Latin hypercube), spread over a pool
+	of worker threads, and keeps a short summary of every run for calibration
+*/
+#include <cmath>
+#include <fstream>
+#include <Settings.h>
+#include <ScriptCommand.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Number of DT_STEP iterations between two per frame calculations of a sweep run
+constexpr size_t SWEEP_FRAME_ITERATIONS = 10;
+
+enum class SweepMode {
+	Grid,			// every combination of the parameter points
+	LatinHypercube	// 'samples' runs, each parameter range split into as many strata
+};
+
+// One varied setting, names are e.g. promptNeutronLifetime, betas[3], lambdas[0], rodWorth[1]
+struct SweepParameter {
+	std::string name;
+	double from = 0.;
+	double to = 0.;
+	// Grid only, points evenly spaced from 'from' to 'to'
+	size_t points = 1;
+};
+
+struct SweepRun {
+	size_t index = 0;
+	// Value of each parameter, in the order they were added
+	std::vector<double> values;
+	bool completed = false;
+
+	// Summary
+	double peakPower = 0.;			// W
+	double peakTime = 0.;			// s
+	double finalPower = 0.;			// W
+	double finalPeriod = 0.;		// s
+	double scramTime = -1.;			// s, negative if there was no SCRAM
+	int scramStatus = 0;			// Simulator::ScramSignals of the first SCRAM
+	double integratedCounts[2] = { 0., 0. };	// noise free detector counts over the run
+};
+
+class ParameterSweep {
+private:
+	Settings base;
+	std::vector<SweepParameter> parameters;
+	std::vector<Command> script;
+	SweepMode mode = SweepMode::Grid;
+	size_t samples = 0;
+	std::uint32_t seed = 0;
+	double duration = 0.;
+	size_t threads = 0;
+	std::vector<SweepRun> runs;
+
+	// Parameter values of every run
+	std::vector<std::vector<double>> buildPoints() const;
+	void runOne(SweepRun& run) const;
+public:
+	ParameterSweep(const Settings& base) : base(base) {}
+
+	// Writes value into the setting called name, returns false if the name is not known
+	static bool applyParameter(Settings& settings, const std::string& name, double value);
+
+	// Returns false (and changes nothing) if the parameter name is not known
+	bool addParameter(const SweepParameter& parameter);
+	// Latin hypercube runs and the detector noise of run i are seeded with seed and seed + i
+	void setMode(SweepMode mode, size_t samples = 0, std::uint32_t seed = 0);
+	/*
+		Reads the mode and the parameters from a text file, one entry per line, # starts a comment:
+			grid | lhs <samples> [seed]
+			<parameter> <from> <to> [points]
+	*/
+	bool loadSpecFromFile(const std::string& path);
+	// The same script is played on every run, times are relative to the start of the run
+	bool loadScriptFromFile(const std::string& path);
+	// Simulated time of every run in seconds
+	void setDuration(double seconds) { duration = seconds; }
+	// 0 uses one thread per core
+	void setThreads(size_t count) { threads = count; }
+
+	size_t runCount() const;
+	const std::vector<SweepParameter>& getParameters() const { return parameters; }
+
+	// Runs the whole sweep and blocks until every run has finished
+	const std::vector<SweepRun>& run();
+	const std::vector<SweepRun>& getRuns() const { return runs; }
+
+	// One line per run: parameter values followed by the summary
+	void summaryToFile(std::string fileName) const;
+};
@@ -0,0 +1,99 @@
+#pragma once
+/*
+	PeriodEstimator.h computes the exponentially weighted reactor period
+		T = dt * sum(k^age * steps / ln(n[i+1] / n[i])) / ((1 - k^(pairs-1)) / (1 - k))
+	over the last sample pairs, updating the weighted sum recursively
+	(S = k * S + steps / ln(r)) instead of summing the whole window every step.
+	The samples of a pair are 'steps' dt apart, 1 unless the period meter runs at a lower rate
+*/
+#include <cmath>
+#include <cstddef>
+
+// Value returned while there is not enough data for an estimate [s]
+constexpr double PERIOD_UNDEFINED = 3600.;
+
+template <size_t MaxPairs>
+class PeriodEstimator {
+private:
+	double k;
+	double dt;
+	// Terms of the window (0 for pairs without information) and their validity, oldest at 'first'
+	double terms[MaxPairs];
+	bool valid[MaxPairs];
+	size_t first = 0;
+	size_t pairs = 0;
+	size_t validPairs = 0;
+	// Pairs kept, at most MaxPairs
+	size_t window = MaxPairs;
+	// k^window, the weight of a term when it leaves the window
+	double kLeaving;
+	// k^(pairs-1), used by the normaliser
+	double kPow = 1.;
+	double sum = 0.;
+public:
+	PeriodEstimator(double k, double dt) {
+		this->k = k;
+		this->dt = dt;
+		kLeaving = std::pow(k, (double)MaxPairs);
+	}
+
+	// Forgets all pairs (the average restarts)
+	void clear() {
+		first = 0;
+		pairs = 0;
+		validPairs = 0;
+		kPow = 1.;
+		sum = 0.;
+	}
+
+	size_t size() const { return pairs; }
+
+	// Keeps at most 'pairs' pairs with the weight k per pair and forgets the window
+	void setWindow(size_t pairs, double k) {
+		window = (pairs < MaxPairs) ? pairs : MaxPairs;
+		this->k = k;
+		kLeaving = std::pow(k, (double)window);
+		clear();
+	}
+	size_t getWindow() const { return window; }
+
+	// The window, so a restored estimator continues with the same sum
+	template<class Archive>
+	void serialize(Archive& archive) { archive(terms, valid, first, pairs, validPairs, kPow, sum); }
+	static constexpr size_t capacity() { return MaxPairs; }
+
+	// Adds the newest pair of neutron populations, taken 'steps' dt apart
+	void push(double previous, double current, double steps = 1.) {
+		const double r = current / previous;
+		const bool isValid = !(r <= 0.0 || r == 1.0); // no information otherwise
+		const double term = isValid ? steps / std::log(r) : 0.;
+
+		sum *= k;
+		if (pairs == window) {
+			sum -= kLeaving * terms[first];
+			if (valid[first]) validPairs--;
+			// The slot after the newest, the oldest one if the window uses the whole array
+			const size_t slot = (first + pairs) % MaxPairs;
+			terms[slot] = term;
+			valid[slot] = isValid;
+			first = (first + 1) % MaxPairs;
+		}
+		else {
+			if (pairs > 0) kPow *= k;
+			size_t slot = (first + pairs) % MaxPairs;
+			terms[slot] = term;
+			valid[slot] = isValid;
+			pairs++;
+		}
+		sum += term;
+		if (isValid) validPairs++;
+	}
+
+	// The period for the pairs in the window [s]
+	double period() const {
+		if (validPairs == 0) return PERIOD_UNDEFINED;
+		const double periodSum = (1. - kPow) / (1. - k);
+		const double T = sum * dt / periodSum;
+		return std::isfinite(T) ? T : PERIOD_UNDEFINED;
+	}
+};
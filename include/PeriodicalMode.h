@@ -76,6 +76,10 @@ public:
 
 	bool getPaused() { return isPaused; }
 
+	// Shape and progress of the waveform, for checkpoints
+	template<class Archive>
+	void serialize(Archive& archive) { archive(period, amplitude, time, isPaused, newPeriod, tracker); }
+
 	virtual float getCurrentOffset(float /*t*/ = -1) { return 0.f; }
 
 	virtual float getRelTimeOfPoint(size_t p_i) { return (float)p_i; }
@@ -129,6 +133,8 @@ public:
 	float rodSpeed = 0.f;
 	float xIndex[4] = { 0.f, 0.5f,0.5f,1.f };
 	SquareWave(float period_, float amplitude_) : PeriodicalMode(period_, amplitude_) { sim_mode = SimulationModes::SquareWaveMode; }
+	template<class Archive>
+	void serialize(Archive& archive) { PeriodicalMode::serialize(archive); archive(rodSpeed, xIndex); }
 
 	float getCurrentOffset(float t) override {
 		if(t < 0) t = getPeriodTime();
@@ -195,6 +201,8 @@ public:
 	};
 	SineMode mode = SineMode::Normal;
 	Sine(float period_, float amplitude_) : PeriodicalMode(period_, amplitude_) { sim_mode = SimulationModes::SineMode; }
+	template<class Archive>
+	void serialize(Archive& archive) { PeriodicalMode::serialize(archive); archive(mode); }
 
 	float getCurrentOffset(float t) override {
 		if(t < 0) t = getPeriodTime();
@@ -233,6 +241,8 @@ struct SawTooth : public PeriodicalMode {
 public:
 	float xIndex[6] = { 0.f, 0.25f, 0.5f, 0.5f, 0.75f, 1.f };
 	SawTooth(float period_, float amplitude_) : PeriodicalMode(period_, amplitude_) { sim_mode = SimulationModes::SawToothMode; }
+	template<class Archive>
+	void serialize(Archive& archive) { PeriodicalMode::serialize(archive); archive(xIndex); }
 
 	float getCurrentOffset(float t) override {
 		if(t < 0) t = getPeriodTime();
@@ -0,0 +1,267 @@
+#pragma once
+/*
+	PkeIntegrator.h advances the point kinetics equations (neutrons and delayed
+	neutron precursor groups) over one time step. Reactivity and source are held
+	constant during the step. Everything is templated on the number of groups,
+	so each group model gets its own fixed size kernels.
+*/
+#include <cmath>
+#include <string>
+#include <PkeState.h>
+
+// Number of delayed groups of the simulator model
+constexpr int PKE_DELAYED_GROUPS = 6;
+
+enum class IntegratorType {
+	RK4,	// Classic fixed step Runge-Kutta (default)
+	SDIRK2,	// L-stable implicit Runge-Kutta, stable for long steps in slow transients
+	RK45	// Dormand-Prince with error control, substeps during fast transients (pulses)
+};
+
+// Coefficients of the point kinetics equations for one step
+template <int Groups>
+struct PkeSystem {
+	typedef PkeState<Groups> State;
+
+	double rho = 0.;				// reactivity (absolute)
+	double beta = 0.;				// sum of the enabled delayed fractions
+	double promptLifetime = 1.;
+	double spontaneousSource = 0.;	// neutrons per second
+	double externalSource = 0.;		// neutrons per second, 0 if the source is withdrawn
+	// Group constants indexed like the state (group i at i + 1), entry 0 and the padding stay 0
+	double betaGroup[State::LANES] = { 0 };
+	double lambda[State::LANES] = { 0 };
+	// Decay constants of the groups that feed the neutrons, 0 for disabled groups (no branch in the kernels)
+	double lambdaCoupled[State::LANES] = { 0 };
+
+	// Right side of the point kinetics equations, dy may alias y
+	void derivative(const State& y, State& dy) const {
+		const double fissionRate = y[0] / promptLifetime; // this is N(t)/l in PKE
+		double dn = (rho - beta) * fissionRate; // New fission neutrons per second
+		dn += spontaneousSource;
+		dn += externalSource;
+		for (int i = 1; i < State::SIZE; i++)
+			dn += lambdaCoupled[i] * y[i]; // Delayed neutrons per second
+		for (int i = 0; i < State::LANES; i++)
+			dy[i] = betaGroup[i] * fissionRate - lambda[i] * y[i];
+		dy[0] = dn;
+	}
+
+	/*
+		Solves (I - c*A) x = b, where A is the matrix of the homogeneous equations.
+		A only couples the neutrons with each group (arrow shape), so the precursors
+		are eliminated analytically and the solve is linear in the number of groups.
+	*/
+	void solveShifted(double c, const State& b, State& x) const {
+		double diagonal = 1. - c * (rho - beta) / promptLifetime;
+		double rhs = b[0];
+		double factor[State::LANES];
+		for (int i = 0; i < State::LANES; i++)
+			factor[i] = 1. / (1. + c * lambda[i]);
+		for (int i = 1; i < State::SIZE; i++) {
+			diagonal -= c * c * lambdaCoupled[i] * betaGroup[i] / promptLifetime * factor[i];
+			rhs += c * lambdaCoupled[i] * b[i] * factor[i];
+		}
+		const double n = rhs / diagonal;
+		for (int i = 0; i < State::LANES; i++)
+			x[i] = (b[i] + c * betaGroup[i] / promptLifetime * n) * factor[i];
+		x[0] = n;
+	}
+
+	/*
+		Prompt jump approximation: the neutrons follow the precursors at once, dN/dt = 0 solved
+		for N. Only meaningful below prompt critical (rho < beta), the caller checks it
+	*/
+	double promptJumpNeutrons(const State& y) const {
+		double delayed = spontaneousSource + externalSource;
+		for (int i = 1; i < State::SIZE; i++)
+			delayed += lambdaCoupled[i] * y[i];
+		return promptLifetime * delayed / (beta - rho);
+	}
+
+	// Advances the precursors of y by dt with the neutrons held at n, exact for a constant n
+	void decayPrecursors(State& y, double n, double dt) const {
+		const double fissionRate = n / promptLifetime;
+		for (int i = 1; i < State::SIZE; i++) {
+			const double decay = std::exp(-lambda[i] * dt);
+			y[i] = y[i] * decay + betaGroup[i] * fissionRate / lambda[i] * (1. - decay);
+		}
+	}
+};
+
+template <int Groups>
+class PkeIntegrator {
+public:
+	typedef PkeState<Groups> State;
+	typedef PkeSystem<Groups> System;
+
+	virtual ~PkeIntegrator() {}
+	virtual IntegratorType type() const = 0;
+	// Advances state by dt, populations are kept non negative. False if only part of dt was done
+	virtual bool step(const System& system, State& state, double dt) = 0;
+	// Forgets step size history (after the state was set from outside)
+	virtual void reset() {}
+	// Step size carried over to the next call, 0 for fixed step methods (saved in checkpoints)
+	virtual double getSubstep() const { return 0.; }
+	virtual void setSubstep(double) {}
+};
+
+template <int Groups>
+class RK4Integrator : public PkeIntegrator<Groups> {
+public:
+	typedef PkeState<Groups> State;
+
+	IntegratorType type() const override { return IntegratorType::RK4; }
+	bool step(const PkeSystem<Groups>& system, State& state, double dt) override {
+		State k1, k2, k3, k4, y;
+		system.derivative(state, k1); // f(t0)
+		y.axpyClamped(0.5 * dt, k1, state);
+		system.derivative(y, k2); // f(t0 + h/2)
+		y.axpyClamped(0.5 * dt, k2, state);
+		system.derivative(y, k3); // f(t0 + h/2)
+		y.axpyClamped(dt, k3, state);
+		system.derivative(y, k4); // f(t0 + h)
+		// state += (dt/6)*( (k1+k4) + 2*(k2+k3) ), no negative values
+		for (int i = 0; i < State::LANES; i++)
+			y[i] = (k1[i] + k4[i]) + (k2[i] + k3[i]) * 2.;
+		state.axpyClamped(dt / 6., y, state);
+		return true;
+	}
+};
+
+/*
+	Two stage, second order, L-stable SDIRK (Alexander 1977). Each stage is one
+	shifted solve, so the cost is close to a single RK4 stage and the prompt
+	neutron mode is damped instead of limiting the step size.
+*/
+template <int Groups>
+class SDIRK2Integrator : public PkeIntegrator<Groups> {
+private:
+	const double gamma = 1. - std::sqrt(0.5);
+public:
+	typedef PkeState<Groups> State;
+
+	IntegratorType type() const override { return IntegratorType::SDIRK2; }
+	bool step(const PkeSystem<Groups>& system, State& state, double dt) override {
+		const double c = gamma * dt;
+		const double source = system.spontaneousSource + system.externalSource;
+		State b = state, y1, f1;
+		// Y1 = y + c*f(Y1)
+		b[0] += c * source;
+		system.solveShifted(c, b, y1);
+		system.derivative(y1, f1);
+		// Y2 = y + (1 - gamma)*dt*f(Y1) + c*f(Y2), the new state is Y2
+		b.axpy(dt - c, f1, state);
+		b[0] += c * source;
+		system.solveShifted(c, b, state);
+		state.clampNonNegative();
+		return true;
+	}
+};
+
+/*
+	Dormand-Prince 5(4) with local error control. A step is split into as many
+	substeps as needed, the accepted substep size carries over to the next step.
+*/
+template <int Groups>
+class RK45Integrator : public PkeIntegrator<Groups> {
+private:
+	double relativeTolerance;
+	double absoluteTolerance;
+	double substep = 0.;
+	static constexpr int MAX_SUBSTEPS = 100000;
+public:
+	typedef PkeState<Groups> State;
+
+	RK45Integrator(double relativeTolerance = 1e-7, double absoluteTolerance = 1e-6) {
+		this->relativeTolerance = relativeTolerance;
+		this->absoluteTolerance = absoluteTolerance;
+	}
+	IntegratorType type() const override { return IntegratorType::RK45; }
+	void reset() override { substep = 0.; }
+	double getSubstep() const override { return substep; }
+	void setSubstep(double value) override { substep = value; }
+	// Returns false if MAX_SUBSTEPS substeps did not reach the end of the step, the state is then at an earlier time
+	bool step(const PkeSystem<Groups>& system, State& state, double dt) override {
+		static const double a21 = 1. / 5.;
+		static const double a31 = 3. / 40., a32 = 9. / 40.;
+		static const double a41 = 44. / 45., a42 = -56. / 15., a43 = 32. / 9.;
+		static const double a51 = 19372. / 6561., a52 = -25360. / 2187., a53 = 64448. / 6561., a54 = -212. / 729.;
+		static const double a61 = 9017. / 3168., a62 = -355. / 33., a63 = 46732. / 5247., a64 = 49. / 176., a65 = -5103. / 18656.;
+		static const double b1 = 35. / 384., b3 = 500. / 1113., b4 = 125. / 192., b5 = -2187. / 6784., b6 = 11. / 84.;
+		// Difference between the 5th and the embedded 4th order weights
+		static const double e1 = 71. / 57600., e3 = -71. / 16695., e4 = 71. / 1920., e5 = -17253. / 339200., e6 = 22. / 525., e7 = -1. / 40.;
+
+		State k[7], y, next;
+		double remaining = dt;
+		double h = (substep > 0.) ? std::min(substep, dt) : dt;
+		bool haveFirst = false;
+		for (int n = 0; remaining > 0. && n < MAX_SUBSTEPS; n++) {
+			const bool last = h >= remaining * (1. - 1e-12);
+			if (last) h = remaining;
+			if (!haveFirst) system.derivative(state, k[0]);
+			y.axpy(h * a21, k[0], state);
+			system.derivative(y, k[1]);
+			for (int i = 0; i < State::LANES; i++) y[i] = state[i] + h * (a31 * k[0][i] + a32 * k[1][i]);
+			system.derivative(y, k[2]);
+			for (int i = 0; i < State::LANES; i++) y[i] = state[i] + h * (a41 * k[0][i] + a42 * k[1][i] + a43 * k[2][i]);
+			system.derivative(y, k[3]);
+			for (int i = 0; i < State::LANES; i++) y[i] = state[i] + h * (a51 * k[0][i] + a52 * k[1][i] + a53 * k[2][i] + a54 * k[3][i]);
+			system.derivative(y, k[4]);
+			for (int i = 0; i < State::LANES; i++) y[i] = state[i] + h * (a61 * k[0][i] + a62 * k[1][i] + a63 * k[2][i] + a64 * k[3][i] + a65 * k[4][i]);
+			system.derivative(y, k[5]);
+			for (int i = 0; i < State::LANES; i++) next[i] = state[i] + h * (b1 * k[0][i] + b3 * k[2][i] + b4 * k[3][i] + b5 * k[4][i] + b6 * k[5][i]);
+			system.derivative(next, k[6]);
+
+			double error = 0.;
+			for (int i = 0; i < State::SIZE; i++) {
+				const double e = h * (e1 * k[0][i] + e3 * k[2][i] + e4 * k[3][i] + e5 * k[4][i] + e6 * k[5][i] + e7 * k[6][i]);
+				const double scale = absoluteTolerance + relativeTolerance * std::max(std::fabs(state[i]), std::fabs(next[i]));
+				error = std::max(error, std::fabs(e) / scale);
+			}
+
+			const double factor = (error > 0.) ? std::min(5., std::max(0.2, 0.9 * std::pow(error, -0.2))) : 5.;
+			if (error <= 1.) {
+				state = next;
+				k[0] = k[6]; // first same as last
+				haveFirst = true;
+				remaining -= h;
+				if (!last) substep = h * factor;
+				h = substep;
+			}
+			else {
+				h *= factor;
+			}
+		}
+		state.clampNonNegative();
+		return remaining <= 0.;
+	}
+};
+
+template <int Groups>
+PkeIntegrator<Groups>* createIntegrator(IntegratorType type) {
+	switch (type) {
+	case IntegratorType::SDIRK2: return new SDIRK2Integrator<Groups>();
+	case IntegratorType::RK45: return new RK45Integrator<Groups>();
+	default: return new RK4Integrator<Groups>();
+	}
+}
+
+inline std::string integratorName(IntegratorType type) {
+	switch (type) {
+	case IntegratorType::SDIRK2: return "SDIRK2";
+	case IntegratorType::RK45: return "RK45";
+	default: return "RK4";
+	}
+}
+
+// Returns false if the name is not known
+inline bool integratorFromName(const std::string& name, IntegratorType& type) {
+	for (IntegratorType t : { IntegratorType::RK4, IntegratorType::SDIRK2, IntegratorType::RK45 }) {
+		if (integratorName(t) == name) {
+			type = t;
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,48 @@
+#pragma once
+/*
+	PkeState.h is the state vector of the point kinetics equations: the neutron
+	population followed by the delayed neutron precursor groups. The size is
+	known at compile time and padded to whole AVX registers (4 doubles), so
+	the stage loops have fixed trip counts and no tail.
+*/
+#include <algorithm>
+
+template <int Groups>
+struct alignas(32) PkeState {
+	// Neutrons + precursor groups
+	static constexpr int SIZE = Groups + 1;
+	// Padded length, the extra lanes are always 0
+	static constexpr int LANES = (SIZE + 3) / 4 * 4;
+
+	double v[LANES];
+
+	double& operator[](int i) { return v[i]; }
+	const double& operator[](int i) const { return v[i]; }
+
+	static PkeState zero() {
+		PkeState s;
+		for (int i = 0; i < LANES; i++) s.v[i] = 0.;
+		return s;
+	}
+
+	// Copies SIZE values from/to a plain array
+	void load(const double* values) {
+		for (int i = 0; i < SIZE; i++) v[i] = values[i];
+		for (int i = SIZE; i < LANES; i++) v[i] = 0.;
+	}
+	void store(double* values) const {
+		for (int i = 0; i < SIZE; i++) values[i] = v[i];
+	}
+
+	// this = x * a + y
+	void axpy(double a, const PkeState& x, const PkeState& y) {
+		for (int i = 0; i < LANES; i++) v[i] = x.v[i] * a + y.v[i];
+	}
+	// this = max(0, x * a + y), a stage value without negative populations
+	void axpyClamped(double a, const PkeState& x, const PkeState& y) {
+		for (int i = 0; i < LANES; i++) v[i] = std::max(0., x.v[i] * a + y.v[i]);
+	}
+	void clampNonNegative() {
+		for (int i = 0; i < LANES; i++) v[i] = std::max(0., v[i]);
+	}
+};
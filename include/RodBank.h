@@ -0,0 +1,163 @@
+#pragma once
+/*
+	RodBank.h holds the rods of the reactor as listed by Settings::rodBank(): the absorbers and
+	the water level, which CROCUS drives like a rod. The kind of a rod picks its worth fit and
+	its ScramAction what a SCRAM does to it, so a variant with more absorbers or several level
+	actuators only needs more RodDefinition entries.
+
+	The per rod results of a step (the worth inserted by each rod) and the SCRAM behaviour are
+	kept in arrays side by side, one entry per rod. step() refreshes every rod and sums their worth
+	in a single pass, the rod reactivity costs one loop whatever the number of rods
+*/
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <ControlRod.h>
+#include <RodWorthCurve.h>
+#include <Settings.h>
+
+class RodBank {
+private:
+	std::vector<ControlRod*> rods;
+	std::vector<Settings::ScramAction> scramActions;
+	std::vector<float> scramPositions;
+	// Worth of each rod at its actual position after the last step (pcm)
+	std::vector<float> insertedPcm;
+
+	void resize(size_t count) {
+		while (rods.size() < count) rods.push_back(new ControlRod());
+		while (rods.size() > count) {
+			delete rods.back();
+			rods.pop_back();
+		}
+		scramActions.resize(count, Settings::ScramAction::Hold);
+		scramPositions.resize(count, 0.f);
+		insertedPcm.resize(count, 0.f);
+	}
+public:
+	RodBank() {}
+	~RodBank() { resize(0); }
+	RodBank(const RodBank&) = delete;
+	RodBank& operator=(const RodBank&) = delete;
+
+	size_t size() const { return rods.size(); }
+	ControlRod* operator[](size_t i) const { return rods[i]; }
+
+	/* Adds or removes rods so there is one per definition and applies the definitions. Rods that
+	already exist keep their position, commands and callbacks */
+	void configure(const std::vector<Settings::RodDefinition>& definitions) {
+		resize(definitions.size());
+		for (size_t i = 0; i < definitions.size(); i++) {
+			const Settings::RodDefinition& d = definitions[i];
+			ControlRod* rod = rods[i];
+			rod->setRodName(d.name);
+			rod->setKind(d.kind);
+			rod->setRodSteps(d.settings.rodSteps, false);
+			rod->setRodSpeed(d.settings.rodSpeed);
+			rod->setRodWorth(d.settings.rodWorth);
+			for (size_t j = 0; j < 2; j++) rod->setParameter(j, d.settings.rodCurve[j], false);
+			scramActions[i] = d.scram;
+			scramPositions[i] = d.scramPosition;
+			RodWorthCurve::Points points;
+			if (!d.curveFile.empty() && RodWorthCurve::loadPoints(d.curveFile, points)) rod->setMeasuredCurve(points);
+			else rod->recalculateStepData();
+		}
+	}
+
+	void reset() {
+		for (ControlRod* rod : rods) rod->resetRod();
+	}
+
+	// Moves every rod by dt and returns the worth they insert minus the worth of the whole bank (pcm)
+	float step(double dt) {
+		float inserted = 0.f, worth = 0.f;
+		for (size_t i = 0; i < rods.size(); i++) {
+			rods[i]->refreshRod(dt);
+			insertedPcm[i] = rods[i]->getCurrentPCM();
+			inserted += insertedPcm[i];
+			worth += rods[i]->getRodWorth();
+		}
+		return -worth + inserted;
+	}
+	const std::vector<float>& getInsertedPcm() const { return insertedPcm; }
+
+	// Worth inserted by the rods where they are now (pcm)
+	float getTotalRodReactivity() const {
+		float sum = 0.f;
+		for (ControlRod* rod : rods) sum += rod->getCurrentPCM();
+		return sum;
+	}
+	/* Highest worth the rods can insert before they stop, each at its command or where it is now
+	if that is higher (pcm, minus the worth of the whole bank like step()) */
+	float getReachableReactivity() const {
+		float inserted = 0.f, worth = 0.f;
+		for (ControlRod* rod : rods) {
+			inserted += rod->getPCMat(std::max({ *rod->getActualPosition(), *rod->getExactPosition(), rod->getCommandedPosition() }));
+			worth += rod->getRodWorth();
+		}
+		return -worth + inserted;
+	}
+	float getTotalRodWorth() const {
+		float sum = 0.f;
+		for (ControlRod* rod : rods) sum += rod->getRodWorth();
+		return sum;
+	}
+
+	Settings::ScramAction getScramAction(size_t i) const { return scramActions[i]; }
+	float getScramPosition(size_t i) const { return scramPositions[i]; }
+
+	// Applies the ScramAction of every rod
+	void scram() {
+		for (size_t i = 0; i < rods.size(); i++) {
+			ControlRod* rod = rods[i];
+			switch (scramActions[i]) {
+			case Settings::ScramAction::Hold:
+				rod->clearCommands();
+				break;
+			case Settings::ScramAction::Drop:
+				rod->scramRod();
+				break;
+			case Settings::ScramAction::Drain:
+				rod->clearCommands();
+				if (*rod->getActualPosition() >= scramPositions[i]) {
+					rod->moveRodToStep(scramPositions[i], true);
+					rod->commandMove(scramPositions[i]);
+				}
+				rod->setEnabled(false);
+				break;
+			}
+		}
+	}
+	// Enables all rods again after a SCRAM
+	void resetScram() {
+		for (ControlRod* rod : rods) {
+			rod->setEnabled(true);
+			rod->clearCommands();
+		}
+	}
+
+	// The rods with their definitions, for checkpoints. The step data has to be recalculated after loading
+	template<class Archive>
+	void save(Archive& archive) const {
+		archive((std::uint64_t)rods.size());
+		for (size_t i = 0; i < rods.size(); i++)
+			archive(rods[i]->getRodName(), rods[i]->getKind(), scramActions[i], scramPositions[i], *rods[i]);
+	}
+	template<class Archive>
+	void load(Archive& archive) {
+		std::uint64_t count = 0;
+		archive(count);
+		resize((size_t)count);
+		for (size_t i = 0; i < rods.size(); i++) {
+			std::string name;
+			Settings::RodKind kind = Settings::RodKind::Absorber;
+			archive(name, kind, scramActions[i], scramPositions[i], *rods[i]);
+			rods[i]->setRodName(name);
+			rods[i]->setKind(kind);
+		}
+	}
+	void recalculateStepData() {
+		for (ControlRod* rod : rods) rod->recalculateStepData();
+	}
+};
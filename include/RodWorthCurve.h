@@ -0,0 +1,197 @@
+#pragma once
+/*
+	RodWorthCurve.h holds the integral worth curve of a control rod (or of the water level)
+	as a table over its steps, relative to the nominal worth, and the inverse lookup from a
+	worth to a position.
+
+	The table is filled from a piecewise polynomial fit (the CROCUS rod polynomial, the water
+	level fits) or from a measured S-curve read from a file. The inverse searches the running
+	maximum of the table, so a curve that is not monotone gives the first step reaching the
+	worth, as the linear search did. A table of WORTH_INVERSE_BINS equal worth bins narrows
+	the search to the steps of one bin, a binary search over the whole table is the fallback
+	when the worth falls on the edge of a bin
+*/
+#include <algorithm>
+#include <cstddef>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Worth bins of the inverse table, a bin holds a few steps of a 1000 step rod
+constexpr size_t WORTH_INVERSE_BINS = 256;
+
+// Piecewise polynomial fit of the integral worth in pcm over the relative position x in [0, 1]
+struct WorthFit {
+	struct Piece {
+		// The piece applies below this position, the last one up to the top
+		double below;
+		// Highest order first
+		std::vector<double> coefficients;
+	};
+	std::vector<Piece> pieces;
+	// The water level fits give the reactivity relative to the full tank, the worth is added
+	bool relativeToTop = false;
+
+	static double horner(const std::vector<double>& coefficients, double x) {
+		double y = 0.;
+		for (double c : coefficients) y = y * x + c;
+		return y;
+	}
+	double operator()(double x, double worth) const {
+		size_t i = 0;
+		while (i + 1 < pieces.size() && x >= pieces[i].below) i++;
+		const double pcm = horner(pieces[i].coefficients, x);
+		return relativeToTop ? pcm + worth : pcm;
+	}
+};
+
+// Safety and regulating rods of CROCUS
+inline WorthFit crocusRodFit()
+{
+	WorthFit fit;
+	fit.pieces.push_back({ 1., { -192.39, 1690.9, -3473.6, 2363.3, -260.91, 37.974, -0.001 } });
+	return fit;
+}
+
+// Water level of CROCUS, x is the level over 1000 mm
+inline WorthFit crocusWaterLevelFit()
+{
+	WorthFit fit;
+	fit.relativeToTop = true;
+	// Extrapolated linear curve from 0 to 800 mm
+	fit.pieces.push_back({ .8, { 9.38232899520517e3, -8785.47016144056 } });
+	// Fitted quadratic curve from 800 to 1000 mm (data from experiments 9/5/2025)
+	fit.pieces.push_back({ 1., { -0.0149964531096730e6, 33.3916504237934e3, -18395.1973141205 } });
+	return fit;
+}
+
+class RodWorthCurve {
+public:
+	// Measured curve, relative position in [0, 1] (0 at the bottom) and integral worth in pcm
+	typedef std::vector<std::pair<float, float>> Points;
+private:
+	// Worth at each step relative to the nominal worth, values[0] is 0
+	std::vector<float> values;
+	// Differential worth, the plots of the rod tab show it
+	std::vector<double> derivative;
+	size_t maxIndex = 0;
+	// Running maximum of values and, for each worth bin j, the first step where it reaches j / binScale
+	std::vector<float> rising;
+	std::vector<size_t> bins;
+	float binScale = 0.f;
+
+	void resize(size_t steps) {
+		values.assign(steps + 1, 0.f);
+		derivative.assign(steps + 1, 0.);
+	}
+	// Derivative, maximum and inverse table of the values
+	void finish() {
+		const size_t steps = values.size() - 1;
+		values[0] = 0.f;
+		maxIndex = 0;
+		for (size_t i = 1; i <= steps; i++) {
+			derivative[i] = static_cast<double>(values[i] - values[i - 1]) * 10.0f;
+			if (derivative[i] > derivative[maxIndex]) maxIndex = i;
+		}
+
+		rising.resize(values.size());
+		rising[0] = values[0];
+		for (size_t i = 1; i <= steps; i++) rising[i] = std::max(rising[i - 1], values[i]);
+		bins.assign(WORTH_INVERSE_BINS + 1, steps);
+		binScale = (rising[steps] > 0.f) ? WORTH_INVERSE_BINS / rising[steps] : 0.f;
+		size_t i = 0;
+		for (size_t j = 0; j <= WORTH_INVERSE_BINS && binScale > 0.f; j++) {
+			const float worth = j / binScale;
+			while (i < steps && rising[i] < worth) i++;
+			bins[j] = i;
+		}
+	}
+	// First step whose worth reaches 'relative', the top step if none does
+	size_t firstStepAt(float relative) const {
+		const size_t steps = values.size() - 1;
+		if (!(relative > rising[0])) return 0;
+		if (relative > rising[steps]) return steps;
+		size_t lo = 0, hi = steps;
+		if (binScale > 0.f) {
+			const size_t bin = std::min((size_t)(relative * binScale), WORTH_INVERSE_BINS - 1);
+			lo = bins[bin];
+			hi = bins[bin + 1];
+			// The worth rounded into a neighbouring bin
+			if (lo > 0 && rising[lo - 1] >= relative) lo = 0;
+			if (rising[hi] < relative) hi = steps;
+		}
+		return std::lower_bound(rising.begin() + lo, rising.begin() + hi + 1, relative) - rising.begin();
+	}
+public:
+	bool empty() const { return values.empty(); }
+	size_t steps() const { return values.size() - 1; }
+	const float* data() const { return values.data(); }
+	float* data() { return values.data(); }
+	double* derivativeData() { return derivative.data(); }
+	size_t maxDerivative() const { return maxIndex; }
+	float at(size_t step) const { return values[step]; }
+
+	void fromFit(const WorthFit& fit, size_t steps, float worth) {
+		resize(steps);
+		const double stepSize = 1.0 / steps;
+		for (size_t i = 1; i <= steps; i++) values[i] = (float)(fit(i * stepSize, worth) / worth);
+		finish();
+	}
+	// Linear interpolation between the measured points, constant beyond the first and the last one
+	void fromPoints(const Points& points, size_t steps, float worth) {
+		resize(steps);
+		size_t p = 0;
+		for (size_t i = 1; i <= steps; i++) {
+			const float x = (float)i / steps;
+			while (p + 1 < points.size() && points[p + 1].first < x) p++;
+			float pcm;
+			if (x <= points.front().first) pcm = points.front().second;
+			else if (p + 1 == points.size()) pcm = points.back().second;
+			else {
+				const float a = (x - points[p].first) / (points[p + 1].first - points[p].first);
+				pcm = points[p].second + a * (points[p + 1].second - points[p].second);
+			}
+			values[i] = pcm / worth;
+		}
+		finish();
+	}
+
+	// Fractional step where the curve reaches the relative worth, interpolated between the steps
+	float positionOf(float relative) const {
+		const size_t i = firstStepAt(relative);
+		if (i == 0 || values[i] <= relative) return (float)i;
+		const float a = (values[i] - relative) / (values[i] - values[i - 1]);
+		return (i - 1) * a + i * (1.f - a);
+	}
+
+	/* Reads a measured S-curve: one "<relative position> <worth in pcm>" pair per line, positions
+	rising from 0 (bottom) to 1 (top), lines starting with # are comments */
+	static bool loadPoints(const std::string& fileName, Points& points) {
+		std::ifstream ifs(fileName);
+		if (!ifs) {
+			std::cerr << "Error opening rod worth curve: " << fileName << std::endl;
+			return false;
+		}
+		Points read;
+		std::string line;
+		while (std::getline(ifs, line)) {
+			if (line.empty() || line[0] == '#') continue;
+			std::istringstream ls(line);
+			float x, pcm;
+			if (!(ls >> x >> pcm) || x < 0.f || x > 1.f || (!read.empty() && x <= read.back().first)) {
+				std::cerr << "Invalid rod worth curve " << fileName << ": " << line << std::endl;
+				return false;
+			}
+			read.emplace_back(x, pcm);
+		}
+		if (read.size() < 2) {
+			std::cerr << "Rod worth curve " << fileName << " needs at least two points" << std::endl;
+			return false;
+		}
+		points.swap(read);
+		return true;
+	}
+};
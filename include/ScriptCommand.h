@@ -1,6 +1,9 @@
 #ifndef SCRIPT_COMMAND_H
 #define SCRIPT_COMMAND_H
+#include <deque>
+#include <limits>
 #include <string>
+#include <vector>
 #include <iostream>
 
 enum operation {
@@ -19,6 +22,13 @@ enum commands {
 	setAlphaT1,
 	setAlphaK,
 	saveToFile,
+	saveToBinaryFile,
+	// Value is the directory of the history journal, saveJournalToBinaryFile writes all of it
+	startJournal,
+	saveJournalToBinaryFile,
+	// Value is the checkpoint file, see Simulator::saveCheckpoint
+	saveCheckpoint,
+	loadCheckpoint,
 	exitSimulator,
 	setSimulationSpeed,
 	setSimulationMode,
@@ -28,20 +38,120 @@ enum commands {
 	setRegulatingSteps,
 	setCvCoeffC,
 	setCvCoeffPropA,
-	setCvCoeffPropB
+	setCvCoeffPropB,
+	// Settings tab commands, the value in the units of the setting
+	setExcessReactivity,		// pcm
+	setSafetyBladesWorth,		// pcm
+	setPromptNeutronLifetime,	// s
+	setCoreVolume,				// m3
+	setSourceActivity,			// n/s
+	setPowerLimit,				// W
+	setPeriodLimit,				// s
+	setWaterLevelLimit,			// m
+	setDetector1Factor,			// CPS/W
+	setDetector2Factor,			// CPS/W
+	setDwellTime,				// s
+	setGodMode,					// 1 or 0
+	// Value is <group>:<value> for the delayed neutron groups 0 to 5: the fraction, the decay constant (1/s) or 1/0
+	setDelayedGroupFraction,
+	setDelayedGroupDecay,
+	setDelayedGroupEnabled,
+	// Value is <Simulator::ScramSignals bit>:<1|0>
+	setScramEnabled,
+	// Operator commands, rod is the index of the targeted control rod
+	moveRod,
+	// Value is the step the rod is put at, at once and without its speed
+	setRodPosition,
+	setRodSpeed,
+	// Value is the total worth of the rod in pcm
+	setRodWorth,
+	setRodEnabled,
+	toggleRodEnabled,
+	rodToTop,
+	rodToBottom,
+	clearRodCommands,
+	// Value is a measured worth curve file (see RodWorthCurve::loadPoints), or "fit" for the built-in fit
+	setRodCurve,
+	setNeutronSource,
+	setSafetyBlades,
+	scramReactor,
+	// Value is the integrator name: RK4, SDIRK2 or RK45
+	setIntegrator,
+	// Value is <name>:<CPS/W>[:<dead time in s>[:<dwell time in s>]], see Simulator::addDetector
+	addDetector,
+	// Value is the slow mode step in s, 0 for the full kinetics, see Simulator::setSlowMode
+	setSlowMode,
+	// Value is the power in W the iodine and xenon are in equilibrium with
+	setPoisonEquilibrium,
+	// Value is <subsystem>:<period in steps>[:<phase>], see Simulator::setSubsystemRate
+	setSubsystemRate,
+	// Value is <name>:<signal>:<above|below|positiveBelow>:<setpoint>[:<delay in s>[:<coincidence>]], see Simulator::addTrip
+	addTrip,
+	unknownCommand
 };
 
 
 
 struct Command {
-	double timed;
+	double timed = 0.;
 	std::string strCommand;
-	commands command;
+	commands command = unknownCommand;
 	std::string value;
+	int rod = -1;
+	// The value parsed once when the command is read, numeric is false if it is not a number
+	double number = 0.;
+	bool numeric = false;
+
+	void parseValue();
+
+	template<class Archive>
+	void serialize(Archive& archive) { archive(timed, strCommand, command, value, rod); }
+};
+
+/* Script commands ordered by time, commands with the same time run in the order they were
+added. Scripts are mostly added in time order, so adding one is usually an append */
+class ScriptQueue {
+private:
+	std::deque<Command> queue;
+public:
+	bool empty() const { return queue.empty(); }
+	size_t size() const { return queue.size(); }
+	void clear() { queue.clear(); }
+	std::deque<Command>::const_iterator begin() const { return queue.begin(); }
+	std::deque<Command>::const_iterator end() const { return queue.end(); }
+
+	// Parses the value of the command and puts it after the commands due at the same time or before
+	void push(Command command);
+	// Time of the next command, infinity if there is none
+	double nextTime() const { return queue.empty() ? std::numeric_limits<double>::infinity() : queue.front().timed; }
+	Command pop() {
+		Command command = queue.front();
+		queue.pop_front();
+		return command;
+	}
+	// Moves every command by dt seconds
+	void shift(double dt) { for (Command& command : queue) command.timed += dt; }
+
+	template<class Archive>
+	void serialize(Archive& archive) {
+		archive(queue);
+		for (Command& command : queue) command.parseValue();
+	}
 };
 
 commands hashit(std::string const& strCommand);
+const std::string& commandName(commands command);
+// True for the commands whose value is a number
+bool numericCommand(commands command);
+// Builds a command for immediate execution (used by the GUI and the serial box)
+Command makeCommand(commands command, const std::string& value = "0", int rod = -1);
 bool compareByTime(const Command& a, const Command& b);
+// A number as a command value, it parses back to the same double
+std::string numberValue(double value);
+// The fields of a value like <name>:<signal>:<setpoint>, split at the colons
+std::vector<std::string> splitFields(const std::string& value);
+// The value as it is written to scripts and sessions, in double quotes if it is empty or has spaces
+std::string quoteValue(const std::string& value);
 std::istream& operator>>(std::istream& is, Command& p);
 std::ostream& operator<<(std::ostream& os, const Command& p);
 
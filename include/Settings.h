@@ -1,5 +1,8 @@
 #pragma once
 #include <cereal/archives/json.hpp>
+#include <cereal/types/string.hpp>
+#include <cereal/types/vector.hpp>
+#include <fstream>
 /*==================
 DEFAULT VALUES - CROCUS adapted
 =====================*/
@@ -40,10 +43,13 @@ constexpr auto SHIM_ROD_STEPS_DEFAULT = 10000;
 constexpr auto SAFETY_ROD_SPEED_DEFAULT = 1e3;
 constexpr auto REGULATORY_ROD_SPEED_DEFAULT = 1e3;
 constexpr auto SHIM_ROD_SPEED_DEFAULT = 22;
+// Water level steps the vessel is drained to by a SCRAM, a lower level is left as it is
+constexpr auto WATER_LEVEL_SCRAM_STEPS_DEFAULT = 6170;
 
 // Operational limits
 constexpr auto DOUBLINGTIME_SCRAM_DEFAULT = 9; // for CROCUS the automatic SCRAM is activated once the doubling time is less than 9s
 constexpr auto PERIOD_SCRAM_DEFAULT = DOUBLINGTIME_SCRAM_DEFAULT / std::log(2);		// seconds
+constexpr auto PERIOD_SCRAM_DELAY = 2.5;	// seconds the period has to stay below the limit
 constexpr auto POWER_SCRAM_DEFAULT = 100;	// watts
 constexpr auto FUEL_TEMPERATURE_SCRAM_DEFAULT = 300;		// celsius
 constexpr auto WATER_TEMPERATURE_SCRAM_DEFAULT = 80;		// celsius
@@ -96,6 +102,8 @@ constexpr auto ALPHA_K_DEFAULT = - 0.004;
 // Delete old data (seconds)
 constexpr auto DELETE_OLD_DATA_TIME_DEFAULT = 10800.0;
 constexpr auto POISON_DATA_DEL_DIVISION = 5000;
+// Steps between the stored fuel temperatures (10 Hz), a divisor of POISON_DATA_DEL_DIVISION
+constexpr auto TEMPERATURE_DATA_DIVISION = 100;
 
 // Automatic mode
 constexpr auto KEEP_CURRENT_POWER_DEFAULT = true;
@@ -130,7 +138,7 @@ constexpr auto PULSE_END_AFTER_DEFAULT = 0.4;
 constexpr auto DEFAULT_DATA_DIVISION = 100;
 
 // IMPORTANT
-const auto SETTINGS_NUMBER = 94;
+const auto SETTINGS_NUMBER = 95;
 const auto SETTINGS_VERSION = 1.1f;
 
 class Settings {
@@ -168,6 +176,39 @@ public:
 		}
 	};
 
+	// How a rod is modelled: its worth curve fit and what it does on a SCRAM
+	enum class RodKind : std::uint8_t {
+		Absorber,	// a control rod, worth from the rod fit
+		WaterLevel	// the moderator level, driven like a rod, worth from the water level fit
+	};
+	enum class ScramAction : std::uint8_t {
+		Hold,		// the commands are cleared, the rod stays where it is
+		Drop,		// driven to the bottom at its speed, then disabled
+		Drain		// brought down to scramPosition at once if it is above, then disabled
+	};
+
+	// One rod of the bank, the three CROCUS rods come from rodSettings and extra ones from extraRods
+	struct RodDefinition {
+	public:
+		std::string name;
+		RodKind kind = RodKind::Absorber;
+		ControlRodSettings settings;
+		ScramAction scram = ScramAction::Hold;
+		float scramPosition = 0.f;
+		// A measured S-curve (see RodWorthCurve::loadPoints) used instead of the fit when not empty
+		std::string curveFile;
+
+		RodDefinition(const std::string& name_, RodKind kind_, const ControlRodSettings& settings_, ScramAction scram_, float scramPosition_ = 0.f)
+			: name(name_), kind(kind_), settings(settings_), scram(scram_), scramPosition(scramPosition_) {}
+		RodDefinition() {}
+
+		template<class Archive>
+		void serialize(Archive& archive)
+		{
+			archive(name, kind, settings, scram, scramPosition, curveFile);
+		}
+	};
+
 	struct SimulationSettings {
 	public:
 		float period;
@@ -297,6 +338,8 @@ public:
 
 	bool squareWaveUsesRodSpeed = false;							// 94
 
+	std::vector<RodDefinition> extraRods;							// 95
+
 
 	// DO NOT ADD SETTINGS UNDER THIS LINE
 	
@@ -309,8 +352,23 @@ public:
 		memcpy(groupsEnabled, delayedGroupsEnabledDefault, 6 * sizeof(bool));
 	};
 
+	// The rods of the reactor in bank order: the safety, regulating and shim rods, then extraRods
+	std::vector<RodDefinition> rodBank() const {
+		std::vector<RodDefinition> bank = {
+			RodDefinition(SAFETY_ROD_NAME_DEFAULT, RodKind::Absorber, rodSettings[0], ScramAction::Hold),
+			RodDefinition(REGULATORY_ROD_NAME_DEFAULT, RodKind::Absorber, rodSettings[1], ScramAction::Hold),
+			RodDefinition(SHIM_ROD_NAME_DEFAULT, RodKind::WaterLevel, rodSettings[2], ScramAction::Drain, (float)WATER_LEVEL_SCRAM_STEPS_DEFAULT)
+		};
+		bank.insert(bank.end(), extraRods.begin(), extraRods.end());
+		return bank;
+	}
+
 	void saveArchive(std::string fileName) {
 		std::ofstream os(fileName);
+		saveArchive(os);
+	}
+
+	void saveArchive(std::ostream& os) {
 		cereal::JSONOutputArchive archive(os);
 
 		archive(rodSettings,
@@ -366,7 +424,8 @@ public:
 			yAxisLog,
 			automaticPulseScram,
 			reactivityHardcore,
-			squareWaveUsesRodSpeed
+			squareWaveUsesRodSpeed,
+			extraRods
 		);
 
 	}
@@ -430,6 +489,12 @@ public:
 			reactivityHardcore,
 			squareWaveUsesRodSpeed
 		);
-
+		// Files saved before the rod bank end here and have no extra rods
+		try {
+			iarchive(extraRods);
+		}
+		catch (const cereal::Exception&) {
+			extraRods.clear();
+		}
 	}
 };
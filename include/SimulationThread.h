@@ -0,0 +1,143 @@
+#pragma once
+/*
+	SimulationThread.h steps the Simulator on its own thread so the
+	kinetics do not depend on the frame rate of the GUI
+*/
+#include <Simulator.h>
+#include <ScriptCommand.h>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <vector>
+#include <functional>
+
+// Maximum number of DT_STEP iterations done while holding the simulator lock
+constexpr size_t SIMULATION_SLICE_ITERATIONS = 100;
+// Number of commands the GUI can queue before the simulation thread picks them up
+constexpr size_t COMMAND_QUEUE_SIZE = 1024;
+// Rods of the bank the snapshot carries, the settings rods and the extra rods
+constexpr size_t SNAPSHOT_MAX_RODS = 16;
+
+// Values the GUI displays every frame, published by the simulation thread
+struct FrameSnapshot {
+	double time = 0.;
+	double power = 0.;
+	double flux = 0.;
+	double period = 0.;
+	double asymPeriod = 0.;
+	float reactivity = 0.f;
+	float rodReactivity = 0.f;
+	float temperature = 0.f;
+	double waterTemperature = 0.;
+	double waterLevel = 0.;
+	// The first rodCount rods of the bank
+	size_t rodCount = 0;
+	float rodExactPosition[SNAPSHOT_MAX_RODS] = { 0.f };
+	float rodActualPosition[SNAPSHOT_MAX_RODS] = { 0.f };
+	bool rodEnabled[SNAPSHOT_MAX_RODS] = { false };
+	int scramStatus = 0;
+	bool sourceInserted = false;
+	bool safetyBladesInserted = false;
+	// Step of the slow mode (s), 0 at the full kinetics
+	double slowStep = 0.;
+	// Ring buffer index of the newest sample and of the oldest valid sample
+	size_t currentIndex = 0;
+	size_t oldestIndex = 0;
+	size_t iterations = 0;
+	// Time of the oldest valid sample (s), the samples are not evenly spaced after a slow mode
+	double oldestTime = 0.;
+};
+
+/*
+	Triple buffer with one writer and one reader: the writer fills the back slot and swaps it with
+	the middle one, the reader swaps the middle slot with its front slot whenever it is newer.
+	Neither side ever waits and the reader always gets a complete value.
+*/
+template <class T>
+class SnapshotBuffer {
+private:
+	static constexpr int DIRTY = 4;
+	T slots[3];
+	std::atomic<int> middle{ 1 };
+	int back = 0;
+	int front = 2;
+public:
+	// Writer side
+	void publish(const T& value) {
+		slots[back] = value;
+		back = middle.exchange(back | DIRTY, std::memory_order_acq_rel) & ~DIRTY;
+	}
+	// Reader side, returns the latest published value
+	const T& read() {
+		if (middle.load(std::memory_order_relaxed) & DIRTY) {
+			front = middle.exchange(front, std::memory_order_acq_rel) & ~DIRTY;
+		}
+		return slots[front];
+	}
+};
+
+// Lock free queue with a single producer (GUI thread) and a single consumer (simulation thread)
+class CommandQueue {
+private:
+	Command buffer[COMMAND_QUEUE_SIZE];
+	std::atomic<size_t> head{ 0 }; // next slot to read
+	std::atomic<size_t> tail{ 0 }; // next slot to write
+public:
+	bool push(const Command& command) {
+		size_t t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) == COMMAND_QUEUE_SIZE) return false;
+		buffer[t % COMMAND_QUEUE_SIZE] = command;
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+	bool pop(Command& command) {
+		size_t h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire)) return false;
+		command = std::move(buffer[h % COMMAND_QUEUE_SIZE]);
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+};
+
+class SimulationThread {
+private:
+	Simulator* reactor;
+	std::thread worker;
+	std::atomic<bool> running{ false };
+
+	// Held while the simulator is stepped or accessed directly
+	std::mutex simMutex;
+	// Number of threads waiting for simMutex, the worker backs off while it is non zero
+	std::atomic<int> waiting{ 0 };
+
+	CommandQueue commandQueue;
+	SnapshotBuffer<FrameSnapshot> snapshots;
+
+	// Work deferred from the simulation thread to the GUI thread (e.g. SCRAM callbacks)
+	std::mutex guiMutex;
+	std::vector<std::function<void()>> guiEvents;
+
+	void run();
+	void executeCommands();
+	void publishSnapshot();
+public:
+	SimulationThread(Simulator* reactor);
+	~SimulationThread();
+
+	void start();
+	void stop();
+
+	// Queues a command for the simulation thread, returns false if the queue is full
+	bool send(const Command& command);
+
+	// Exclusive access to the simulator for code that reads or changes it outside of the command queue
+	std::unique_lock<std::mutex> acquire();
+
+	// Latest published frame, only call from the GUI thread
+	const FrameSnapshot& snapshot() { return snapshots.read(); }
+
+	// Schedules work for the GUI thread, safe to call from the simulation thread
+	void postToGui(const std::function<void()>& event);
+	// Runs the scheduled work, must be called from the GUI thread while holding acquire()
+	void processGuiEvents();
+};
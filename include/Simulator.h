@@ -9,14 +9,43 @@
 #include <string>
 #include <deque>
 #include <functional>
+#include <atomic>
+#include <vector>
 #include <ControlRod.h>
-#include <nanogui/DataDisplay.h>
+#include <RodBank.h>
+#include <DetectorBank.h>
 #include <Settings.h>
 #include <ScriptCommand.h>
+#include <HistoryStore.h>
+#include <HistoryExport.h>
+#include <HistoryJournal.h>
+#include <HistoryPyramid.h>
+#include <PeriodEstimator.h>
+#include <PkeIntegrator.h>
+#include <SubsystemScheduler.h>
+#include <TripTable.h>
 #include <random>
+#include <limits>
 
 // Delta time
 constexpr auto DT_STEP = 0.001;  // seconds, changed form 0.001 for CROCUS
+// Step of the slow mode (s), see Simulator::setSlowMode. The longest keeps the explicit fuel
+// temperature step (time constant about 45 s) and the poison step accurate
+constexpr double SLOW_MODE_STEP_DEFAULT = 1.;
+constexpr double SLOW_MODE_STEP_MAX = 10.;
+// Fraction of beta above which the prompt jump approximation is left for the full kinetics
+constexpr double PROMPT_JUMP_LIMIT = 0.8;
+// Steps between updates of the iodine and xenon concentrations, they change slowly
+constexpr std::uint32_t POISON_UPDATE_PERIOD = 125;
+// Longest kinetics period in steps (100 ms), only for the SDIRK2 and RK45 integrators
+constexpr std::uint32_t KINETICS_PERIOD_MAX = 100;
+
+// Reactor period: weight of older samples and length of the moving average
+constexpr auto PERIOD_WEIGHT = 0.01;
+constexpr size_t PERIOD_AVERAGE_SAMPLES = 500;
+
+// History saved with a checkpoint by default, the span of the plots
+constexpr double CHECKPOINT_HISTORY_DEFAULT = DISPLAY_TIME_DEFAULT;
 
 constexpr auto AVOGADRO_NUM = 6.0221409e+23;
 constexpr auto XENON_MOLAR_MASS = 134.907;
@@ -56,6 +85,8 @@ private:
 	void recalculatePoisonConcentrations(double dt);
 	double Xe_conc = 0;
 	double I_conc = 0;
+	// Length of a slow mode step (s), 0 when the kinetics run at DT_STEP
+	double slowStepLength = 0.;
 
 	double startTime = -1.;
 	double actualTime = 0;
@@ -145,24 +176,6 @@ private:
 
 public:
 
-	// Classes for use in Simulator.cpp
-	struct PowerExtreme {
-		// The new order this extreme got to
-		int order = 0;
-		// The index at which this happened
-		double when = 0.;
-		// Value to hold if the order is negative infinity
-		bool isZero = false;
-
-		PowerExtreme(int order, double time) {
-			this->order = order;
-			this->when = time;
-		}
-		PowerExtreme() {
-			isZero = true;
-		}
-	};
-
 	struct PulseData {
 		double peakPower = 0.;
 		double FWHM = 0.;
@@ -193,12 +206,59 @@ public:
 
 	float acquisitionStartTime = 0.0f;
 
+	// The file exports block until the file is written, startExport writes it in the background
 	void dataToFile(std::string fileName);
 
+	// Writes every sample in the history to fileName.bin, see HistoryFile.h for the format
+	void dataToBinaryFile(std::string fileName);
+
 	void rodsToFile(std::string fileName);
 
 	void CountsToFile(std::string fileName);
 
+	// Captures the history now and writes it on a worker thread while the simulation continues.
+	// The simulator owns the export and deletes it in the frame after it has finished
+	HistoryExport* startExport(ExportFormat format, const std::string& fileName);
+	const std::vector<HistoryExport*>& getExports() const { return exports; }
+
+	// From now on every sample is also copied to segment files in 'directory', so the history is no longer
+	// limited to the ring (see HistoryJournal.h). The journal starts with the oldest sample in the ring,
+	// an empty directory stops it. maxSegments limits the disk space used, 0 keeps everything
+	bool setJournal(const std::string& directory, size_t segmentSamples = JOURNAL_SEGMENT_SAMPLES_DEFAULT, size_t maxSegments = 0);
+	HistoryJournal* getJournal() const { return journal; }
+	// Writes the journaled samples between two simulation times to fileName.bin, in the format of dataToBinaryFile
+	bool journalToBinaryFile(std::string fileName, double fromTime, double toTime);
+
+	// Min/max pyramid of a float history column (e.g. counts_detector1_noisy_), created on the first
+	// call and from then on updated with every new sample. The simulator owns it
+	HistoryPyramid* getPyramid(const float* column);
+	ColumnPyramid<double>* getPyramid(const double* column);
+	// Minimum, maximum, argmax, mean and integral of a history column between two simulation times
+	template <class T>
+	typename ColumnPyramid<T>::Envelope historyStats(const T* column, double fromTime, double toTime) {
+		ColumnPyramid<T>* pyramid = getPyramid(column);
+		pyramid->update(iterations_total);
+		const size_t from = getIterationFromTime(fromTime);
+		const size_t to = getIterationFromTime(std::max(fromTime, toTime));
+		return pyramid->query(from, (iterations_total > 0) ? to + 1 - from : 0);
+	}
+
+	// Writes the complete dynamic state (kinetics, poisons, temperatures, rods and their commands, waveforms,
+	// detector noise, pending script commands) and the last historyTime seconds of the history to a binary file
+	bool saveCheckpoint(const std::string& fileName, double historyTime = CHECKPOINT_HISTORY_DEFAULT);
+	// Continues the simulation from a checkpoint, its history is put at the start of the ring. A file that
+	// cannot be read leaves the simulation as it was, apart from the history older than a few seconds
+	bool loadCheckpoint(const std::string& fileName);
+
+	// Logs every command executed from now on (script, GUI or serial box) to fileName, stamped with the number
+	// of iterations since the recording started, and saves the state at the start to fileName.ck. A reset
+	// ends the recording, an empty name stops it
+	bool setRecording(const std::string& fileName);
+	bool isRecording() const { return recording != nullptr; }
+	// Restores the start of a recorded session and executes its commands at the iterations they were
+	// recorded at, as fast as the CPU allows. The replay is bit for bit identical to the recorded run
+	bool replaySession(const std::string& fileName);
+
 	void setDemoMode();
 	void setHighPowerDemoMode();
 
@@ -233,30 +293,28 @@ public:
 	void setTemperatureEffectsEnabled(const bool& value);
 	const bool& getFissionPoisoningEffectsEnabled() { return fissionPoisoning_effects; }
 	void setFissionPoisoningEffectsEnabled(const bool& value);
+	// Method used to integrate the point kinetics equations, default is RK4
+	IntegratorType getIntegrator() const { return integrator->type(); }
+	// RK4 is not stable at long steps, it sets the kinetics back to every step
+	void setIntegrator(IntegratorType type);
+	// Steps the integrator could not finish (RK45 out of substeps) since init
+	size_t getIncompleteKineticsSteps() const { return incompleteKineticsSteps; }
 
 	const size_t getCurrentIndex() const {
-		if (iterations_total > 0) {
-			return (iterations_total - 1) % dataPoints;
-		}
-		else {
-			return iterations_total;
-		}
+		return cursor.getCurrent();
 	}
 	const size_t getNextIndex() const {
-		return iterations_total % dataPoints;
+		return cursor.getNext();
 	}
 	const size_t shiftIndex(size_t index, long shift) const {
-		if (shift + (long)index >= (long)dataPoints) {
-			return (shift + index) % dataPoints;
-		}
-		else if (shift + (long)index < 0L) {
-			return dataPoints + shift + index;
-		}
-		else {
-			return shift + index;
-		}
+		return cursor.shift(index, shift);
 	}
 
+	// Number of DT_STEP iterations done since the start of the simulation
+	const size_t getIterationsTotal() const { return iterations_total; }
+	// Iteration the period average restarted at, see PeriodEstimator
+	size_t getAverageStart() const { return resetAverage; }
+
 	const size_t getOldestIndex() const {
 		return (iterations_total > dataPoints) ? getNextIndex() : (size_t)0;
 	}
@@ -407,10 +465,17 @@ public:
 	// I think this is quite self explanatory
 	void scram(ScramSignals reason);
 
+	/* Adds a trip after the operational limits, see TripTable. Its reason is a ScramSignals bit,
+	User if none is given */
+	void addTrip(TripDefinition trip);
+	// The compiled protection system with its event log
+	const TripTable& getTripTable() const { return trips; }
+
 	int getScramStatus() { return status; }
 
 	// Control rods
-	ControlRod* rods[NUMBER_OF_CONTROL_RODS];
+	// The three CROCUS rods first, then the extra rods of the settings
+	RodBank rods;
 	ControlRod* safetyRod() { return rods[0]; }
 	ControlRod* regulatingRod() { return rods[1]; }
 	ControlRod* shimRod() { return rods[2]; }
@@ -424,8 +489,29 @@ public:
 	// Functions for returning poison concentrations
 	double* getXenonConcentration() { return &Xe_conc; }
 	double* getIodineConcentration() { return &I_conc; }
-	float* xenon_;
-	float* iodine_;
+	// Sets iodine and xenon to their equilibrium at a constant power (W), e.g. after days of operation
+	void setPoisonEquilibrium(double power);
+
+	/* Slow mode: steps of 'step' seconds (at most SLOW_MODE_STEP_MAX) for hours or days of poison,
+	water and fuel temperature dynamics. The neutrons follow the precursors by the prompt jump
+	approximation instead of the point kinetics. A pulse or rods that can bring the reactivity above
+	PROMPT_JUMP_LIMIT times beta within a step go back to DT_STEP, as does a step of 0. Returns
+	false if the step is refused */
+	bool setSlowMode(double step);
+	double getSlowStepLength() const { return slowStepLength; }
+	// Length of the steps the simulation is currently taking (s)
+	double getStepLength() const { return slowStepLength > 0. ? slowStepLength : DT_STEP; }
+
+	/* Runs a subsystem every 'period' steps, at the steps where step % period == phase (see
+	SubsystemScheduler). The poison storage keeps its rate. The kinetics can run every
+	KINETICS_PERIOD_MAX steps at most with the SDIRK2 or RK45 integrator, a pulse sets them back to
+	every step. The slow mode runs every subsystem at each of its steps. Returns false if the rate
+	is refused */
+	bool setSubsystemRate(Subsystem subsystem, std::uint32_t period, std::uint32_t phase = 0);
+	const SubsystemScheduler& getScheduler() const { return scheduler; }
+	// Stored every POISON_DATA_DEL_DIVISION steps, see HistoryStore
+	DecimatedColumn* xenon_;
+	DecimatedColumn* iodine_;
 
 	// Returns the current reactivity(in pcm) in the reactor.
 	double getCurrentReactivity() const;
@@ -433,17 +519,17 @@ public:
 	const float *getReactivity() const;
 	float* reactivity_;
 
-	std::string* n_source;
-	std::string* safety_blades;
+	// Per-sample history, the data arrays of this class point into its columns
+	HistoryStore* history;
 
 	// Returns reactor period
 	double *getReactorPeriod();
 	// Returns the current reactor period (in s) in the reactor - added to show in putput file
 	float getCurrentReactorPeriod() const;
-	double* reactorPeriod_;
+	float* reactorPeriod_;
 	// Returns the current doubling time in the reactor.
 	float getCurrentDoublingTime() const;
-	double* doublingTime_;
+	float* doublingTime_;
 
 	// Returns reactor asymptotic
 	double *getReactorAsymPeriod();
@@ -453,14 +539,16 @@ public:
 	// Returns the entire data array for reactivity.
 	const float *getRodReactivity() const;
 	float* rodReactivity_;
-	float** rodPositions_;  // 2D array: [3 rods][time steps]
+	float** rodPositions_;  // 2D array: [rods][time steps]
 
 
 	// Returns the current temperature(in kelvin) in the reactor.
 	float getCurrentTemperature() const;
-	// Returns the entire data array for temperature.
-	const float *getTemperature() const;
-	float* temperature_;
+	// Returns the history of the temperature, stored every TEMPERATURE_DATA_DIVISION steps.
+	const DecimatedColumn *getTemperature() const;
+	DecimatedColumn* temperature_;
+	// Fuel temperature (in celsius) the thermal step continues from, kept as the float it was stored as
+	float fuelTemperature = WATER_TEMPERATURE_DEFAULT;
 
 	// Water temperature(in celsius).
 	double *getWaterTemperature();
@@ -493,26 +581,24 @@ public:
 
 	// Added to simulate what detectors in CROCUS see
 	const double getCurrentCPS(float detector_convFactor);
-	double* CPS_detector1_;
-	double *counts_detector1_noisy_;   //vector with random fluctuations 
-	double* CPS_detector2_;
-	double *counts_detector2_noisy_;
-	std::mt19937 rng_;  
-	// ——— Dwell‐time noise sampling ———
-	size_t dwellCounter_ = 0;           // steps since last sample
-	double dwellSumCPS1_ = 0.0;          // sum of clean CPS this window
-	double dwellSumCPS2_ = 0.0;
-	double currentNoisyCPS1_ = 0.0;      // value to hold until next window
-	double currentNoisyCPS2_ = 0.0;
-
-	static constexpr double POISSON_TH   = 100.0;     // counts per dwell window
+	float* CPS_detector1_;
+	float *counts_detector1_noisy_;   //vector with random fluctuations 
+	float* CPS_detector2_;
+	float *counts_detector2_noisy_;
+	// Detector channels, the first two are the detectors above and use the system dwell time
+	DetectorBank detectors;
+	// Adds a channel with its own history columns (zero before now) and returns its index
+	size_t addDetector(const DetectorChannel& channel);
+	// Seeds the detector noise of this instance, runs with the same seed give the same counts
+	void setNoiseSeed(std::uint32_t seed) { noiseSeed = seed; detectors.seed(seed); }
+	std::uint32_t getNoiseSeed() const { return noiseSeed; }
 
 	int &getDet1Factor() { return det1_convFactor; }
-	void setDet1Factor(double value) { det1_convFactor = value; }
+	void setDet1Factor(double value) { det1_convFactor = value; syncSystemDetectors(); }
 	int det1_convFactor =  DETECT1_CONV_DEFAULT;
 
 	int &getDet2Factor() { return det2_convFactor; }
-	void setDet2Factor(double value) { det2_convFactor = value; }
+	void setDet2Factor(double value) { det2_convFactor = value; syncSystemDetectors(); }
 	int det2_convFactor =  DETECT2_CONV_DEFAULT;
 	// to know the number of elements of the CPS vectors 
 	size_t getDataPoints() const { return dataPoints; }
@@ -529,7 +615,9 @@ public:
 	double &getSpeedFactor();
 	double speedFactor = 0;;
 
+	// Ring index (or iteration) of the stored sample closest to a simulation time, the time steps need not be even
 	const size_t getIndexFromTime(double time) const;
+	size_t getIterationFromTime(double time) const;
 
 	double getStableTemperature(double P);
 
@@ -543,13 +631,6 @@ public:
 	const size_t &getCalculationsPerformed() const;
 	size_t calc_performed = 0;
 
-	// Returns the number of order changes since the start of the simulation.
-	size_t getOrderChanges() const;
-
-	// Returns the power extreme at the desired location
-	PowerExtreme &getExtremeAt(size_t i);
-	PowerExtreme trailingExtreme = PowerExtreme();
-
 	// Returns a boolean value if the simulation is paused or not
 	bool isPaused() const;
 
@@ -606,7 +687,15 @@ public:
 	double getAlphaSlope() { return alphaK; }
 	void setAlphaSlope(double value) { alphaK = value; }
 
-	void runLoop();
+	// Advances the simulation by the wall-clock time elapsed since the last call (times the speed factor),
+	// doing at most maxIterations steps. Returns the number of iterations performed
+	size_t runLoop(size_t maxIterations = std::numeric_limits<size_t>::max());
+
+	// Advances the simulation by a fixed number of DT_STEP iterations, independent of wall-clock time
+	void runIterations(size_t iterations);
+
+	// Appends the commands of a script file to scriptCommands, timed relative to the current simulation time
+	bool loadScriptFromFile(const std::string& path);
 
 	/*
 	Should recieve a pointer to a double array of size 7
@@ -632,8 +721,15 @@ public:
 
 	void setAutoScram(bool value) { autoScramAfterPulse = value; }
 
+	// Runs the script commands that are due, mainLoop calls it at the step they are due
 	void doScriptCommands();
-	std::vector<Command> scriptCommands;
+	ScriptQueue scriptCommands;
+
+	// Executes a single command immediately (script, GUI or serial box)
+	void executeCommand(const Command& command);
+
+	// True after the exitSimulator command, the owner of the simulator stops stepping it
+	bool isExitRequested() const { return exitRequested; }
 
 private:
 	bool pulsing = false;
@@ -645,47 +741,129 @@ private:
 	double time_at_peak = 0;
 	double pulse_startP = 0;
 	bool autoScramAfterPulse = AUTOMATIC_PULSE_SCRAM_DEFAULT;
+	bool exitRequested = false;
+
+	// JSON archive of the Settings last given to setProperties, stored in the binary export
+	std::string settingsJson = "{}";
+
+	// Background exports read the history while it is being written, before the samples below
+	// historyHead - dataPoints are overwritten the head moves past them (see HistoryExport)
+	std::atomic<size_t> historyHead{ 0 };
+	// Incremented whenever init() starts the history over
+	std::atomic<size_t> historyResets{ 0 };
+	std::vector<HistoryExport*> exports;
+	friend class HistoryExport;
+	HistoryJournal* journal = nullptr;
+	// Copies the new samples to the journal, stops the journal if that fails
+	void appendToJournal();
+	std::vector<HistoryPyramid*> pyramids;
+	std::vector<ColumnPyramid<double>*> doublePyramids;
+	void updatePyramids();
+	// The history starts over, the pyramids are rebuilt by the next update
+	void restartPyramids();
+	// Checkpoint loaded by the loadCheckpoint command, once the commands due at the same step have run
+	std::string pendingCheckpoint;
+	// Every member saved in a checkpoint except the history, see SimulatorCheckpoint.cpp
+	template <class Archive>
+	void serializeState(Archive& archive);
+	void writeCheckpoint(std::ostream& os, double historyTime);
+	void readCheckpoint(std::istream& is);
+	// Restores the checkpoint requested by a command, see doScriptCommands
+	void loadPendingCheckpoint();
+	// Session recording, see setRecording
+	std::ofstream* recording = nullptr;
+	size_t recordedIterations = 0;
+	std::uint32_t noiseSeed = std::mt19937::default_seed;
+	// Points the detector channels and the rods to their history columns, allocating or freeing columns as needed
+	void attachColumns();
+	// Copies the conversion factors and the dwell time to the first two channels
+	void syncSystemDetectors();
+	// Logs and deletes the finished exports, or waits for all of them
+	void reapExports(bool wait);
 	
 	double ns_activity_temp = NEUTRON_SOURCE_ACTIVITY_DEFAULT;
 	double doseRate = 0;
 
 	// Variables controlling execution of the script
 	double scriptStart = 0.;
+	// A command is due at the step closest to its time
+	bool scriptDue() const { return scriptCommands.nextTime() <= getCurrentTime() + getStepLength() / 2; }
 	
 	double scriptTimer = 0;
 
 	// Increment neutron source simtulation time
 	void advanceSourceTime(double dt) { if(source_mode != SimulationModes::None) getSourceModeClass(source_mode)->handleAddTime((float)dt); };
 
-	// Variables for neutron changes
-	double temp_state[7] = { 0 }, delayed = 0, fissionRate = 0;
+	// Integrates the point kinetics equations each step
+	PkeIntegrator<PKE_DELAYED_GROUPS>* integrator = nullptr;
+	// Integrates pkeSystem over dt, logs the first step the integrator could not finish
+	void integrateKinetics(PkeState<PKE_DELAYED_GROUPS>& state, double dt);
+	size_t incompleteKineticsSteps = 0;
+	/* Kinetics slower than every step: the state integrated when they were due, reached after
+	kineticsRemaining more steps */
+	double kineticsTarget[7] = { 0. };
+	std::uint32_t kineticsRemaining = 0;
 
 	// Per frame calculations
 	void solvePerFrame();
+
+	// Monotonic wall-clock time in seconds, used to pace runLoop
+	static double getWallClockTime();
 	
 	// Initialization method
 	void init();
 
 	// A function that checks if operational limits have been crossed
 	void checkOperationalLimits();
+	// The operational limits and the added trips, evaluated in this order by checkOperationalLimits
+	TripTable trips;
+	std::vector<TripDefinition> extraTrips;
+	void compileTrips();
+	// Subsystem rates of a new simulator, see SubsystemScheduler
+	void resetSubsystemRates();
 
 	// The main calculation loop.
 	void mainLoop(size_t iterations);
+	// Steps the simulation up to 'iterations' times, stops early after the step where a script command falls due
+	size_t runSteps(size_t iterations);
+
+	// Body of mainLoop, instantiated for each combination of the flags it checks
+	template <bool TemperatureEffects, bool FissionPoisoning, bool SourceInserted, bool Pulsing, bool AutomaticRod>
+	void step();
+	// One step of the slow mode, see setSlowMode
+	void slowStep();
+	// In the automatic mode, moves the regulating rod to reach or maintain a constant power
+	// Moves the target of the regulating rod by rodAutoMove per step, over the 'steps' steps since the last move
+	void moveAutomaticRod(double power, std::uint32_t steps);
+	typedef void (Simulator::*StepFunction)();
+	StepFunction stepFunction = nullptr;
+	template <int Remaining, bool... Flags> friend struct StepSelector;
+	// Picks the step instantiation for the current flags, called whenever one of them changes
+	void selectStepFunction();
 
 	// Recalculate effective beta and lambda after change of "groups enabled"
 	void recalculateLambdaBetaEffective();
 
-	// Method for derivatives
-	void neutronChange(double* new_state, double* prev_state, double rho);
-	static void multiplyArray(double* in_array, double scalar);
-	static void arraySum(double* sum_array1, double* sum_array2, bool posOnly = false);
+	// Coefficients of the point kinetics equations, refreshed when the delayed groups or the prompt lifetime change
+	PkeSystem<PKE_DELAYED_GROUPS> pkeSystem;
+	void updatePkeSystem();
 	size_t iterations_total = 0;
+	// Ring indices of the newest and the next sample, they follow iterations_total
+	RingCursor cursor;
+	void setIterationsTotal(size_t iterations) {
+		iterations_total = iterations;
+		cursor.reset(iterations);
+		scheduler.sync(cursor.getNext());
+	}
+	void advanceIteration() {
+		iterations_total++;
+		cursor.advance();
+		scheduler.advance(cursor.getNext());
+	}
+	// Subsystems due at the next index
+	SubsystemScheduler scheduler;
 	size_t frames_total = 0;
 
-	deque<PowerExtreme>* powerExtremes = nullptr;
-
-	void addPowerExtremes();
-
 	void checkPulsingStatus();
 
 	double reactorPeriod = 0;
@@ -700,17 +878,13 @@ private:
 	double waterLevelLimit = WATER_LEVEL_SCRAM_DEFAULT;
 	double dwellTime = DWELLTIME_DEFAULT;
 
-	/*The scram on period will happen only if the period 
-	raises over the limit for more than a certain period, so 
-	we need a way to know how long has it passed since the period 
-	has risen too high*/
-	double periodTimer = 0;
-
 	// The status of the reactor
 	int status = ScramSignals::None;
 	int tempMode = TemperatureMode::Asymptotic;
 
 	size_t resetAverage = 0;
+	// Incremental reactor period over the sample pairs since resetAverage
+	PeriodEstimator<PERIOD_AVERAGE_SAMPLES - 1> periodEstimator{ PERIOD_WEIGHT, DT_STEP };
 
 	std::function<void(int)> scramCallback;
 	std::function<void()> scramResetCallback;
@@ -0,0 +1,133 @@
+#pragma once
+/*
+	SubsystemScheduler.h decides which parts of a step run at which sample. Every subsystem has a
+	period and a phase in DT_STEP samples and is due at the steps where
+		step % period == phase
+	with the steps counted by the scheduler's clock, which runs on across the wrap of the ring and is
+	saved in checkpoints. The ring length is not a multiple of the periods, so every run is exactly
+	'period' steps after the previous one only with a clock of its own. Ring aligned subsystems count
+	the ring index instead, for the samples of the decimated history columns.
+	A countdown per subsystem replaces the modulo, advance() is called once per step and the step
+	reads the mask of what is due. A subsystem that is not due keeps its last result, the next time
+	it runs it covers the 'period' steps since its last run.
+
+	The owner decides which rates it accepts, the simulator only runs the kinetics slower than every
+	step with an integrator stable at long steps. The poison storage follows the decimation of the
+	xenon and iodine columns and is not configurable.
+	A new subsystem only needs an entry in Subsystem and a name
+*/
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+enum Subsystem : std::uint8_t {
+	Kinetics,
+	FuelThermal,
+	WaterThermal,
+	Poisons,
+	PoisonStorage,	// samples of the xenon and iodine columns (POISON_DATA_DEL_DIVISION)
+	Detectors,
+	PeriodMeter,
+	Autopilot,
+	Protection,
+	SUBSYSTEM_COUNT
+};
+
+typedef std::uint32_t SubsystemMask;
+
+inline constexpr SubsystemMask subsystemBit(Subsystem s) { return (SubsystemMask)1 << s; }
+
+inline const char* subsystemName(Subsystem s) {
+	static const char* names[SUBSYSTEM_COUNT] = {
+		"kinetics", "fuelThermal", "waterThermal", "poisons", "poisonStorage",
+		"detectors", "periodMeter", "autopilot", "protection"
+	};
+	return (s < SUBSYSTEM_COUNT) ? names[s] : "unknown";
+}
+
+// Returns false if the name is not known
+inline bool subsystemFromName(const std::string& name, Subsystem& s) {
+	for (int i = 0; i < SUBSYSTEM_COUNT; i++) {
+		if (name == subsystemName((Subsystem)i)) {
+			s = (Subsystem)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+class SubsystemScheduler {
+private:
+	std::uint32_t periods[SUBSYSTEM_COUNT];
+	std::uint32_t phases[SUBSYSTEM_COUNT];
+	// Samples until the subsystem is due again, 0 if it is due at the upcoming index
+	std::uint32_t countdown[SUBSYSTEM_COUNT];
+	SubsystemMask due = 0;
+	// The upcoming step
+	std::uint64_t clock = 0;
+	// Subsystems whose phase refers to the ring index of the step instead of the clock
+	SubsystemMask ringAligned = 0;
+
+	void syncSubsystem(int i, std::uint64_t position) {
+		countdown[i] = (std::uint32_t)((phases[i] + periods[i] - position % periods[i]) % periods[i]);
+		if (countdown[i] == 0) due |= (SubsystemMask)1 << i;
+		else due &= ~((SubsystemMask)1 << i);
+	}
+public:
+	SubsystemScheduler() {
+		for (int i = 0; i < SUBSYSTEM_COUNT; i++) {
+			periods[i] = 1;
+			phases[i] = 0;
+		}
+		sync(0);
+	}
+
+	// Sets the period and phase of a subsystem, call sync() afterwards. False for invalid rates
+	bool setRate(Subsystem s, std::uint32_t period, std::uint32_t phase = 0) {
+		if (s >= SUBSYSTEM_COUNT || period == 0 || phase >= period) return false;
+		periods[s] = period;
+		phases[s] = phase;
+		return true;
+	}
+	std::uint32_t getPeriod(Subsystem s) const { return periods[s]; }
+	std::uint32_t getPhase(Subsystem s) const { return phases[s]; }
+	// False if a rate could not have been set by setRate (e.g. a damaged checkpoint)
+	bool valid() const {
+		for (int i = 0; i < SUBSYSTEM_COUNT; i++)
+			if (periods[i] == 0 || phases[i] >= periods[i]) return false;
+		return true;
+	}
+
+	void setRingAligned(SubsystemMask mask) { ringAligned = mask; }
+	// Sets the clock to 'step' (a new simulation), call sync() afterwards
+	void setClock(std::uint64_t step) { clock = step; }
+	std::uint64_t getClock() const { return clock; }
+
+	// Recalculates the countdowns for the upcoming step at the ring index 'index' (after a jump of the ring or a rate change)
+	void sync(size_t index) {
+		for (int i = 0; i < SUBSYSTEM_COUNT; i++)
+			syncSubsystem(i, (ringAligned & ((SubsystemMask)1 << i)) ? index : clock);
+	}
+	// Moves on to the following step, at the ring index 'index'
+	void advance(size_t index) {
+		clock++;
+		due = 0;
+		for (int i = 0; i < SUBSYSTEM_COUNT; i++) {
+			// The ring aligned subsystems start over where the ring wraps
+			if (index == 0 && (ringAligned & ((SubsystemMask)1 << i))) {
+				syncSubsystem(i, 0);
+				continue;
+			}
+			countdown[i] = countdown[i] ? countdown[i] - 1 : periods[i] - 1;
+			if (countdown[i] == 0) due |= (SubsystemMask)1 << i;
+		}
+	}
+
+	// Subsystems due at the upcoming index
+	SubsystemMask getDue() const { return due; }
+	bool isDue(Subsystem s) const { return (due & subsystemBit(s)) != 0; }
+
+	// The rates and the clock, the countdowns follow from them after loading
+	template<class Archive>
+	void serialize(Archive& archive) { archive(periods, phases, clock); }
+};
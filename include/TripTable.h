@@ -0,0 +1,243 @@
+#pragma once
+/*
+	TripTable.h evaluates the protection system: a flat table of trips, each comparing one signal
+	with its setpoint. A trip fires when its condition held for 'coincidence' consecutive
+	evaluations and for 'delay' seconds. The signals are read once per pass into an array, so a
+	new trip (doubling time, count rate, ...) is one more row and no new code in the step.
+
+	The setpoint and the enabled flag of a row can be bound to variables of the owner, limits set
+	from the GUI take effect without compiling the table again. The moment a condition starts is
+	interpolated between the last two evaluations, so the time of a trip does not depend on the
+	step length or on the rate of the protection. Fired trips are kept in a short event log
+*/
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum TripSignal : std::uint8_t {
+	PowerSignal,			// W
+	FuelTemperatureSignal,	// °C
+	WaterTemperatureSignal,	// °C
+	PeriodSignal,			// s
+	DoublingTimeSignal,		// s
+	CountRateSignal,		// CPS of the first detector channel
+	TRIP_SIGNAL_COUNT
+};
+
+enum class TripComparator : std::uint8_t {
+	Above,			// signal > setpoint
+	Below,			// signal < setpoint
+	PositiveBelow	// 0 < signal < setpoint, for periods
+};
+
+// State of the simulator a row depends on, see TripDefinition::modes and inhibits
+enum TripCondition : std::uint8_t {
+	NormalMode = 1,
+	GodMode = 2,
+	PulsingCondition = 4,
+	RodSimulationCondition = 8
+};
+
+inline const char* tripSignalName(TripSignal s) {
+	static const char* names[TRIP_SIGNAL_COUNT] = {
+		"power", "fuelTemperature", "waterTemperature", "period", "doublingTime", "countRate"
+	};
+	return (s < TRIP_SIGNAL_COUNT) ? names[s] : "unknown";
+}
+
+// Returns false if the name is not known
+inline bool tripSignalFromName(const std::string& name, TripSignal& s) {
+	for (int i = 0; i < TRIP_SIGNAL_COUNT; i++) {
+		if (name == tripSignalName((TripSignal)i)) {
+			s = (TripSignal)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+inline bool tripComparatorFromName(const std::string& name, TripComparator& c) {
+	if (name == "above") c = TripComparator::Above;
+	else if (name == "below") c = TripComparator::Below;
+	else if (name == "positiveBelow") c = TripComparator::PositiveBelow;
+	else return false;
+	return true;
+}
+
+struct TripDefinition {
+	std::string name;
+	TripSignal signal = PowerSignal;
+	TripComparator comparator = TripComparator::Above;
+	double setpoint = 0.;
+	double delay = 0.;					// s
+	std::uint32_t coincidence = 1;		// consecutive evaluations
+	std::uint8_t reason = 0;			// the Simulator::ScramSignals bit of the trip
+	bool enabled = true;
+	std::uint8_t modes = NormalMode;	// TripCondition mode bits the row is evaluated in
+	std::uint8_t inhibits = 0;			// TripCondition bits that keep the row from firing
+	bool exclusive = false;				// a firing row ends the pass (the limits beyond any setting)
+	int severity = -1;					// argument of the severe error callback, -1 for none
+	// Variables of the owner read instead of setpoint and enabled, not saved
+	const double* boundSetpoint = nullptr;
+	const bool* boundEnabled = nullptr;
+
+	TripDefinition() {}
+	TripDefinition(const std::string& name, TripSignal signal, TripComparator comparator, double setpoint, std::uint8_t reason) {
+		this->name = name;
+		this->signal = signal;
+		this->comparator = comparator;
+		this->setpoint = setpoint;
+		this->reason = reason;
+	}
+
+	template<class Archive>
+	void serialize(Archive& archive) {
+		archive(name, signal, comparator, setpoint, delay, coincidence, reason, enabled, modes, inhibits, exclusive, severity);
+	}
+};
+
+struct TripEvent {
+	double time = 0.;		// s, interpolated
+	float value = 0.f;		// signal at the evaluation that fired
+	std::uint8_t trip = 0;	// row of the table
+
+	template<class Archive>
+	void serialize(Archive& archive) { archive(time, value, trip); }
+};
+
+class TripTable {
+private:
+	struct Row {
+		TripDefinition definition;
+		const double* setpoint = nullptr;
+		const bool* enabled = nullptr;
+		// Start of the condition (s), consecutive evaluations it held and the last evaluation
+		double onset = 0.;
+		std::uint32_t count = 0;
+		double lastValue = 0.;
+		double lastTime = -1.;
+	};
+	std::vector<Row> rows;
+
+	static constexpr size_t LOG_SIZE = 64;
+	TripEvent log[LOG_SIZE];
+	size_t logged = 0;
+
+	static bool holds(TripComparator comparator, double value, double setpoint) {
+		switch (comparator) {
+		case TripComparator::Above: return value > setpoint;
+		case TripComparator::Below: return value < setpoint;
+		default: return value < setpoint && value > 0.;
+		}
+	}
+public:
+	TripTable() {}
+	TripTable(const TripTable&) = delete;
+	TripTable& operator=(const TripTable&) = delete;
+
+	/* Builds the table from the definitions in the order of evaluation. Rows with the name of an
+	existing row keep its state */
+	void compile(const std::vector<TripDefinition>& definitions) {
+		std::vector<Row> compiled(definitions.size());
+		for (size_t i = 0; i < definitions.size(); i++) {
+			compiled[i].definition = definitions[i];
+			for (const Row& old : rows) {
+				if (old.definition.name != definitions[i].name) continue;
+				compiled[i].onset = old.onset;
+				compiled[i].count = old.count;
+				compiled[i].lastValue = old.lastValue;
+				compiled[i].lastTime = old.lastTime;
+			}
+		}
+		rows.swap(compiled);
+		// The rows do not move any more
+		for (Row& r : rows) {
+			r.setpoint = r.definition.boundSetpoint ? r.definition.boundSetpoint : &r.definition.setpoint;
+			r.enabled = r.definition.boundEnabled ? r.definition.boundEnabled : &r.definition.enabled;
+		}
+	}
+	size_t size() const { return rows.size(); }
+	const TripDefinition& operator[](size_t i) const { return rows[i].definition; }
+
+	// Forgets the conditions in progress
+	void resetState() {
+		for (Row& r : rows) {
+			r.count = 0;
+			r.lastTime = -1.;
+		}
+	}
+	void clearLog() { logged = 0; }
+
+	/* One pass over the table with the signals indexed by TripSignal and the TripCondition bits of
+	the moment. Calls fire(definition) for every row that trips */
+	template <class F>
+	void evaluate(const double* signals, double time, std::uint8_t conditions, F fire) {
+		for (size_t i = 0; i < rows.size(); i++) {
+			Row& r = rows[i];
+			const TripDefinition& d = r.definition;
+			if (!(d.modes & conditions)) continue;
+			const double value = signals[d.signal];
+			const double setpoint = *r.setpoint;
+			if (holds(d.comparator, value, setpoint)) {
+				if (r.count == 0) {
+					// Where the signal crossed the setpoint, if the last evaluation was on the other side
+					r.onset = time;
+					if (r.lastTime >= 0. && value != r.lastValue) {
+						const double fraction = (setpoint - r.lastValue) / (value - r.lastValue);
+						if (fraction >= 0. && fraction <= 1.) r.onset = r.lastTime + fraction * (time - r.lastTime);
+					}
+				}
+				r.count++;
+			}
+			else {
+				r.count = 0;
+			}
+			r.lastValue = value;
+			r.lastTime = time;
+
+			if (r.count >= d.coincidence && r.onset + d.delay <= time && *r.enabled && !(d.inhibits & conditions)) {
+				TripEvent& e = log[logged % LOG_SIZE];
+				e.time = r.onset + d.delay;
+				e.value = (float)value;
+				e.trip = (std::uint8_t)i;
+				logged++;
+				fire(d);
+				if (d.exclusive) return;
+			}
+		}
+	}
+
+	// The log, oldest first. Only the last LOG_SIZE events are kept
+	size_t getEventCount() const { return (logged < LOG_SIZE) ? logged : LOG_SIZE; }
+	const TripEvent& getEvent(size_t i) const {
+		return log[(logged < LOG_SIZE) ? i : (logged + i) % LOG_SIZE];
+	}
+
+	// The state of the rows and the log, for checkpoints. The rows are compiled before loading
+	template<class Archive>
+	void save(Archive& archive) const {
+		archive((std::uint64_t)rows.size());
+		for (const Row& r : rows) archive(r.definition.name, r.onset, r.count, r.lastValue, r.lastTime);
+		archive((std::uint64_t)logged, log);
+	}
+	template<class Archive>
+	void load(Archive& archive) {
+		std::uint64_t count = 0, events = 0;
+		archive(count);
+		for (std::uint64_t i = 0; i < count; i++) {
+			Row state;
+			std::string name;
+			archive(name, state.onset, state.count, state.lastValue, state.lastTime);
+			for (Row& r : rows) {
+				if (r.definition.name != name) continue;
+				r.onset = state.onset;
+				r.count = state.count;
+				r.lastValue = state.lastValue;
+				r.lastTime = state.lastTime;
+			}
+		}
+		archive(events, log);
+		logged = (size_t)events;
+	}
+};
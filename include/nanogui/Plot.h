@@ -1,5 +1,7 @@
 #pragma once
 #include <nanogui/common.h>
+#include <HistoryPyramid.h>
+#include <HistoryStore.h>
 #include <iostream>
 #include <deque>
 #include <cmath>
@@ -331,6 +333,8 @@ protected:
 	std::function<void(double*, const size_t)> mValueComputing;
 	bool mRewriting;
 	float rodPosition = 0.f;
+	// Min/max pyramid of the Y data, Smart drawing then shows the envelope of every pixel
+	const HistoryPyramid* mEnvelope = nullptr;
 public:
 	Plot(const size_t arraySize, bool rewriting = false) : mArraySize(arraySize) { mRewriting = rewriting; };
 
@@ -359,10 +363,15 @@ public:
 	void setValueComputing(std::function<void(double*, const size_t)> computing) { mValueComputing = computing; }
 	std::function<void(double*, const size_t)> valueComputing() { return mValueComputing; }
 
+	// The pyramid has to be built over the Y data, mValueComputing has to be monotonic for the envelope to hold
+	void setEnvelope(const HistoryPyramid* pyramid) { mEnvelope = pyramid; }
+	const HistoryPyramid* getEnvelope() const { return mEnvelope; }
+
 protected:
 	double *xValues;
 	float *yValues_float;
 	double *yValues_dbl;
+	const DecimatedColumn *yValues_decimated;
 	long start = -1L;
 public:
 
@@ -371,6 +380,8 @@ public:
 	void setXdata(double* x_axis) { xValues = x_axis; }
 	void setYdata(double* y_axis) { yValues_dbl = y_axis; type = 2; }
 	void setYdata(float* y_axis) { yValues_float = y_axis; type = 1; }
+	// Every sample reads the last value the column stored
+	void setYdata(const DecimatedColumn* y_axis) { yValues_decimated = y_axis; type = 3; }
 
 	double getXat(size_t i, bool normalize = true) {
 		if (start >= 0L) {
@@ -401,9 +412,17 @@ public:
 		else if (type == 2) {
 			preNorm = (double)yValues_dbl[i];
 		}
+		else if (type == 3) {
+			preNorm = (double)yValues_decimated->get(i);
+		}
 		else {
 			return 0.;
 		}
+		return getYfor(preNorm, i, normalize);
+	}
+
+	// Y position of a value of the sample i (e.g. an extreme from the envelope)
+	double getYfor(double preNorm, size_t i, bool normalize = true) {
 		if (mValueComputing) mValueComputing(&preNorm, i);
 		if (normalize) {
 			if (ylog) {
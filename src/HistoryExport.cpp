@@ -0,0 +1,276 @@
+#include <HistoryExport.h>
+#include <HistoryFile.h>
+#include <Simulator.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <vector>
+
+HistoryExport::HistoryExport(const Simulator* reactor, ExportFormat format, const std::string& fileName)
+{
+	this->reactor = reactor;
+	this->format = format;
+	this->fileName = fileName;
+	dataPoints = reactor->dataPoints;
+	resets = reactor->historyResets.load();
+	coreVolume = reactor->getReactorCoreVolume();
+
+	const size_t total = reactor->iterations_total;
+	capturedHead = total;
+	firstIteration = (total > dataPoints) ? total - dataPoints : 0;
+	// The text files stop before the current sample, like they always did
+	const size_t end = (format == ExportFormat::Binary || total == 0) ? total : total - 1;
+	count = end - firstIteration;
+
+	time_t now = time(0);
+	struct tm *p = localtime(&now);
+	char s[100];
+	strftime(s, 100, "%c", p);
+	std::ostringstream os;
+	switch (format) {
+	case ExportFormat::Text:
+		division = (size_t)std::max(reactor->data_division, 1);
+		os << "#######################################################################################################################\n";
+		os << "#                  Research reactor simulator log " << s << "                   #\n";
+		os << "#Time[h:m:s:ms]  n-source  Safety blades  NR[mm]  SR[mm]  WL[mm]  Reactivity[pcm]  Power[W]  Flux[#/(cm²·s)]  Period[s]  #\n";
+		os << "#######################################################################################################################\n";
+		break;
+	case ExportFormat::Counts: {
+		// At least one sample per row
+		dwellTime = std::max(reactor->dwellTime, DT_STEP);
+		acquisitionStartTime = reactor->acquisitionStartTime;
+		// Rows start at the sample closest to the start of the acquisition
+		const double oldestTime = reactor->time_[firstIteration % dataPoints];
+		if (count && acquisitionStartTime >= oldestTime) {
+			const size_t start = reactor->getIterationFromTime(acquisitionStartTime);
+			firstIteration = std::min(start, end);
+			count = end - firstIteration;
+		}
+		os << "##############  Counts/bin from detectors, dwell Time = " << reactor->dwellTime << " s  #################\n";
+		os << "Time[h:m:s:ms]       Det1[Counts]      Det2[Counts]               \n";
+		break;
+	}
+	case ExportFormat::Binary:
+		captureRange();
+		settings = reactor->settingsJson;
+		break;
+	}
+	header = os.str();
+}
+
+HistoryExport::~HistoryExport()
+{
+	wait();
+}
+
+void HistoryExport::run()
+{
+	Status result = Status::Failed;
+	switch (format) {
+	case ExportFormat::Text:
+		result = writeText();
+		break;
+	case ExportFormat::Counts:
+		result = writeCounts();
+		break;
+	case ExportFormat::Binary:
+		result = writeBinary();
+		break;
+	}
+	if (result != Status::Finished) std::remove(outputPath().c_str());
+	if (result == Status::Cancelled) message = "Export to " + outputPath() + " cancelled";
+	status = (int)result;
+}
+
+void HistoryExport::start()
+{
+	if (capturedHead + EXPORT_MARGIN_SAMPLES > dataPoints) {
+		const size_t end = firstIteration + count;
+		firstIteration = std::min(std::max(firstIteration, capturedHead + EXPORT_MARGIN_SAMPLES - dataPoints), end);
+		count = end - firstIteration;
+		if (format == ExportFormat::Binary) captureRange();
+	}
+	worker = std::thread(&HistoryExport::run, this);
+}
+
+void HistoryExport::wait()
+{
+	if (worker.joinable()) worker.join();
+}
+
+void HistoryExport::captureRange()
+{
+	startTime = count ? reactor->time_[firstIteration % dataPoints] : 0.;
+	// Even if the range spans count - 1 steps of DT_STEP, the tolerance covers the rounding of the time column
+	const double span = (count > 1) ? reactor->time_[(firstIteration + count - 1) % dataPoints] - startTime : 0.;
+	dt = (std::abs(span - (double)(count - 1) * DT_STEP) <= DT_STEP * 0.1) ? DT_STEP : 0.;
+}
+
+std::string HistoryExport::outputPath() const
+{
+	return fileName + ((format == ExportFormat::Binary) ? ".bin" : ".dat");
+}
+
+bool HistoryExport::unchanged(size_t from) const
+{
+	// Orders the copy before the loads below, pairs with the release fence in Simulator::mainLoop
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return reactor->historyResets.load(std::memory_order_relaxed) == resets
+		&& from + dataPoints >= reactor->historyHead.load(std::memory_order_relaxed);
+}
+
+HistoryExport::Status HistoryExport::overrun()
+{
+	message = "The simulation overwrote the history before it was written, " + outputPath() + " removed";
+	return Status::Failed;
+}
+
+HistoryExport::Status HistoryExport::writeText()
+{
+	std::ofstream logFile(outputPath());
+	if (!logFile) {
+		message = "Error opening data file: " + outputPath();
+		return Status::Failed;
+	}
+	logFile << header;
+	logFile << std::setprecision(5);
+
+	const HistoryStore* history = reactor->history;
+	std::vector<double> time(EXPORT_CHUNK_SAMPLES), neutrons(EXPORT_CHUNK_SAMPLES);
+	std::vector<float> rodPositions[NUMBER_OF_CONTROL_RODS], reactivity(EXPORT_CHUNK_SAMPLES), period(EXPORT_CHUNK_SAMPLES);
+	for (auto& r : rodPositions) r.resize(EXPORT_CHUNK_SAMPLES);
+	std::vector<std::uint8_t> sourceIn(EXPORT_CHUNK_SAMPLES), bladesIn(EXPORT_CHUNK_SAMPLES);
+
+	const size_t end = firstIteration + count;
+	for (size_t from = firstIteration; from < end; from += EXPORT_CHUNK_SAMPLES) {
+		if (cancelRequested) return Status::Cancelled;
+		const size_t n = std::min(EXPORT_CHUNK_SAMPLES, end - from);
+		history->copySamples(history->time, from, n, time.data());
+		history->copySamples(history->neutrons[0], from, n, neutrons.data());
+		for (int r = 0; r < NUMBER_OF_CONTROL_RODS; r++)
+			history->copySamples(history->rodPositions[r], from, n, rodPositions[r].data());
+		history->copySamples(history->reactivity, from, n, reactivity.data());
+		history->copySamples(history->period, from, n, period.data());
+		history->copySamples(history->sourceInserted, from, n, sourceIn.data());
+		history->copySamples(history->safetyBladesInserted, from, n, bladesIn.data());
+		if (!unchanged(from)) return overrun();
+
+		for (size_t i = 0; i < n; i++) {
+			if ((from + i - firstIteration) % division != 0) continue;
+			logFile << Simulator::formatTime(time[i])
+				<< std::setw(11) << (sourceIn[i] ? "IN" : "OUT")
+				<< std::setw(12) << (bladesIn[i] ? "IN" : "OUT")
+				<< std::setw(11) << rodPositions[0][i]
+				<< std::setw(9) << rodPositions[1][i]
+				<< std::setw(9) << rodPositions[2][i]
+				<< std::setw(12) << reactivity[i]
+				<< std::setw(15) << neutrons[i] * reactor->t_neutron_speed / coreVolume / (2.53e7) * 1e-4
+				<< std::setw(14) << neutrons[i] * reactor->t_neutron_speed / coreVolume * 1e-4
+				<< std::setw(12) << period[i]
+				<< '\n';
+		}
+		written += n;
+	}
+
+	logFile.close();
+	if (logFile.fail()) {
+		message = "Error writing data file: " + outputPath();
+		return Status::Failed;
+	}
+	message = "Saved " + outputPath();
+	return Status::Finished;
+}
+
+HistoryExport::Status HistoryExport::writeCounts()
+{
+	std::ofstream countsFile(outputPath());
+	if (!countsFile) {
+		message = "Error opening counts file: " + outputPath();
+		return Status::Failed;
+	}
+	countsFile << header;
+
+	const HistoryStore* history = reactor->history;
+	std::vector<double> time(EXPORT_CHUNK_SAMPLES);
+	std::vector<float> counts1(EXPORT_CHUNK_SAMPLES), counts2(EXPORT_CHUNK_SAMPLES);
+
+	// Rows at the first sample of each dwell time, the half step absorbs the rounding of the time column
+	double nextRow = -std::numeric_limits<double>::infinity();
+	const size_t end = firstIteration + count;
+	for (size_t from = firstIteration; from < end; from += EXPORT_CHUNK_SAMPLES) {
+		if (cancelRequested) return Status::Cancelled;
+		const size_t n = std::min(EXPORT_CHUNK_SAMPLES, end - from);
+		history->copySamples(history->time, from, n, time.data());
+		history->copySamples(history->noisyCounts[0], from, n, counts1.data());
+		history->copySamples(history->noisyCounts[1], from, n, counts2.data());
+		if (!unchanged(from)) return overrun();
+
+		for (size_t i = 0; i < n; i++) {
+			if (from + i == firstIteration) nextRow = time[i];
+			if (time[i] + DT_STEP / 2 < nextRow) continue;
+			if (time[i] >= acquisitionStartTime)
+				countsFile << Simulator::formatTime(time[i]) << std::setw(16) << counts1[i] << std::setw(16) << counts2[i] << '\n';
+			// A slow mode step may cover several dwell times
+			do nextRow += dwellTime; while (time[i] + DT_STEP / 2 >= nextRow);
+		}
+		written += n;
+	}
+
+	countsFile.close();
+	if (countsFile.fail()) {
+		message = "Error writing counts file: " + outputPath();
+		return Status::Failed;
+	}
+	message = "Saved " + outputPath();
+	return Status::Finished;
+}
+
+HistoryExport::Status HistoryExport::writeBinary()
+{
+	const HistoryStore* history = reactor->history;
+	const std::vector<HistoryChannel> channels = history->fileChannels();
+
+	HistoryFileWriter writer;
+	// 0 for samples that are not evenly spaced, the time channel has the time of every sample
+	writer.setNumber("dt", dt);
+	writer.setNumber("startTime", startTime);
+	// Power and flux are proportional to the neutron channel
+	writer.setNumber("powerPerNeutron", reactor->t_neutron_speed / coreVolume / (2.53e7) * 1e-4);
+	writer.setNumber("fluxPerNeutron", reactor->t_neutron_speed / coreVolume * 1e-4);
+	writer.setJson("settings", settings);
+	for (const auto& c : channels) writer.addChannel(c.name, c.unit, c.type, c.elementSize);
+	if (!writer.open(outputPath(), count)) {
+		message = "Error opening binary data file: " + outputPath();
+		return Status::Failed;
+	}
+
+	std::vector<std::vector<char>> buffers;
+	for (const auto& c : channels) buffers.emplace_back(EXPORT_CHUNK_SAMPLES * c.elementSize);
+	bool ok = true;
+	const size_t end = firstIteration + count;
+	for (size_t from = firstIteration; from < end && ok; from += EXPORT_CHUNK_SAMPLES) {
+		if (cancelRequested) {
+			writer.close();
+			return Status::Cancelled;
+		}
+		const size_t n = std::min(EXPORT_CHUNK_SAMPLES, end - from);
+		for (size_t c = 0; c < channels.size(); c++) history->copySamples(channels[c], from, n, buffers[c].data());
+		if (!unchanged(from)) {
+			writer.close();
+			return overrun();
+		}
+		for (size_t c = 0; c < channels.size() && ok; c++) ok = writer.writeValues(c, from - firstIteration, buffers[c].data(), n);
+		written += n;
+	}
+
+	if (!writer.close() || !ok) {
+		message = "Error writing binary data file: " + outputPath();
+		return Status::Failed;
+	}
+	message = "Saved " + outputPath();
+	return Status::Finished;
+}
@@ -0,0 +1,210 @@
+#include <HistoryJournal.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// Samples converted at once when a channel is read with a small stride
+constexpr size_t JOURNAL_READ_SAMPLES = 1 << 14;
+
+bool MappedFile::open(const std::string& path, size_t length, bool writable)
+{
+	close();
+#if defined(_WIN32)
+	HANDLE f = CreateFileA(path.c_str(), writable ? (GENERIC_READ | GENERIC_WRITE) : GENERIC_READ,
+		FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, writable ? OPEN_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (f == INVALID_HANDLE_VALUE) return false;
+	file = f;
+	// A writable mapping extends the file to its size
+	mapping = CreateFileMappingA(f, nullptr, writable ? PAGE_READWRITE : PAGE_READONLY,
+		(DWORD)((unsigned long long)length >> 32), (DWORD)(length & 0xFFFFFFFFull), nullptr);
+	if (mapping) bytes = (char*)MapViewOfFile(mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, length);
+#else
+	fd = ::open(path.c_str(), writable ? (O_RDWR | O_CREAT) : O_RDONLY, 0644);
+	if (fd < 0) return false;
+	if (writable) {
+		// Reserves the blocks now, a full disk would otherwise only show up as a signal when a page is written
+		bool sized = ftruncate(fd, (off_t)length) == 0;
+#if defined(__linux__)
+		sized = sized && posix_fallocate(fd, 0, (off_t)length) == 0;
+#endif
+		if (!sized) {
+			close();
+			return false;
+		}
+	}
+	void* p = mmap(nullptr, length, writable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, fd, 0);
+	if (p != MAP_FAILED) bytes = (char*)p;
+#endif
+	this->length = length;
+	if (!bytes) close();
+	return bytes != nullptr;
+}
+
+void MappedFile::close()
+{
+#if defined(_WIN32)
+	if (bytes) UnmapViewOfFile(bytes);
+	if (mapping) CloseHandle(mapping);
+	if (file) CloseHandle(file);
+	mapping = nullptr;
+	file = nullptr;
+#else
+	if (bytes) munmap(bytes, length);
+	if (fd >= 0) ::close(fd);
+	fd = -1;
+#endif
+	bytes = nullptr;
+	length = 0;
+}
+
+HistoryJournal::HistoryJournal(const HistoryStore* history, const std::string& directory, size_t segmentSamples)
+{
+	this->history = history;
+	this->directory = directory;
+	this->segmentSamples = std::max(segmentSamples, (size_t)1);
+	channels = history->fileChannels();
+}
+
+HistoryJournal::~HistoryJournal()
+{
+	current.close();
+}
+
+std::string HistoryJournal::segmentPath(size_t segment) const
+{
+	return directory + "/segment_" + std::to_string(segment) + ".bin";
+}
+
+size_t HistoryJournal::channelOffset(size_t channel) const
+{
+	size_t offset = 0;
+	for (size_t c = 0; c < channel; c++) offset += segmentSamples * channels[c].elementSize;
+	return offset;
+}
+
+void HistoryJournal::deleteSegments(size_t from, size_t to)
+{
+	for (size_t segment = from; segment < to; segment++) std::remove(segmentPath(segment).c_str());
+}
+
+void HistoryJournal::restart(size_t iteration)
+{
+	current.close();
+	if (end > first) deleteSegments(first / segmentSamples, (end - 1) / segmentSamples + 1);
+	first = iteration;
+	end = iteration;
+}
+
+bool HistoryJournal::mapSegment(size_t segment)
+{
+	current.close();
+	if (!current.open(segmentPath(segment), segmentBytes(), true)) {
+		std::cerr << "Error creating journal segment " << segmentPath(segment) << std::endl;
+		return false;
+	}
+	currentSegment = segment;
+
+	// The oldest segments make room for the new one
+	const size_t firstSegment = first / segmentSamples;
+	if (maxSegments && segment + 1 - firstSegment > maxSegments) {
+		deleteSegments(firstSegment, segment + 1 - maxSegments);
+		first = (segment + 1 - maxSegments) * segmentSamples;
+	}
+	return true;
+}
+
+bool HistoryJournal::append(size_t endIteration)
+{
+	while (end < endIteration) {
+		const size_t segment = end / segmentSamples;
+		if ((!current.isOpen() || segment != currentSegment) && !mapSegment(segment)) return false;
+		const size_t offset = end - segment * segmentSamples;
+		const size_t n = std::min(endIteration - end, segmentSamples - offset);
+		for (size_t c = 0; c < channels.size(); c++)
+			history->copySamples(channels[c], end, n, current.data() + channelOffset(c) + offset * channels[c].elementSize);
+		end += n;
+	}
+	return true;
+}
+
+bool HistoryJournal::read(size_t channel, size_t from, size_t count, void* out)
+{
+	if (channel >= channels.size() || from < first || from + count > end) return false;
+	const size_t elementSize = channels[channel].elementSize;
+	char* dst = (char*)out;
+	while (count) {
+		const size_t segment = from / segmentSamples;
+		const size_t offset = from - segment * segmentSamples;
+		const size_t n = std::min(count, segmentSamples - offset);
+		const size_t at = channelOffset(channel) + offset * elementSize;
+		if (current.isOpen() && segment == currentSegment) {
+			memcpy(dst, current.data() + at, n * elementSize);
+		}
+		else {
+			// Older segments are only mapped while they are read
+			MappedFile old;
+			if (!old.open(segmentPath(segment), segmentBytes(), false)) return false;
+			memcpy(dst, old.data() + at, n * elementSize);
+		}
+		dst += n * elementSize;
+		from += n;
+		count -= n;
+	}
+	return true;
+}
+
+size_t HistoryJournal::iterationAt(double time)
+{
+	// The time channel grows with every sample
+	size_t low = first, high = end;
+	while (high - low > 1) {
+		const size_t middle = low + (high - low) / 2;
+		double t = 0.;
+		if (!read(0, middle, 1, &t)) break;
+		if (t <= time) low = middle;
+		else high = middle;
+	}
+	if (low + 1 < end) {
+		double t[2];
+		if (read(0, low, 2, t) && time - t[0] > t[1] - time) low++;
+	}
+	return low;
+}
+
+bool HistoryJournal::read(const std::string& channel, double fromTime, double toTime, std::vector<double>& values, size_t stride)
+{
+	values.clear();
+	size_t c = 0;
+	while (c < channels.size() && channels[c].name != channel) c++;
+	if (c == channels.size()) return false;
+	if (end == first) return true;
+	stride = std::max(stride, (size_t)1);
+
+	const size_t from = iterationAt(fromTime);
+	const size_t to = iterationAt(toTime) + 1;
+	const std::string type = channels[c].type;
+	const size_t elementSize = channels[c].elementSize;
+	// Small strides convert whole blocks, large ones read single samples
+	const size_t block = (stride < JOURNAL_READ_SAMPLES) ? JOURNAL_READ_SAMPLES - JOURNAL_READ_SAMPLES % stride : 1;
+	const size_t step = (block == 1) ? stride : block;
+	std::vector<char> raw(block * elementSize);
+	for (size_t i = from; i < to; i += step) {
+		const size_t n = std::min(block, to - i);
+		if (!read(c, i, n, raw.data())) return false;
+		for (size_t k = 0; k < n; k += std::min(stride, block)) {
+			if (type == "f64") values.push_back(((const double*)raw.data())[k]);
+			else if (type == "f32") values.push_back(((const float*)raw.data())[k]);
+			else values.push_back(((const std::uint8_t*)raw.data())[k]);
+		}
+	}
+	return true;
+}
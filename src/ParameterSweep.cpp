@@ -0,0 +1,277 @@
+#include <ParameterSweep.h>
+#include <Simulator.h>
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <thread>
+
+bool ParameterSweep::applyParameter(Settings& settings, const std::string& name, double value)
+{
+	// Indexed settings are written as name[index]
+	std::string key = name;
+	long index = -1;
+	size_t open = name.find('[');
+	if (open != std::string::npos) {
+		if (name.back() != ']') return false;
+		key = name.substr(0, open);
+		try {
+			index = std::stol(name.substr(open + 1, name.size() - open - 2));
+		}
+		catch (const std::exception&) {
+			return false;
+		}
+		if (index < 0) return false;
+	}
+
+	if (key == "betas" && index >= 0 && index < 6) {
+		settings.betas[index] = value;
+	}
+	else if (key == "lambdas" && index >= 0 && index < 6) {
+		settings.lambdas[index] = value;
+	}
+	else if (key == "rodWorth" && index >= 0 && index < NUMBER_OF_CONTROL_RODS) {
+		settings.rodSettings[index].rodWorth = (float)value;
+	}
+	else if (key == "rodWorth" && index >= NUMBER_OF_CONTROL_RODS && (size_t)index < NUMBER_OF_CONTROL_RODS + settings.extraRods.size()) {
+		// The rod bank continues with the extra rods
+		settings.extraRods[index - NUMBER_OF_CONTROL_RODS].settings.rodWorth = (float)value;
+	}
+	else if (key == "promptNeutronLifetime" && index < 0) {
+		settings.promptNeutronLifetime = value;
+	}
+	else if (key == "excessReactivity" && index < 0) {
+		// Same as editing the excess reactivity in the GUI
+		settings.excessReactivity = (float)value;
+		settings.excessReactivity_initial = (float)value;
+	}
+	else {
+		return false;
+	}
+	return true;
+}
+
+bool ParameterSweep::addParameter(const SweepParameter& parameter)
+{
+	// Indices of rods are checked against the rod bank of the base settings
+	Settings probe = base;
+	if (!applyParameter(probe, parameter.name, parameter.from)) {
+		std::cerr << "Unknown sweep parameter: " << parameter.name << std::endl;
+		return false;
+	}
+	parameters.push_back(parameter);
+	if (parameters.back().points == 0) parameters.back().points = 1;
+	return true;
+}
+
+void ParameterSweep::setMode(SweepMode mode, size_t samples, std::uint32_t seed)
+{
+	this->mode = mode;
+	this->samples = samples;
+	this->seed = seed;
+}
+
+bool ParameterSweep::loadSpecFromFile(const std::string& path)
+{
+	std::ifstream ifs(path);
+	if (!ifs) {
+		std::cerr << "Error opening sweep file: " << path << std::endl;
+		return false;
+	}
+
+	std::string line;
+	size_t lineNumber = 0;
+	while (std::getline(ifs, line)) {
+		lineNumber++;
+		line = line.substr(0, line.find('#'));
+		std::istringstream ls(line);
+		std::string name;
+		if (!(ls >> name)) continue;
+
+		if (name == "grid") {
+			setMode(SweepMode::Grid, 0, seed);
+		}
+		else if (name == "lhs") {
+			size_t count = 0;
+			std::uint32_t lhsSeed = 0;
+			if (!(ls >> count) || count == 0) {
+				std::cerr << path << ":" << lineNumber << ": lhs needs the number of runs" << std::endl;
+				return false;
+			}
+			ls >> lhsSeed;
+			setMode(SweepMode::LatinHypercube, count, lhsSeed);
+		}
+		else {
+			SweepParameter parameter;
+			parameter.name = name;
+			if (!(ls >> parameter.from >> parameter.to)) {
+				std::cerr << path << ":" << lineNumber << ": expected <parameter> <from> <to> [points]" << std::endl;
+				return false;
+			}
+			if (!(ls >> parameter.points)) parameter.points = (parameter.from == parameter.to) ? 1 : 2;
+			if (!addParameter(parameter)) return false;
+		}
+	}
+	return true;
+}
+
+bool ParameterSweep::loadScriptFromFile(const std::string& path)
+{
+	std::ifstream ifs(path);
+	if (!ifs) {
+		std::cerr << "Error opening input file: " << path << std::endl;
+		return false;
+	}
+
+	script.clear();
+	Command cmd;
+	while (ifs >> cmd) script.push_back(cmd);
+	return true;
+}
+
+size_t ParameterSweep::runCount() const
+{
+	if (mode == SweepMode::LatinHypercube) return samples;
+	size_t count = 1;
+	for (const auto& p : parameters) count *= p.points;
+	return count;
+}
+
+std::vector<std::vector<double>> ParameterSweep::buildPoints() const
+{
+	const size_t count = runCount();
+	std::vector<std::vector<double>> points(count, std::vector<double>(parameters.size()));
+
+	if (mode == SweepMode::Grid) {
+		// The last parameter changes fastest
+		for (size_t r = 0; r < count; r++) {
+			size_t rest = r;
+			for (size_t p = parameters.size(); p-- > 0; ) {
+				const SweepParameter& parameter = parameters[p];
+				const size_t k = rest % parameter.points;
+				rest /= parameter.points;
+				points[r][p] = (parameter.points > 1)
+					? parameter.from + (parameter.to - parameter.from) * (double)k / (double)(parameter.points - 1)
+					: parameter.from;
+			}
+		}
+	}
+	else {
+		// Every parameter range is cut into 'count' strata and each stratum is used by exactly one run
+		std::mt19937 gen(seed);
+		std::uniform_real_distribution<double> uniform(0., 1.);
+		std::vector<size_t> strata(count);
+		for (size_t p = 0; p < parameters.size(); p++) {
+			const SweepParameter& parameter = parameters[p];
+			std::iota(strata.begin(), strata.end(), (size_t)0);
+			std::shuffle(strata.begin(), strata.end(), gen);
+			for (size_t r = 0; r < count; r++) {
+				points[r][p] = parameter.from + (parameter.to - parameter.from) * ((double)strata[r] + uniform(gen)) / (double)count;
+			}
+		}
+	}
+	return points;
+}
+
+void ParameterSweep::runOne(SweepRun& run) const
+{
+	Settings settings = base;
+	for (size_t p = 0; p < parameters.size(); p++)
+		applyParameter(settings, parameters[p].name, run.values[p]);
+
+	Simulator reactor(&settings);
+	reactor.setNoiseSeed(seed + (std::uint32_t)run.index);
+	reactor.setScramCallback([&run, &reactor](int status) {
+		if (run.scramTime < 0.) {
+			run.scramTime = reactor.getCurrentTime();
+			run.scramStatus = status;
+		}
+	});
+
+	const double time0 = reactor.getCurrentTime();
+	for (Command cmd : script) {
+		cmd.timed += time0;
+		reactor.scriptCommands.push(cmd);
+	}
+
+	const size_t dataPoints = reactor.getDataPoints();
+	run.peakPower = reactor.getCurrentPower();
+	run.peakTime = time0;
+	// Samples are scanned after every frame, so runs longer than the history are fine
+	size_t scanned = reactor.getIterationsTotal();
+	while (reactor.getCurrentTime() < time0 + duration && !reactor.isExitRequested()) {
+		reactor.runIterations(SWEEP_FRAME_ITERATIONS);
+		for (; scanned < reactor.getIterationsTotal(); scanned++) {
+			const size_t i = scanned % dataPoints;
+			const double power = reactor.powerFromNeutrons(reactor.state_vector_[0][i]);
+			if (power > run.peakPower) {
+				run.peakPower = power;
+				run.peakTime = reactor.time_[i];
+			}
+			// Each sample stands for the time since the one before, longer in slow mode
+			const double dt = reactor.time_[i] - reactor.time_[(scanned - 1) % dataPoints];
+			run.integratedCounts[0] += reactor.CPS_detector1_[i] * dt;
+			run.integratedCounts[1] += reactor.CPS_detector2_[i] * dt;
+		}
+	}
+	run.finalPower = reactor.getCurrentPower();
+	run.finalPeriod = *reactor.getReactorPeriod();
+}
+
+const std::vector<SweepRun>& ParameterSweep::run()
+{
+	std::vector<std::vector<double>> points = buildPoints();
+	runs.assign(points.size(), SweepRun());
+	for (size_t i = 0; i < runs.size(); i++) {
+		runs[i].index = i;
+		runs[i].values = points[i];
+	}
+
+	size_t workers = threads ? threads : (size_t)std::thread::hardware_concurrency();
+	workers = std::max((size_t)1, std::min(workers, runs.size()));
+
+	// Every worker takes the next run that nobody has started yet
+	std::atomic<size_t> next{ 0 };
+	auto work = [this, &next]() {
+		for (size_t i = next++; i < runs.size(); i = next++) {
+			try {
+				runOne(runs[i]);
+				runs[i].completed = true;
+			}
+			catch (const std::exception& e) {
+				std::cerr << "Sweep run " << i << " failed: " << e.what() << std::endl;
+			}
+		}
+	};
+	std::vector<std::thread> pool;
+	for (size_t w = 1; w < workers; w++) pool.emplace_back(work);
+	work();
+	for (auto& t : pool) t.join();
+	return runs;
+}
+
+void ParameterSweep::summaryToFile(std::string fileName) const
+{
+	std::ofstream summaryFile;
+	summaryFile.open(fileName + ".dat");
+	summaryFile << "# Parameter sweep, " << runs.size() << " runs, "
+		<< ((mode == SweepMode::Grid) ? "grid" : "latin hypercube") << ", " << duration << " s each\n";
+	summaryFile << "#run";
+	for (const auto& p : parameters) summaryFile << "\t" << p.name;
+	summaryFile << "\tpeakPower[W]\tpeakTime[s]\tfinalPower[W]\tfinalPeriod[s]\tscramTime[s]\tscramStatus\tcounts1\tcounts2\n";
+	summaryFile << std::setprecision(8);
+	for (const auto& r : runs) {
+		if (!r.completed) {
+			summaryFile << "# run " << r.index << " failed\n";
+			continue;
+		}
+		summaryFile << r.index;
+		for (double v : r.values) summaryFile << "\t" << v;
+		summaryFile << "\t" << r.peakPower << "\t" << r.peakTime << "\t" << r.finalPower << "\t" << r.finalPeriod
+			<< "\t" << r.scramTime << "\t" << r.scramStatus << "\t" << r.integratedCounts[0] << "\t" << r.integratedCounts[1] << "\n";
+	}
+	summaryFile.close();
+}
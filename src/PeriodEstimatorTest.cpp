@@ -0,0 +1,84 @@
+/*
+	PeriodEstimatorTest.cpp replays a transient one step at a time (stable power, a pulse with its
+	SCRAM, a reset, rod moves and a second pulse) and compares the reactor period the simulator
+	stores with the weighted window formula PeriodEstimator replaced, which sums the last
+	PERIOD_AVERAGE_SAMPLES samples from scratch at every step.
+
+	Returns 0 if every step agrees within the tolerance, 1 otherwise
+*/
+#include <Simulator.h>
+#include <Settings.h>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+// Relative difference allowed between the recursive and the summed period
+constexpr double TOLERANCE = 1e-9;
+
+// Swallows the simulator log
+class NullBuffer : public std::streambuf {
+protected:
+	int overflow(int c) override { return c; }
+};
+
+// The period of the step writing the sample after currentIndex, as mainLoop computed it before PeriodEstimator
+static double windowPeriod(const Simulator& reactor, size_t currentIndex, size_t iterationsTotal, size_t averageStart)
+{
+	const int averageValues = (int)std::min(iterationsTotal - averageStart - 1, PERIOD_AVERAGE_SAMPLES);
+	if (averageValues <= 1) return PERIOD_UNDEFINED;
+	const double periodSum = (1 - std::pow(PERIOD_WEIGHT, averageValues - 2)) / (1 - PERIOD_WEIGHT);
+	std::vector<double> vals(averageValues);
+	for (int i = 0; i < averageValues; i++)
+		vals[i] = reactor.state_vector_[0][reactor.shiftIndex(currentIndex, i - averageValues + 1)];
+	double sum = 0.;
+	int good = 0;
+	for (int i = 0; i < averageValues - 1; i++) {
+		const double r = vals[i + 1] / vals[i];
+		if (r <= 0.0 || r == 1.0) continue;
+		sum += std::pow(PERIOD_WEIGHT, averageValues - i - 2) / std::log(r);
+		++good;
+	}
+	if (good == 0) return PERIOD_UNDEFINED;
+	sum *= DT_STEP / periodSum;
+	return std::isfinite(sum) ? sum : PERIOD_UNDEFINED;
+}
+
+int main()
+{
+	NullBuffer null;
+	std::streambuf* log = std::cout.rdbuf(&null);
+	Settings settings;
+	Simulator reactor(&settings);
+	reactor.pushStableState(100.);
+
+	const size_t steps = 80000;
+	size_t failures = 0, compared = 0;
+	double worst = 0.;
+	for (size_t step = 0; step < steps; step++) {
+		// The events of the transient
+		if (step == 5000) reactor.beginPulse();
+		if (step == 30000) reactor.scram(Simulator::ScramSignals::None);
+		if (step == 32000) reactor.pushStableState(10.);
+		if (step == 35000) reactor.executeCommand(makeCommand(moveRod, "0", 1));
+		if (step == 45000) reactor.executeCommand(makeCommand(moveRod, "1000", 1));
+		if (step == 60000) reactor.beginPulse();
+
+		const size_t currentIndex = reactor.getCurrentIndex();
+		const size_t iterationsTotal = reactor.getIterationsTotal();
+		const size_t averageStart = reactor.getAverageStart();
+		reactor.runIterations(1);
+		const double expected = windowPeriod(reactor, currentIndex, iterationsTotal, averageStart);
+		const double actual = *reactor.getReactorPeriod();
+		const double difference = (expected == actual) ? 0. : std::abs(actual - expected) / std::abs(expected);
+		compared++;
+		worst = std::max(worst, difference);
+		if (!(difference <= TOLERANCE)) {
+			if (failures < 10) std::fprintf(stderr, "step %zu: period %.17g, window formula %.17g\n", step, actual, expected);
+			failures++;
+		}
+	}
+	std::cout.rdbuf(log);
+	std::printf("%zu steps compared, largest relative difference %.3g, %zu above %.0e\n", compared, worst, failures, TOLERANCE);
+	return failures ? 1 : 0;
+}
@@ -1,25 +1,156 @@
 #include <ScriptCommand.h>
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <iomanip>
+#include <sstream>
+
+static const std::pair<std::string, commands> commandNames[] = {
+	{ "setRegulatingRod", setRegulatingRod },
+	{ "moveRegulatingRod", moveRegulatingRod },
+	{ "setShimRod", setShimRod },
+	{ "setSafetyRod", setSafetyRod },
+	{ "setStablePower", setStablePower },
+	{ "setAlpha0", setAlpha0 },
+	{ "setAlphaAtT1", setAlphaAtT1 },
+	{ "setAlphaT1", setAlphaT1 },
+	{ "setAlphaK", setAlphaK },
+	{ "saveToFile", saveToFile },
+	{ "saveToBinaryFile", saveToBinaryFile },
+	{ "startJournal", startJournal },
+	{ "saveJournalToBinaryFile", saveJournalToBinaryFile },
+	{ "saveCheckpoint", saveCheckpoint },
+	{ "loadCheckpoint", loadCheckpoint },
+	{ "exitSimulator", exitSimulator },
+	{ "setSimulationSpeed", setSimulationSpeed },
+	{ "setSimulationMode", setSimulationMode },
+	{ "holdPower", holdPower },
+	{ "firePulse", firePulse },
+	{ "setDataLogDivider", setDataLogDivider },
+	{ "setRegulatingSteps", setRegulatingSteps },
+	{ "setCvCoeffC", setCvCoeffC },
+	{ "setCvCoeffPropA", setCvCoeffPropA },
+	{ "setCvCoeffPropB", setCvCoeffPropB },
+	{ "setExcessReactivity", setExcessReactivity },
+	{ "setSafetyBladesWorth", setSafetyBladesWorth },
+	{ "setPromptNeutronLifetime", setPromptNeutronLifetime },
+	{ "setCoreVolume", setCoreVolume },
+	{ "setSourceActivity", setSourceActivity },
+	{ "setPowerLimit", setPowerLimit },
+	{ "setPeriodLimit", setPeriodLimit },
+	{ "setWaterLevelLimit", setWaterLevelLimit },
+	{ "setDetector1Factor", setDetector1Factor },
+	{ "setDetector2Factor", setDetector2Factor },
+	{ "setDwellTime", setDwellTime },
+	{ "setGodMode", setGodMode },
+	{ "setDelayedGroupFraction", setDelayedGroupFraction },
+	{ "setDelayedGroupDecay", setDelayedGroupDecay },
+	{ "setDelayedGroupEnabled", setDelayedGroupEnabled },
+	{ "setScramEnabled", setScramEnabled },
+	{ "moveRod", moveRod },
+	{ "setRodPosition", setRodPosition },
+	{ "setRodSpeed", setRodSpeed },
+	{ "setRodWorth", setRodWorth },
+	{ "setRodEnabled", setRodEnabled },
+	{ "toggleRodEnabled", toggleRodEnabled },
+	{ "rodToTop", rodToTop },
+	{ "rodToBottom", rodToBottom },
+	{ "clearRodCommands", clearRodCommands },
+	{ "setRodCurve", setRodCurve },
+	{ "setNeutronSource", setNeutronSource },
+	{ "setSafetyBlades", setSafetyBlades },
+	{ "scramReactor", scramReactor },
+	{ "setIntegrator", setIntegrator },
+	{ "addDetector", addDetector },
+	{ "setSlowMode", setSlowMode },
+	{ "setPoisonEquilibrium", setPoisonEquilibrium },
+	{ "setSubsystemRate", setSubsystemRate },
+	{ "addTrip", addTrip }
+};
 
 commands hashit(std::string const& strCommand) {
-	if (strCommand == "setRegulatingRod") return setRegulatingRod;
-	if (strCommand == "moveRegulatingRod") return moveRegulatingRod;
-	if (strCommand == "setShimRod") return setShimRod;
-	if (strCommand == "setSafetyRod") return setSafetyRod;
-	if (strCommand == "setStablePower") return setStablePower;
-	if (strCommand == "setAlpha0") return setAlpha0;
-	if (strCommand == "setAlphaAtT1") return setAlphaAtT1;
-	if (strCommand == "setAlphaT1") return setAlphaT1;
-	if (strCommand == "setAlphaK") return setAlphaK;
-	if (strCommand == "saveToFile") return saveToFile;
-	if (strCommand == "exitSimulator") return exitSimulator;
-	if (strCommand == "setSimulationSpeed") return setSimulationSpeed;
-	if (strCommand == "setSimulationMode") return setSimulationMode;
-	if (strCommand == "holdPower") return holdPower;
-	if (strCommand == "firePulse") return firePulse;
-	if (strCommand == "setDataLogDivider") return setDataLogDivider;
-	if (strCommand == "setRegulatingSteps") return setRegulatingSteps;
-	if (strCommand == "setCvCoeffPropA") return setCvCoeffPropA;
-	if (strCommand == "setCvCoeffPropB") return setCvCoeffPropB;
+	for (const auto& c : commandNames) {
+		if (c.first == strCommand) return c.second;
+	}
+	return unknownCommand;
+}
+
+const std::string& commandName(commands command) {
+	static const std::string unknown = "unknownCommand";
+	for (const auto& c : commandNames) {
+		if (c.second == command) return c.first;
+	}
+	return unknown;
+}
+
+bool numericCommand(commands command) {
+	switch (command) {
+	case saveToFile:
+	case saveToBinaryFile:
+	case startJournal:
+	case saveJournalToBinaryFile:
+	case saveCheckpoint:
+	case loadCheckpoint:
+	case exitSimulator:
+	case setSimulationMode:
+	case firePulse:
+	case setRodEnabled:
+	case toggleRodEnabled:
+	case rodToTop:
+	case rodToBottom:
+	case setRodCurve:
+	case setNeutronSource:
+	case setSafetyBlades:
+	case setIntegrator:
+	case addDetector:
+	case setSubsystemRate:
+	case addTrip:
+	case setDelayedGroupFraction:
+	case setDelayedGroupDecay:
+	case setDelayedGroupEnabled:
+	case setScramEnabled:
+	case unknownCommand:
+		return false;
+	default:
+		return true;
+	}
+}
+
+void Command::parseValue() {
+	char* end = nullptr;
+	number = std::strtod(value.c_str(), &end);
+	numeric = (end != value.c_str());
+	if (!numeric) number = 0.;
+}
+
+std::string numberValue(double value) {
+	std::ostringstream os;
+	os << std::setprecision(std::numeric_limits<double>::max_digits10) << value;
+	return os.str();
+}
+
+std::vector<std::string> splitFields(const std::string& value) {
+	std::istringstream fields(value);
+	std::string field;
+	std::vector<std::string> values;
+	while (std::getline(fields, field, ':')) values.push_back(field);
+	return values;
+}
+
+void ScriptQueue::push(Command command) {
+	command.parseValue();
+	auto i = std::upper_bound(queue.begin(), queue.end(), command, compareByTime);
+	queue.insert(i, command);
+}
+
+Command makeCommand(commands command, const std::string& value, int rod) {
+	Command c;
+	c.command = command;
+	c.strCommand = commandName(command);
+	c.value = value;
+	c.rod = rod;
+	c.parseValue();
+	return c;
 }
 
 
@@ -27,21 +158,39 @@ bool compareByTime(const Command& a, const Command& b) {
 	return a.timed < b.timed;
 }
 
+std::string quoteValue(const std::string& value) {
+	const bool plain = !value.empty() && value[0] != '"'
+		&& std::none_of(value.begin(), value.end(), [](char ch) { return std::isspace((unsigned char)ch) != 0; });
+	if (plain) return value;
+	std::ostringstream os;
+	os << std::quoted(value);
+	return os.str();
+}
+
+// One command per line: <time> <command> <value> [rod index], a value in double quotes may contain spaces
 std::istream& operator>>(std::istream& is, Command& p)
 {
-	Command c;
-	std::string timestr;
-	if (is >> c.timed >> c.strCommand >> c.value)
-	{ 
+	std::string line;
+	while (std::getline(is, line)) {
+		std::istringstream ls(line);
+		Command c;
+		if (!(ls >> c.timed >> c.strCommand >> std::ws)) continue;
+		if (ls.peek() == '"') ls >> std::quoted(c.value);
+		else ls >> c.value;
+		if (!ls) continue;
+		if (!(ls >> c.rod)) c.rod = -1;
 		c.command = hashit(c.strCommand);
+		c.parseValue();
 		p = c;
+		return is;
 	}
-
 	return is;
 }
 
 std::ostream& operator<<(std::ostream& os, const Command& p)
 {
-	os << p.timed << '\t' << p.strCommand << '\t' << p.value << std::endl;
+	os << p.timed << '\t' << p.strCommand << '\t' << quoteValue(p.value);
+	if (p.rod >= 0) os << '\t' << p.rod;
+	os << std::endl;
 	return os;
 }
@@ -0,0 +1,116 @@
+#include <SimulationThread.h>
+#include <algorithm>
+#include <chrono>
+
+SimulationThread::SimulationThread(Simulator* reactor)
+{
+	this->reactor = reactor;
+	publishSnapshot();
+}
+
+SimulationThread::~SimulationThread()
+{
+	stop();
+}
+
+void SimulationThread::start()
+{
+	if (running) return;
+	running = true;
+	worker = std::thread(&SimulationThread::run, this);
+}
+
+void SimulationThread::stop()
+{
+	running = false;
+	if (worker.joinable()) worker.join();
+}
+
+bool SimulationThread::send(const Command& command)
+{
+	if (commandQueue.push(command)) return true;
+	cerr << "Command queue full, dropping " << command.strCommand << endl;
+	return false;
+}
+
+std::unique_lock<std::mutex> SimulationThread::acquire()
+{
+	waiting++;
+	std::unique_lock<std::mutex> lock(simMutex);
+	waiting--;
+	return lock;
+}
+
+void SimulationThread::postToGui(const std::function<void()>& event)
+{
+	std::lock_guard<std::mutex> lock(guiMutex);
+	guiEvents.push_back(event);
+}
+
+void SimulationThread::processGuiEvents()
+{
+	std::vector<std::function<void()>> events;
+	{
+		std::lock_guard<std::mutex> lock(guiMutex);
+		events.swap(guiEvents);
+	}
+	for (auto& event : events) event();
+}
+
+void SimulationThread::executeCommands()
+{
+	Command command;
+	while (commandQueue.pop(command)) reactor->executeCommand(command);
+}
+
+void SimulationThread::publishSnapshot()
+{
+	FrameSnapshot frame;
+	size_t index = reactor->getCurrentIndex();
+	frame.time = reactor->getCurrentTime();
+	frame.power = reactor->getCurrentPower();
+	frame.flux = reactor->getCurrentFlux();
+	frame.period = *reactor->getReactorPeriod();
+	frame.asymPeriod = *reactor->getReactorAsymPeriod();
+	frame.reactivity = reactor->reactivity_[index];
+	frame.rodReactivity = reactor->rodReactivity_[index];
+	frame.temperature = reactor->getCurrentTemperature();
+	frame.waterTemperature = *reactor->getWaterTemperature();
+	frame.waterLevel = *reactor->getWaterLevel();
+	frame.rodCount = std::min(reactor->rods.size(), SNAPSHOT_MAX_RODS);
+	for (size_t i = 0; i < frame.rodCount; i++) {
+		frame.rodExactPosition[i] = *reactor->rods[i]->getExactPosition();
+		frame.rodActualPosition[i] = *reactor->rods[i]->getActualPosition();
+		frame.rodEnabled[i] = *reactor->rods[i]->isEnabled();
+	}
+	frame.scramStatus = reactor->getScramStatus();
+	frame.sourceInserted = reactor->getNeutronSourceInserted();
+	frame.safetyBladesInserted = reactor->getSafetyBladesInserted();
+	frame.slowStep = reactor->getSlowStepLength();
+	frame.currentIndex = index;
+	frame.oldestIndex = reactor->getOldestIndex();
+	frame.oldestTime = reactor->time_[frame.oldestIndex];
+	frame.iterations = reactor->getIterationsTotal();
+	snapshots.publish(frame);
+}
+
+void SimulationThread::run()
+{
+	while (running) {
+		size_t done;
+		{
+			std::lock_guard<std::mutex> lock(simMutex);
+			executeCommands();
+			done = reactor->runLoop(SIMULATION_SLICE_ITERATIONS);
+			publishSnapshot();
+		}
+		if (done < SIMULATION_SLICE_ITERATIONS) {
+			// Caught up with the wall clock
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		else {
+			// Behind the wall clock, only give way if someone is waiting for the simulator
+			while (waiting > 0 && running) std::this_thread::yield();
+		}
+	}
+}
@@ -1,77 +1,222 @@
 #include <Simulator.h>
+#include <HistoryFile.h>
 #include <limits>
 #include <cmath>
 #include <ctime>
 #include <iterator>
 #include <iomanip>
 #include <random>
+#include <chrono>
+#include <cstring>
+#include <sstream>
+
+// DT_STEP iterations between two per frame calculations during a replay
+constexpr size_t REPLAY_FRAME_ITERATIONS = 100;
 // ca
 void Simulator::dataToFile(std::string fileName)
 {
-	ofstream logFile;
-	logFile.open(fileName + ".dat");
-	logFile << "#######################################################################################################################\n";
-	time_t now = time(0);
-	struct tm *p = localtime(&now);
-	char s[100];
-	strftime(s, 100, "%c", p);
-	logFile << "#                  Research reactor simulator log " << s << "                   #\n";
-	logFile << "#Time[h:m:s:ms]  n-source  Safety blades  NR[mm]  SR[mm]  WL[mm]  Reactivity[pcm]  Power[W]  Flux[#/(cm²·s)]  Period[s]  #\n";
-	logFile << "#######################################################################################################################\n";
-	logFile << std::setprecision(5);
-size_t start = getOldestIndex();
-size_t end   = getCurrentIndex();  // stop at current time
-size_t idx = start;
-size_t step = 0;
-
-while (idx != end) {
-    if (step % data_division == 0) {
-        size_t poisonIdx = idx / POISON_DATA_DEL_DIVISION;
-        logFile << formatTime(time_[idx])
-				<< std::setw(11) << n_source[idx]
-				<< std::setw(12) << safety_blades[idx]
-                << std::setw(11) << rodPositions_[0][idx]
-                << std::setw(9) << rodPositions_[1][idx]
-                << std::setw(9) << rodPositions_[2][idx]
-                << std::setw(12) << reactivity_[idx]
-                << std::setw(15) << powerFromNeutrons(state_vector_[0][idx])
-                << std::setw(14) << state_vector_[0][idx] * t_neutron_speed / (getReactorCoreVolume()) * 1e-4
-                << std::setw(12) << reactorPeriod_[idx]
-                << std::setw(12) << std::endl;
-    }
-    idx = shiftIndex(idx, 1);
-    step++;
-}
-
-	logFile.close();
+	HistoryExport history(this, ExportFormat::Text, fileName);
+	history.run();
+	if (history.getStatus() != HistoryExport::Status::Finished) cerr << history.getMessage() << endl;
+}
+
+void Simulator::dataToBinaryFile(std::string fileName)
+{
+	HistoryExport history(this, ExportFormat::Binary, fileName);
+	history.run();
+	if (history.getStatus() != HistoryExport::Status::Finished) cerr << history.getMessage() << endl;
 }
 
 void Simulator::CountsToFile(std::string fileName)
 {
-	ofstream countsFile;
-	countsFile.open(fileName + ".dat");
-	time_t now = time(0);
-	struct tm *p = localtime(&now);
-	char s[100];
-	strftime(s, 100, "%c", p);
-	countsFile << "##############  Counts/bin from detectors, dwell Time = " << getdwellTime() << " s  #################\n";
-	countsFile << "Time[h:m:s:ms]       Det1[Counts]      Det2[Counts]               \n";
-	size_t start = getIndexFromTime(acquisitionStartTime);
-	size_t end = getCurrentIndex();
-	size_t idx = start;
-	size_t stepsPerDwell = size_t(getdwellTime() / DT_STEP + 0.5);
-	size_t stepCount = 0;
-
-	while (idx != end)
-	{
-		if (time_[idx] >= acquisitionStartTime && stepCount % stepsPerDwell == 0)
-		{
-			countsFile << formatTime(time_[idx]) << std::setw(16)  << counts_detector1_noisy_[idx] << std::setw(16) <<  counts_detector2_noisy_[idx]  << std::endl;
+	HistoryExport history(this, ExportFormat::Counts, fileName);
+	history.run();
+	if (history.getStatus() != HistoryExport::Status::Finished) cerr << history.getMessage() << endl;
+}
+
+HistoryExport* Simulator::startExport(ExportFormat format, const std::string& fileName)
+{
+	HistoryExport* historyExport = new HistoryExport(this, format, fileName);
+	historyExport->start();
+	exports.push_back(historyExport);
+	return historyExport;
+}
+
+bool Simulator::setJournal(const std::string& directory, size_t segmentSamples, size_t maxSegments)
+{
+	appendToJournal();
+	delete journal;
+	journal = nullptr;
+	if (directory.empty()) return true;
+
+	journal = new HistoryJournal(history, directory, segmentSamples);
+	journal->setMaxSegments(maxSegments);
+	journal->restart((iterations_total > dataPoints) ? iterations_total - dataPoints : 0);
+	appendToJournal();
+	return journal != nullptr;
+}
+
+void Simulator::appendToJournal()
+{
+	if (journal && !journal->append(iterations_total)) {
+		cerr << "Stopping the history journal in " << journal->getDirectory() << endl;
+		delete journal;
+		journal = nullptr;
+	}
+}
+
+HistoryPyramid* Simulator::getPyramid(const float* column)
+{
+	for (HistoryPyramid* pyramid : pyramids) {
+		if (pyramid->getColumn() == column) return pyramid;
+	}
+	HistoryPyramid* pyramid = new HistoryPyramid(column, dataPoints);
+	pyramids.push_back(pyramid);
+	pyramid->update(iterations_total);
+	return pyramid;
+}
+
+ColumnPyramid<double>* Simulator::getPyramid(const double* column)
+{
+	for (ColumnPyramid<double>* pyramid : doublePyramids) {
+		if (pyramid->getColumn() == column) return pyramid;
+	}
+	ColumnPyramid<double>* pyramid = new ColumnPyramid<double>(column, dataPoints);
+	doublePyramids.push_back(pyramid);
+	pyramid->update(iterations_total);
+	return pyramid;
+}
+
+void Simulator::updatePyramids()
+{
+	for (HistoryPyramid* pyramid : pyramids) pyramid->update(iterations_total);
+	for (ColumnPyramid<double>* pyramid : doublePyramids) pyramid->update(iterations_total);
+}
+
+void Simulator::restartPyramids()
+{
+	for (HistoryPyramid* pyramid : pyramids) pyramid->restart(0);
+	for (ColumnPyramid<double>* pyramid : doublePyramids) pyramid->restart(0);
+}
+
+bool Simulator::setRecording(const std::string& fileName)
+{
+	if (recording) {
+		*recording << "# end " << recordedIterations << endl;
+		delete recording;
+		recording = nullptr;
+	}
+	if (fileName.empty()) return true;
+
+	// The replay starts from the state at the start of the recording
+	if (!saveCheckpoint(fileName + ".ck")) return false;
+	recording = new std::ofstream(fileName);
+	if (!*recording) {
+		cerr << "Error opening session recording: " << fileName << endl;
+		delete recording;
+		recording = nullptr;
+		return false;
+	}
+	recordedIterations = 0;
+	*recording << "# CROCUS session: <iteration> <command> <value> [rod], the state at iteration 0 is in " << fileName << ".ck" << endl;
+	*recording << "# seed " << noiseSeed << ", started at iteration " << iterations_total << " (" << getCurrentTime() << " s)" << endl;
+	return true;
+}
+
+bool Simulator::replaySession(const std::string& fileName)
+{
+	std::ifstream ifs(fileName);
+	if (!ifs) {
+		std::cerr << "Error opening session: " << fileName << std::endl;
+		return false;
+	}
+	std::vector<Command> session;
+	size_t end = 0;
+	std::string line;
+	while (std::getline(ifs, line)) {
+		std::istringstream ls(line);
+		Command c;
+		if (line.compare(0, 6, "# end ") == 0) {
+			ls.ignore(6);
+			ls >> end;
+		}
+		else if (ls >> c) {
+			session.push_back(c);
 		}
-		idx = shiftIndex(idx, 1);
-		stepCount++;
 	}
-	countsFile.close();
+	if (!loadCheckpoint(fileName + ".ck")) return false;
+	// Every command executed during the recording is in the session, the scripts included
+	scriptCommands.clear();
+
+	size_t done = 0;
+	auto runTo = [&](size_t iteration) {
+		while (done < iteration && !exitRequested) {
+			const size_t n = std::min(iteration - done, REPLAY_FRAME_ITERATIONS);
+			runIterations(n);
+			done += n;
+		}
+	};
+	for (const Command& c : session) {
+		runTo((size_t)c.timed);
+		if (exitRequested) break;
+		executeCommand(c);
+		loadPendingCheckpoint();
+	}
+	runTo(end);
+	return true;
+}
+
+bool Simulator::journalToBinaryFile(std::string fileName, double fromTime, double toTime)
+{
+	appendToJournal();
+	if (!journal) return false;
+	const size_t from = journal->iterationAt(fromTime);
+	const size_t count = (journal->getEnd() > from) ? journal->iterationAt(toTime) + 1 - from : 0;
+	const std::vector<HistoryChannel>& channels = journal->getChannels();
+
+	double startTime = 0., endTime = 0.;
+	if (count) {
+		journal->read(0, from, 1, &startTime);
+		journal->read(0, from + count - 1, 1, &endTime);
+	}
+	HistoryFileWriter writer;
+	// 0 for samples that are not evenly spaced (slow mode), as in HistoryExport
+	const double span = endTime - startTime;
+	writer.setNumber("dt", (count < 2 || std::abs(span - (double)(count - 1) * DT_STEP) <= DT_STEP * 0.1) ? DT_STEP : 0.);
+	writer.setNumber("startTime", startTime);
+	writer.setNumber("powerPerNeutron", powerFromNeutrons(1.));
+	writer.setNumber("fluxPerNeutron", t_neutron_speed / getReactorCoreVolume() * 1e-4);
+	writer.setJson("settings", settingsJson);
+	for (const auto& c : channels) writer.addChannel(c.name, c.unit, c.type, c.elementSize);
+	bool ok = writer.open(fileName + ".bin", count);
+
+	std::vector<char> buffer;
+	for (size_t c = 0; c < channels.size() && ok; c++) {
+		buffer.resize(EXPORT_CHUNK_SAMPLES * channels[c].elementSize);
+		for (size_t i = 0; i < count && ok; i += EXPORT_CHUNK_SAMPLES) {
+			const size_t n = std::min(EXPORT_CHUNK_SAMPLES, count - i);
+			ok = journal->read(c, from + i, n, buffer.data()) && writer.writeValues(c, i, buffer.data(), n);
+		}
+	}
+	ok = writer.close() && ok;
+	if (!ok) cerr << "Error writing binary data file: " << fileName << ".bin" << endl;
+	return ok;
+}
+
+void Simulator::reapExports(bool wait)
+{
+	for (auto it = exports.begin(); it != exports.end(); ) {
+		HistoryExport* historyExport = *it;
+		if (wait) historyExport->wait();
+		else if (!historyExport->isDone()) {
+			it++;
+			continue;
+		}
+		if (historyExport->getStatus() == HistoryExport::Status::Finished) cout << historyExport->getMessage() << endl;
+		else cerr << historyExport->getMessage() << endl;
+		delete historyExport;
+		it = exports.erase(it);
+	}
 }
 
 
@@ -85,13 +230,13 @@ void Simulator::rodsToFile(std::string fileName)
 
 	size_t max_steps = 0;
 
-	for (int i = 0; i < NUMBER_OF_CONTROL_RODS; i++) {
+	for (size_t i = 0; i < rods.size(); i++) {
 		max_steps = std::max(max_steps, *rods[i]->getRodSteps());
 	}
 
 	for (size_t i = 0; i <= max_steps; i++) {
 		rodFile << std::setprecision(2) << fixed << (float)i << "\t";
-		for (size_t j = 0; j < NUMBER_OF_CONTROL_RODS; j++) {
+		for (size_t j = 0; j < rods.size(); j++) {
 			if (i <= *rods[j]->getRodSteps()) {
 				rodFile << std::setprecision(2) << fixed << rods[j]->getPCMat((float)i) << "\t";
 				if (i <= *rods[j]->getRodSteps() - 1) {
@@ -182,32 +327,33 @@ bool Simulator::getScramEnabled(ScramSignals scramType)
 Simulator::Simulator(Settings* properties)
 {
 	dataPoints = (size_t)std::round(DELETE_OLD_DATA_TIME_DEFAULT / DT_STEP) + 1;
-	time_ = new double[dataPoints];
-	reactivity_ = new float[dataPoints];
-	n_source = new std::string[dataPoints];
-	safety_blades = new std::string[dataPoints];
-	rodReactivity_ = new float[dataPoints];
-	reactorPeriod_ = new double[dataPoints];    // introduce vector to save period values at each index
-	doublingTime_ = new double[dataPoints];    // introduce vector to save doubling time values at each index
-	rodPositions_ = new float*[3];
-	for (int i = 0; i < 3; ++i)
-		rodPositions_[i] = new float[dataPoints];  // or a specific max length
-	CPS_detector1_ = new double[dataPoints];    // introduce vector to save "detector counts" at each index
-	counts_detector1_noisy_ = new double[dataPoints];   // vector with fluctuations
-	CPS_detector2_ = new double[dataPoints];    // introduce vector to save "detector counts" at each index
-	counts_detector2_noisy_ = new double[dataPoints];   // vector with fluctuations
-
-	// Initialize the state vector
+	cursor = RingCursor(dataPoints);
+	history = new HistoryStore(dataPoints);
+	integrator = createIntegrator<PKE_DELAYED_GROUPS>(IntegratorType::RK4);
+	time_ = history->time;
+	reactivity_ = history->reactivity;
+	rodReactivity_ = history->rodReactivity;
+	reactorPeriod_ = history->period;    // period values at each index
+	doublingTime_ = history->doublingTime;    // doubling time values at each index
+	// The control room detectors, setProperties gives them their conversion factors and dwell time
+	detectors.add(DetectorChannel("detector 1", DETECT1_CONV_DEFAULT));
+	detectors.add(DetectorChannel("detector 2", DETECT2_CONV_DEFAULT));
+	// Create control rods, setProperties adds the extra rods of the settings
+	rods.configure(Settings().rodBank());
+	attachColumns();
+	resetSubsystemRates();
+	compileTrips();
+
+	// The state vector
 	for (int i = 0; i < 8; i++)
-		state_vector_[i] = new double[dataPoints];
+		state_vector_[i] = history->neutrons[i];
 
-	xenon_ = new float[(size_t)(2*DELETE_OLD_DATA_TIME_DEFAULT + 1)];
-	iodine_ = new float[(size_t)(2*DELETE_OLD_DATA_TIME_DEFAULT + 1)];
-	temperature_ = new float[dataPoints];
+	xenon_ = &history->xenon;
+	iodine_ = &history->iodine;
+	temperature_ = &history->temperature;
 
-	// Create control rods
-	for (int i = 0; i < NUMBER_OF_CONTROL_RODS; i++)
-		rods[i] = new ControlRod(i,false);
+	// The step function depends on whether the regulating rod is in automatic mode
+	regulatingRod()->setModeChangedCallback([this]() { selectStepFunction(); });
 
 	source_sqw = new SquareWave(SIMULATION_MODE_PERIOD_DEFAULT, 1.f);
 	source_sinMode = new Sine(SIMULATION_MODE_PERIOD_DEFAULT, 1.f);
@@ -220,10 +366,18 @@ Simulator::Simulator(Settings* properties)
 }
 
 void Simulator::init() {
+	// Background exports of the old history stop at their next chunk
+	historyResets++;
+	historyHead.store(1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	if (journal) journal->restart(0);
+	restartPyramids();
+	// A replay could not follow the reset
+	if (recording) setRecording("");
+
 	// Reset rods
-	for (int i = 0; i < NUMBER_OF_CONTROL_RODS; i++) {
-		rods[i]->resetRod();
-	}
+	rods.reset();
 
 	// Initial values
 	time_[0] = 0.;
@@ -234,12 +388,13 @@ void Simulator::init() {
 		reactivity_[0] -= safety_blades_worth;
 	}
 
-	n_source[0] = getNeutronSourceInserted() ? "IN" : "OUT";
-	safety_blades[0] = getSafetyBladesInserted() ? "IN" : "OUT";
+	history->sourceInserted.set(0, getNeutronSourceInserted());
+	history->safetyBladesInserted.set(0, getSafetyBladesInserted());
 
 	rodReactivity_[0] = reactivity_[0];
-	reactorPeriod_[0] = 3600.; // just to initialise it, it has no influence on other parameters anyway
-	doublingTime_[0] = reactorPeriod_[0] * std::log(2); 
+	reactorPeriod = 3600.; // just to initialise it, it has no influence on other parameters anyway
+	reactorPeriod_[0] = (float)reactorPeriod;
+	doublingTime_[0] = (float)(reactorPeriod * std::log(2)); 
 
 	// to have the possibility of no neutron source from the first instant 
 	if (source_inserted){
@@ -254,16 +409,21 @@ void Simulator::init() {
 		state_vector_[i][0] = state_vector_[0][0] * groupStability[i - 1];
 		state_vector_[7][0] += state_vector_[i][0];
 	}
-	CPS_detector1_[0] = int(powerFromNeutrons(state_vector_[0][0]) * getDet1Factor());
-	CPS_detector2_[0] = int(powerFromNeutrons(state_vector_[0][0]) * getDet2Factor());
-	counts_detector1_noisy_[0] = CPS_detector1_[0];
-	counts_detector2_noisy_[0] = CPS_detector2_[0];
-	xenon_[0] = 0.f;
-	iodine_[0] = 0.f;
-	temperature_[0] = WATER_TEMPERATURE_DEFAULT;
+	for (size_t i = 0; i < detectors.size(); i++) {
+		detectors[i].cps[0] = (float)(int)detectors[i].rate(powerFromNeutrons(state_vector_[0][0]));
+		detectors[i].noisyCounts[0] = detectors[i].cps[0];
+	}
+	detectors.resetWindows();
+	xenon_->set(0, 0.f);
+	iodine_->set(0, 0.f);
+	fuelTemperature = WATER_TEMPERATURE_DEFAULT;
+	temperature_->set(0, fuelTemperature);
 	waterTemperature = WATER_TEMPERATURE_DEFAULT;
 	Xe_conc = 0.;
 	I_conc = 0.;
+	slowStepLength = 0.;
+	kineticsRemaining = 0;
+	incompleteKineticsSteps = 0;
 	startTime = -1.;
 	actualTime = 0.;
 	simulatorTime = 0.;
@@ -279,44 +439,35 @@ void Simulator::init() {
 	last_sample_number = 0;
 	speedFactor = 1.;
 	calc_performed = 0;
-	iterations_total = 0;
+	scheduler.setClock(0);
+	setIterationsTotal(0);
 	frames_total = 0;
-	periodTimer = -1.;
+	trips.resetState();
+	trips.clearLog();
 	resetAverage = 0;
 	doseRate = 0.;
-
-	// Adding power extremes
-	if (powerExtremes) delete powerExtremes;
-	powerExtremes = new deque<PowerExtreme>;
-	powerExtremes->push_back(PowerExtreme());
+	exitRequested = false;
 
 	recalculateLambdaBetaEffective();
+	integrator->reset();
+	selectStepFunction();
 
-	iterations_total++;
+	advanceIteration();
 }
 
 Simulator::~Simulator() {
-	delete time_;
-	delete reactivity_;
-	delete n_source;
-	delete safety_blades;
-	for(int i = 0; i < 8; i++)
-		delete state_vector_[i];
-	delete xenon_;
-	delete iodine_;
-	delete temperature_;
-	delete rodReactivity_;
-	delete reactorPeriod_;
-	delete doublingTime_;
-	for (int i = 0; i < 3; ++i)
-		delete[] rodPositions_[i];
-	delete[] rodPositions_;
-	delete CPS_detector1_;
-	delete CPS_detector2_;
-	delete counts_detector1_noisy_;
-	delete counts_detector2_noisy_;
-	delete powerExtremes;
-	for (int i = 0; i < NUMBER_OF_CONTROL_RODS; i++) delete rods[i];
+	setRecording("");
+	reapExports(true);
+	appendToJournal();
+	delete journal;
+	for (HistoryPyramid* pyramid : pyramids) delete pyramid;
+	for (ColumnPyramid<double>* pyramid : doublePyramids) delete pyramid;
+	delete history;
+	delete integrator;
+	delete source_sqw;
+	delete source_sinMode;
+	delete source_saw;
+	delete source_none;
 }
 
 void Simulator::setAllToDefaults()
@@ -346,6 +497,7 @@ const bool &Simulator::getSafetyBladesInserted() const
 void Simulator::setNeutronSourceInserted(const bool &value)
 {
 	source_inserted = value;
+	selectStepFunction();
 }
 
 void Simulator::setSafetyBladesInserted(const bool &value)
@@ -359,10 +511,12 @@ const bool &Simulator::getTemperatureEffectsEnabled() const {
 
 void Simulator::setTemperatureEffectsEnabled(const bool &value) {
 	temperature_effects = value;
+	selectStepFunction();
 }
 
 void Simulator::setFissionPoisoningEffectsEnabled(const bool &value) {
 	fissionPoisoning_effects = value;
+	selectStepFunction();
 }
 
 const double &Simulator::getMaxFissionCrossSection() const
@@ -428,6 +582,7 @@ const double &Simulator::getPromptNeutronLifetime() const
 void Simulator::setPromptNeutronLifetime(const double &value)
 {
 	prompt_lifetime = value;
+	updatePkeSystem();
 }
 
 const double & Simulator::getExcessReactivity() const
@@ -557,10 +712,10 @@ float Simulator::getCurrentDoublingTime() const
 
 float Simulator::getCurrentTemperature() const
 {
-	return temperature_[getCurrentIndex()];
+	return fuelTemperature;
 }
 
-const float *Simulator::getTemperature() const
+const DecimatedColumn *Simulator::getTemperature() const
 {
 	return temperature_;
 }
@@ -674,16 +829,6 @@ const size_t &Simulator::getCalculationsPerformed() const
 	return calc_performed;
 }
 
-size_t Simulator::getOrderChanges() const
-{
-	return powerExtremes->size();
-}
-
-Simulator::PowerExtreme &Simulator::getExtremeAt(size_t i)
-{
-	return powerExtremes->at(i);
-}
-
 bool Simulator::isPaused() const
 {
 	return speedFactor == 0.;
@@ -721,14 +866,13 @@ double &Simulator::getSpeedFactor()
 
 const size_t Simulator::getIndexFromTime(double time) const
 {
-	size_t ret = getOldestIndex();
-	double prevTime = time_[ret];
-	if (time >= prevTime) {
-		return shiftIndex(ret, (int)std::round((time - prevTime) * 1e3));
-	}
-	else {
-		return ret;
-	}
+	return getIterationFromTime(time) % dataPoints;
+}
+
+size_t Simulator::getIterationFromTime(double time) const
+{
+	const size_t first = (iterations_total > dataPoints) ? iterations_total - dataPoints : 0;
+	return history->iterationAt(time, first, iterations_total);
 }
 
 double &Simulator::getPowerLimit()
@@ -758,6 +902,66 @@ double &Simulator::getdwellTime()
 void Simulator::setdwellTime(double tdwell)
 {
 	dwellTime = tdwell;
+	syncSystemDetectors();
+}
+
+void Simulator::syncSystemDetectors()
+{
+	detectors[0].convFactor = det1_convFactor;
+	detectors[1].convFactor = det2_convFactor;
+	detectors[0].dwellTime = dwellTime;
+	detectors[1].dwellTime = dwellTime;
+}
+
+size_t Simulator::addDetector(const DetectorChannel& channel)
+{
+	detectors.add(channel);
+	attachColumns();
+	return detectors.size() - 1;
+}
+
+void Simulator::attachColumns()
+{
+	if (history->cps.size() != detectors.size() || history->rodPositions.size() != rods.size()) {
+		// The journal and the pyramids read the columns, the journal starts over with the new set of channels
+		appendToJournal();
+		std::vector<const void*> removed;
+		for (size_t i = detectors.size(); i < history->cps.size(); i++) {
+			removed.push_back(history->cps[i]);
+			removed.push_back(history->noisyCounts[i]);
+		}
+		for (size_t i = rods.size(); i < history->rodPositions.size(); i++) removed.push_back(history->rodPositions[i]);
+		for (auto it = pyramids.begin(); it != pyramids.end(); ) {
+			if (std::find(removed.begin(), removed.end(), (const void*)(*it)->getColumn()) != removed.end()) {
+				delete *it;
+				it = pyramids.erase(it);
+			}
+			else {
+				it++;
+			}
+		}
+		HistoryJournal* oldJournal = journal;
+		journal = nullptr;
+		history->setDetectors(detectors.size());
+		history->setRods(rods.size());
+		if (oldJournal) {
+			const std::string directory = oldJournal->getDirectory();
+			const size_t segmentSamples = oldJournal->getSegmentSamples();
+			const size_t maxSegments = oldJournal->getMaxSegments();
+			oldJournal->restart(0);
+			delete oldJournal;
+			setJournal(directory, segmentSamples, maxSegments);
+		}
+	}
+	for (size_t i = 0; i < detectors.size(); i++) {
+		detectors[i].cps = history->cps[i];
+		detectors[i].noisyCounts = history->noisyCounts[i];
+	}
+	CPS_detector1_ = history->cps[0];    // "detector counts" at each index
+	counts_detector1_noisy_ = history->noisyCounts[0];   // counts with fluctuations
+	CPS_detector2_ = history->cps[1];
+	counts_detector2_noisy_ = history->noisyCounts[1];
+	rodPositions_ = history->rodPositions.data();
 }
 
 
@@ -801,66 +1005,78 @@ void Simulator::pushNewState(double * states, size_t index)
 void Simulator::checkOperationalLimits()
 {
 	if (status) return;
-	if (getCurrentPower() > 1e13) { // 10GW
-		if (severeErrorCallback) severeErrorCallback(0);
-		scram(ScramSignals::Power);
+	// Read once, the newest sample does not change during the pass
+	double signals[TRIP_SIGNAL_COUNT];
+	signals[PowerSignal] = getCurrentPower();
+	signals[FuelTemperatureSignal] = getCurrentTemperature();
+	signals[WaterTemperatureSignal] = waterTemperature;
+	signals[PeriodSignal] = reactorPeriod;
+	signals[DoublingTimeSignal] = reactorPeriod * std::log(2);
+	signals[CountRateSignal] = CPS_detector1_[getCurrentIndex()];
+	std::uint8_t conditions = godMode ? GodMode : NormalMode;
+	if (pulsing) conditions |= PulsingCondition;
+	if (regulatingRod()->getOperationMode() == ControlRod::OperationModes::Simulation) conditions |= RodSimulationCondition;
+
+	trips.evaluate(signals, getCurrentTime(), conditions, [this](const TripDefinition& trip) {
+		if (trip.severity >= 0 && severeErrorCallback) severeErrorCallback(trip.severity);
+		scram((ScramSignals)trip.reason);
+	});
+}
+
+void Simulator::compileTrips()
+{
+	std::vector<TripDefinition> table;
+	// Beyond any setting, also in god mode. One of them ends the pass
+	TripDefinition severePower("severe power", PowerSignal, TripComparator::Above, 1e13, ScramSignals::Power); // 10GW
+	TripDefinition severeTemperature("severe fuel temperature", FuelTemperatureSignal, TripComparator::Above, 950., ScramSignals::FuelTemperature);
+	severePower.severity = 0;
+	severeTemperature.severity = 1;
+	for (TripDefinition* t : { &severePower, &severeTemperature }) {
+		t->modes = NormalMode | GodMode;
+		t->exclusive = true;
+		table.push_back(*t);
 	}
-	else if (getCurrentTemperature() > 950.f) {
-		if (severeErrorCallback) severeErrorCallback(1);
-		scram(ScramSignals::FuelTemperature);
-	}
-	else {
-		if (godMode) {
-			if (getCurrentPower() > std::numeric_limits<double>::max()*0.1)
-			{
-				scram(ScramSignals::Power);
-			}
-
-			if (getCurrentTemperature() > std::numeric_limits<float>::max()*0.001) {
-				scram(ScramSignals::FuelTemperature);
-			}
-		}
-		else {
-			if ((getCurrentPower() > powerLimit) && !pulsing)
-			{
-				if (power_scram_enabled) scram(ScramSignals::Power);
-			}
-
-			if (getCurrentTemperature() > fuelTemperatureLimit) {
-				if (fuel_temp_scram_enabled) scram(ScramSignals::FuelTemperature);
-			}
-
-			if (waterTemperature > waterTemperatureLimit) {
-				if (water_temp_scram_enabled) scram(ScramSignals::WaterTemperature);
-			}
-
-			/*if (std::abs(waterLevel_delta) > waterLevelLimit) {
-			if (water_level_scram_enabled) scram(ScramSignals::WaterLevel);
-			}*/
 
-			if (periodTimer == -1) // If period hasn't gone past the limit yet
-			{
-				if (reactorPeriod < periodLimit && reactorPeriod > 0)
-				{
-					periodTimer = getCurrentTime(); // Set period time to current time
-				}
-			}
-			else
-			{
-				if (reactorPeriod > periodLimit || reactorPeriod < 0)
-				{
-					periodTimer = -1; // Reset period timer
-				}
-				else
-				{
-					if (periodTimer + 2.5 < getCurrentTime()) // If it's been there for more than half a second, SCRAM!
-					{
-						if (period_scram_enabled && !(regulatingRod()->getOperationMode() == ControlRod::OperationModes::Simulation)) scram(ScramSignals::Period);
-					}
-				}
-			}
-		}
-	}
+	// God mode only stops at values close to the overflow
+	TripDefinition godPower("god mode power", PowerSignal, TripComparator::Above, std::numeric_limits<double>::max() * 0.1, ScramSignals::Power);
+	TripDefinition godTemperature("god mode fuel temperature", FuelTemperatureSignal, TripComparator::Above, std::numeric_limits<float>::max() * 0.001, ScramSignals::FuelTemperature);
+	godPower.modes = godTemperature.modes = GodMode;
+	table.push_back(godPower);
+	table.push_back(godTemperature);
+
+	// The operational limits, bound to the limits and switches of the GUI
+	TripDefinition power("power", PowerSignal, TripComparator::Above, 0., ScramSignals::Power);
+	power.boundSetpoint = &powerLimit;
+	power.boundEnabled = &power_scram_enabled;
+	power.inhibits = PulsingCondition;
+	table.push_back(power);
+	TripDefinition fuel("fuel temperature", FuelTemperatureSignal, TripComparator::Above, 0., ScramSignals::FuelTemperature);
+	fuel.boundSetpoint = &fuelTemperatureLimit;
+	fuel.boundEnabled = &fuel_temp_scram_enabled;
+	table.push_back(fuel);
+	TripDefinition water("water temperature", WaterTemperatureSignal, TripComparator::Above, 0., ScramSignals::WaterTemperature);
+	water.boundSetpoint = &waterTemperatureLimit;
+	water.boundEnabled = &water_temp_scram_enabled;
+	table.push_back(water);
+	// The water level trip is not used, waterLevel_delta only changes by boiling
+	TripDefinition period("period", PeriodSignal, TripComparator::PositiveBelow, 0., ScramSignals::Period);
+	period.boundSetpoint = &periodLimit;
+	period.boundEnabled = &period_scram_enabled;
+	period.delay = PERIOD_SCRAM_DELAY;
+	period.inhibits = RodSimulationCondition;
+	table.push_back(period);
+
+	table.insert(table.end(), extraTrips.begin(), extraTrips.end());
+	trips.compile(table);
+}
+
+void Simulator::addTrip(TripDefinition trip)
+{
+	if (!trip.reason) trip.reason = ScramSignals::User;
+	trip.boundSetpoint = nullptr;
+	trip.boundEnabled = nullptr;
+	extraTrips.push_back(trip);
+	compileTrips();
 }
 
 void Simulator::scram(ScramSignals reason)
@@ -868,19 +1084,7 @@ void Simulator::scram(ScramSignals reason)
 	if (reason) {
 		if ((status & reason) == reason) return;
 		status |= reason;
-		for (int i = 0; i < 2; i++) {
-			rods[i]->clearCommands();
-		}
-
-		rods[2]->clearCommands();
-		if (*rods[2]->getActualPosition() < 6170){
-			rods[2]->setEnabled(false);
-		}
-		else {
-			rods[2]->moveRodToStep(6170, true);
-			rods[2]->commandMove((size_t) 6170);
-			rods[2]->setEnabled(false);
-		}
+		rods.scram();
 
 		Simulator::setSafetyBladesInserted(true);
 		Simulator::setNeutronSourceInserted(false);
@@ -890,17 +1094,16 @@ void Simulator::scram(ScramSignals reason)
 	}
 	else {
 		status = ScramSignals::None;
-		for (int i = 0; i < NUMBER_OF_CONTROL_RODS; i++) {
-			rods[i]->setEnabled(true);
-			rods[i]->clearCommands();
-		}
+		rods.resetScram();
+		// A condition still present after the reset counts its delay again
+		trips.resetState();
 		if (scramResetCallback) scramResetCallback();
 	}
 }
 
 double *Simulator::getReactorPeriod()
 {
-	return &reactorPeriod_[getCurrentIndex()];
+	return &reactorPeriod;
 }
 
 double *Simulator::getReactorAsymPeriod()
@@ -910,293 +1113,502 @@ double *Simulator::getReactorAsymPeriod()
 
 float Simulator::getTotalRodReactivity()
 {
-	float sum = 0.f;
-	for (int i = 0; i < NUMBER_OF_CONTROL_RODS; i++) sum += rods[i]->getCurrentPCM();
-	return sum;
+	return rods.getTotalRodReactivity();
 }
 
 float Simulator::getTotalRodWorth()
 {
-	float sum = 0.f;
-	for (int i = 0; i < NUMBER_OF_CONTROL_RODS; i++) sum += rods[i]->getRodWorth();
-	return sum;
+	return rods.getTotalRodWorth();
 }
 
-void Simulator::runLoop()
+double Simulator::getWallClockTime()
 {
-	double time = nanogui::get_seconds_since_epoch();
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+size_t Simulator::runLoop(size_t maxIterations)
+{
+	double time = getWallClockTime();
 	size_t srt_iterations;
 	if (startTime < 0.) {
-		startTime = nanogui::get_seconds_since_epoch();
+		startTime = time;
 		srt_iterations = 1;
 	}
 	else {
 		double processTime = (time - lastTime) * speedFactor; // the amount of time we need to process
 															  // itterations from the time we need to process plus the difference between the actual simulator time and the latest time we simulated
-		srt_iterations = (size_t)floor((processTime + simulatorTime - time_[getCurrentIndex()]) / DT_STEP);
+		srt_iterations = (size_t)floor((processTime + simulatorTime - time_[getCurrentIndex()]) / getStepLength());
 		// Increment actual simulator time
 		simulatorTime += processTime;
 	}
+	// Iterations above the limit are not lost, they are caught up in the following calls
+	srt_iterations = std::min(srt_iterations, maxIterations);
 
-	mainLoop(srt_iterations);
-	last_sample_number = srt_iterations;
-	solvePerFrame();
-	frames_total++;
+	runIterations(srt_iterations);
 	lastTime = time;
 	actualTime = time - startTime; // Maybe we will use this some time in the future, doesn't hurt fps so why not
+	return srt_iterations;
+}
+
+void Simulator::runIterations(size_t iterations)
+{
+	mainLoop(iterations);
+	last_sample_number = iterations;
+	solvePerFrame();
+	frames_total++;
+}
+
+bool Simulator::loadScriptFromFile(const std::string& path)
+{
+	std::ifstream ifs(path);
+	if (!ifs) {
+		std::cerr << "Error opening input file: " << path << std::endl;
+		return false;
+	}
+
+	// Script times are relative to the moment the script is loaded
+	double time0 = getCurrentTime();
+	Command cmd;
+	while (ifs >> cmd) {
+		cmd.timed += time0;
+		cout << cmd;
+		if (cmd.command == unknownCommand)
+			cerr << "Unknown command: " << cmd.strCommand << endl;
+		else if (numericCommand(cmd.command) && !cmd.numeric)
+			cerr << "Command " << cmd.strCommand << " needs a number, got " << cmd.value << endl;
+		scriptCommands.push(cmd);
+	}
+	return true;
 }
 
 const float rodAutoMove = 0.001f; // how much can the control rod move at a time (raw fraction of rodSteps)[0.1%]
 void Simulator::mainLoop(size_t iterations)
 {
-	// Optimizations:
-	size_t currentIndex, nextIndex;
-	double newPower, tempPow, negative_reactivity, rho, lastState[7], kf[4][7], finalState[8];
-	double stationary_temperature, new_temperature;
-	for (size_t i = 0; i < iterations; i++)
+	while (iterations > 0) {
+		// The journal has to copy the samples before the ring overwrites them
+		iterations -= runSteps(journal ? std::min(iterations, dataPoints / 2) : iterations);
+		// Script commands run between the steps, at the step they are due
+		if (iterations > 0 && scriptDue()) {
+			doScriptCommands();
+			// The rest of the frame belongs to the restored state or is not wanted any more
+			if (exitRequested || !pendingCheckpoint.empty()) break;
+		}
+	}
+}
+
+size_t Simulator::runSteps(size_t iterations)
+{
+	// Announces the samples about to be overwritten before writing them, see HistoryExport
+	historyHead.store(iterations_total + iterations, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	size_t i = 0;
+	while (i < iterations)
 	{
 		// Check pulse status
 		checkPulsingStatus();
 
-		currentIndex = getCurrentIndex();
-		nextIndex = getNextIndex();
-		// Increment time
-		time_[nextIndex] = time_[currentIndex] + DT_STEP;
+		// The step advances the scheduler, the limits are checked if they were due at this step.
+		// A slow step runs every subsystem
+		const SubsystemMask due = (slowStepLength > 0.) ? ~(SubsystemMask)0 : scheduler.getDue();
+		(this->*stepFunction)();
 
-		newPower = getCurrentPower();
+		// Increase number of iterations
+		advanceIteration();
+		recordedIterations++;
+		i++;
 
-		for (int r = 0; r < 3; ++r) {
-			rodPositions_[r][nextIndex] = (*rods[r]->getExactPosition())/10;
-		}
-		double cleanCPS1 = powerFromNeutrons(state_vector_[0][currentIndex]) * getDet1Factor();
-		double cleanCPS2 = powerFromNeutrons(state_vector_[0][currentIndex]) * getDet2Factor();
-		CPS_detector1_[nextIndex] = std::round(cleanCPS1);	
-		CPS_detector2_[nextIndex] = std::round(cleanCPS2);			
-
-		
-		const size_t stepsPerDwell = size_t(getdwellTime()/DT_STEP + 0.5);
-		dwellSumCPS1_ += cleanCPS1;
-		dwellSumCPS2_ += cleanCPS2;
-		dwellCounter_+= 1;
-
-		if (dwellCounter_ >= stepsPerDwell) {
-			double avgCPS1 = dwellSumCPS1_ / double(dwellCounter_);   // average CPS over the window
-			double avgCPS2 = dwellSumCPS2_ / double(dwellCounter_); 
-			double windowTime = dwellCounter_ * DT_STEP;
-			double lambda = avgCPS1 * windowTime;   // expected counts in window = CPS·time
-			double lambda_2 = avgCPS2 * windowTime;
-
-			double noisyCounts1;
-			double noisyCounts2;
-			if (lambda <= POISSON_TH) {
-				// true Poisson when counts/window is low
-				std::poisson_distribution<int> pdist(lambda);
-				std::poisson_distribution<int> pdist2(lambda_2);
-				noisyCounts1 = pdist(rng_);
-				noisyCounts2 = pdist2(rng_);
-			} else {
-				// Gaussian otherwise
-				std::normal_distribution<double> ndist(lambda, std::sqrt(lambda));
-				std::normal_distribution<double> ndist2(lambda_2, std::sqrt(lambda_2));
-				noisyCounts1 = ndist(rng_);
-				noisyCounts2 = ndist2(rng_);
-			}
-			currentNoisyCPS1_ = noisyCounts1;    //  add / windowTime if want to convert back to CPS 
-			currentNoisyCPS2_ = noisyCounts2; 
-			// reset for next dwell
-			dwellCounter_ = 0;
-			dwellSumCPS1_  = 0.0;
-			dwellSumCPS2_  = 0.0;
-		}
-		counts_detector1_noisy_[nextIndex] = std::round(currentNoisyCPS1_);   // save noisy CPS at each step 
-		counts_detector2_noisy_[nextIndex] = std::round(currentNoisyCPS2_);   
-
-
-		// Adding the period calculation here so it's done every time step and not only every frame
-		const double periodK = 0.01;
-		const auto NO_AVERAGES_REACTIVITY = 500;    // moving average 
-		int averageValues = (int)std::min(iterations_total - resetAverage - 1, (size_t)NO_AVERAGES_REACTIVITY);
-		// && std::abs(powerFromNeutrons(state_vector_[0][nextIndex]) - powerFromNeutrons(state_vector_[0][currentIndex]))> 0.0001
-		if (averageValues > 1 ) {
-			const double periodSum = (1 - std::pow(periodK, averageValues - 2)) / (1 - periodK);
-			double* vals = new double[averageValues];
-			double sum = 0.;
-			int    good = 0;
-			for (int i = 0; i < averageValues; i++) 
-				vals[i] = state_vector_[0][shiftIndex(currentIndex, i - averageValues + 1)];
-			for (int i = 0; i < averageValues - 1; i++) {
-				const double r = vals[i + 1] / vals[i];
-				if (r <= 0.0 || r == 1.0) continue;               // no information → skip
-				sum  += std::pow(periodK, averageValues - i - 2) / std::log(r);
-				++good;
-			}
-			delete[] vals;
-			if (good == 0) {                       // no valid pairs at all
-			reactorPeriod = 3600.0;            // ← default 1 hour
-		} else {
-			sum *= DT_STEP / periodSum;
-			reactorPeriod = std::isfinite(sum) ? sum : 3600.0;   // NaN/Inf guard
-		}
+		if (due & subsystemBit(Protection)) checkOperationalLimits();
+		if (scriptDue()) break;
+	}
+	updatePyramids();
+	appendToJournal();
+	return i;
+}
+
+// One DT_STEP of the simulation, the template arguments replace the per step checks of the feedback
+// effects, neutron source, pulse and regulating rod mode (see selectStepFunction)
+template <bool TemperatureEffects, bool FissionPoisoning, bool SourceInserted, bool Pulsing, bool AutomaticRod>
+void Simulator::step()
+{
+	// Optimizations:
+	size_t currentIndex, nextIndex, averageValues;
+	double newPower, tempPow, negative_reactivity, rho, lastState[7], finalState[8];
+	PkeState<PKE_DELAYED_GROUPS> pkeState;
+	double stationary_temperature, new_temperature;
+	// Subsystems that run at this step, the others keep their last results
+	const SubsystemMask due = scheduler.getDue();
 
-		/* “Too-few averages” branch */
+	currentIndex = getCurrentIndex();
+	nextIndex = getNextIndex();
+	// Increment time
+	time_[nextIndex] = time_[currentIndex] + DT_STEP;
+
+	newPower = getCurrentPower();
+
+	for (size_t r = 0; r < rods.size(); ++r) {
+		rodPositions_[r][nextIndex] = (*rods[r]->getExactPosition())/10;
+	}
+	// Count rates and the counts of the dwell windows of every detector channel
+	if (due & subsystemBit(Detectors))
+		detectors.step(powerFromNeutrons(state_vector_[0][currentIndex]), nextIndex, scheduler.getPeriod(Detectors) * DT_STEP);
+	else
+		detectors.hold(currentIndex, nextIndex);
+
+
+	// Adding the period calculation here so it's done every time step and not only every frame
+	// The average restarts at resetAverage and covers at most PERIOD_AVERAGE_SAMPLES samples
+	if (due & subsystemBit(PeriodMeter)) {
+		// At a lower rate the pairs are 'stride' samples apart and the average keeps its length in time
+		const size_t stride = scheduler.getPeriod(PeriodMeter);
+		const size_t window = (PERIOD_AVERAGE_SAMPLES - 1) / stride;
+		if (periodEstimator.getWindow() != window) periodEstimator.setWindow(window, std::pow(PERIOD_WEIGHT, (double)stride));
+		averageValues = std::min(iterations_total - resetAverage - 1, PERIOD_AVERAGE_SAMPLES);
+		const size_t pairs = (averageValues > stride) ? (averageValues - 1) / stride : 0;
+		if (pairs > 0) {
+			// The estimator holds the pairs - 1 older pairs, unless the average restarted or the state was replaced
+			if (!(periodEstimator.size() + 1 == pairs || (periodEstimator.size() == pairs && pairs == window))) {
+				periodEstimator.clear();
+				for (size_t i = pairs - 1; i > 0; i--)
+					periodEstimator.push(state_vector_[0][shiftIndex(currentIndex, -(long)((i + 1) * stride))],
+						state_vector_[0][shiftIndex(currentIndex, -(long)(i * stride))], (double)stride);
+			}
+			periodEstimator.push(state_vector_[0][shiftIndex(currentIndex, -(long)stride)], state_vector_[0][currentIndex], (double)stride);
+			reactorPeriod = periodEstimator.period();
 		}
-			else {                                 // averageValues <= 1
-			reactorPeriod = 3600.0;            // ← default 1 hour
+		else {
+			periodEstimator.clear();
+			reactorPeriod = PERIOD_UNDEFINED;            // ← default 1 hour
 		}
-		
-		reactorPeriod_[nextIndex] = reactorPeriod;  //saving reactor period for the output
-		doublingTime_[nextIndex] = reactorPeriod * std::log(2);  // doubling time added so can be displayed like in real CROCUS screens
+	}
+	
+	reactorPeriod_[nextIndex] = (float)reactorPeriod;  //saving reactor period for the output
+	doublingTime_[nextIndex] = (float)(reactorPeriod * std::log(2));  // doubling time added so can be displayed like in real CROCUS screens
 
 /* 		double meanCPS = CPS_detector1_[nextIndex];
-		double sigma   = std::sqrt(std::max(meanCPS, 0.0));                // Gaussian σ ≈ √mean
-		std::normal_distribution<double> dist(meanCPS, sigma);
-		counts_detector1_noisy_[nextIndex] = dist(rng_);       */
+	double sigma   = std::sqrt(std::max(meanCPS, 0.0));                // Gaussian σ ≈ √mean
+	std::normal_distribution<double> dist(meanCPS, sigma);
+	counts_detector1_noisy_[nextIndex] = dist(rng_);       */
 
+	new_temperature = fuelTemperature;
+	if (due & subsystemBit(FuelThermal)) {
 		// Calculate stationary temperature
 		tempPow = std::min(newPower, 1e6) / (float)no_fuel_elements;
 		stationary_temperature = (float)waterTemperature;
 		for (int order = 0; order < 3; order++) 
 			stationary_temperature += (float)(tempModelCoeff[order] * pow(tempPow, order + 1));
-		new_temperature = temperature_[currentIndex];
 
 
 		double power_losses = getCoolingFromTemperature(new_temperature);
-		new_temperature += (newPower - power_losses) * DT_STEP / getFuelCp(new_temperature);
+		new_temperature += (newPower - power_losses) * (scheduler.getPeriod(FuelThermal) * DT_STEP) / getFuelCp(new_temperature);
 		new_temperature = std::max(new_temperature, 22.);
 		// The cooling step, performed in both FH model and asymptotic model, commented out due to temperature model refractoring
+	}
 
-		temperature_[nextIndex] = static_cast<float>(new_temperature);
-
-		// Move rods
-		// In the automatic mode, the rods are moved to reach or maintain a constant power
-		if (regulatingRod()->getOperationMode() == ControlRod::OperationModes::Automatic) {
-			double powerToKeep = keepCurrentPower ? powerHold : keepSteadyPowerAt;
-			if (std::abs(powerToKeep - newPower) / powerToKeep > steadyDeviation) {
-				float move = rodAutoMove * *regulatingRod()->getRodSteps();
-				float newPos = *regulatingRod()->getExactPosition();
-				if (powerToKeep < newPower) {
-					newPos -= move;
-					newPos = std::max(0.f, newPos);
-				}
-				else {
-					newPos += move;
-					newPos = std::min((float)*regulatingRod()->getRodSteps(), newPos);
-				}
-				if ((avoidPeriodScram && (reactorPeriod > periodLimit * 1.1 || reactorPeriod < 0.)) || !avoidPeriodScram || (powerToKeep < newPower)) {
-					regulatingRod()->commandMove(newPos);
-				}
-				else {
-					regulatingRod()->clearCommands();
-				}
-			}
-		}
+	fuelTemperature = static_cast<float>(new_temperature);
+	if (temperature_->due(nextIndex)) temperature_->set(nextIndex, fuelTemperature);
 
-		// Rod positions are updated by the ControlRod class
-		for (int r = 0; r < NUMBER_OF_CONTROL_RODS; r++) 
-			rods[r]->refreshRod(r, DT_STEP);
+	// Move rods
+	// In the automatic mode, the rods are moved to reach or maintain a constant power
+	if (AutomaticRod && (due & subsystemBit(Autopilot))) moveAutomaticRod(newPower, scheduler.getPeriod(Autopilot));
 
-		rodReactivity_[nextIndex] = -getTotalRodWorth() + getTotalRodReactivity() + core_excess_reactivity;
-		if (safety_blades_inserted) {
-			rodReactivity_[nextIndex] -= safety_blades_worth;
-		}
+	// Rod positions are updated by the ControlRod class, the bank sums their worth in the same pass
+	rodReactivity_[nextIndex] = rods.step(DT_STEP) + core_excess_reactivity;
+	if (safety_blades_inserted) {
+		rodReactivity_[nextIndex] -= safety_blades_worth;
+	}
 
 
-		// The fission poison concentrations are changing slowly, so they do not need to be
-		// calculated as often as the point kinetics. Default is each 125 steps
-		if (nextIndex % 125 == 0) 
-			recalculatePoisonConcentrations(125 * DT_STEP);
-		// Save values everyPOISON_DATA_DEL_DIVISION steps and convert to g/m3
-		if (nextIndex % POISON_DATA_DEL_DIVISION == 0) {
-			size_t poi_idx = nextIndex / POISON_DATA_DEL_DIVISION;
-			xenon_[poi_idx] = (float)(Xe_conc / AVOGADRO_NUM * XENON_MOLAR_MASS);
-			iodine_[poi_idx] = (float)(I_conc / AVOGADRO_NUM * IODINE_MOLAR_MASS);
+	// The fission poison concentrations are changing slowly, so they do not need to be
+	// calculated as often as the point kinetics. Default is each POISON_UPDATE_PERIOD steps
+	if (due & subsystemBit(Poisons))
+		recalculatePoisonConcentrations(scheduler.getPeriod(Poisons) * DT_STEP);
+	// Save values every POISON_DATA_DEL_DIVISION steps and convert to g/m3
+	if (due & subsystemBit(PoisonStorage)) {
+		xenon_->set(nextIndex, (float)(Xe_conc / AVOGADRO_NUM * XENON_MOLAR_MASS));
+		iodine_->set(nextIndex, (float)(I_conc / AVOGADRO_NUM * IODINE_MOLAR_MASS));
+	}
+
+	/*This adds negative temperature and fission poisoning effects on
+	reactivity if enabled.*/
+	negative_reactivity = 0.;
+	if (TemperatureEffects) {
+		negative_reactivity += getReactivityCoefficient(new_temperature) * (new_temperature - ENVIRONMENT_TEMPERATURE_DEFAULT);	
+	}
+	if (FissionPoisoning) {
+		negative_reactivity += Xe_conc * 1e5 * sigma_Xe_a / (nu_bar * Sigma_f);
+		/*
+		if (nextIndex % 5000 == 0) {
+			std::cout << "Xenon: " << Xe_conc << " Xenon negative reactivity ";
+			std::cout << Xe_conc * 1e5 * sigma_Xe_a / (nu_bar * Sigma_f) << " pcm conv ";
+			std::cout <<	sigma_Xe_a / (nu_bar * Sigma_f) << " flux " << getCurrentFlux() << std::endl;
 		}
+		*/
+	}
 
-		/*This adds negative temperature and fission poisoning effects on
-		reactivity if enabled.*/
-		negative_reactivity = 0.;
-		if (temperature_effects) {
-			negative_reactivity += getReactivityCoefficient(new_temperature) * (new_temperature - ENVIRONMENT_TEMPERATURE_DEFAULT);	
+	// Substract total negative reactivity from insrted reactivity
+	reactivity_[nextIndex] = rodReactivity_[nextIndex] - (float)(negative_reactivity);
+	
+	history->sourceInserted.set(nextIndex, getNeutronSourceInserted());
+	history->safetyBladesInserted.set(nextIndex, getSafetyBladesInserted());
+
+	// Get neutron source activity
+	ns_activity_temp = getCurrentSourceActivity();
+	advanceSourceTime(DT_STEP);
+
+	// Integrate the point kinetics equations over the step
+	getCurrentStateVector(lastState, false); // get neutron populations
+	rho = (reactivity_[nextIndex]) * 1e-5; // set variable for reactivity
+	pkeSystem.rho = rho;
+	pkeSystem.externalSource = SourceInserted ? ns_activity_temp : 0.; // Neutron source neutrons per second
+	if (scheduler.getPeriod(Kinetics) == 1) {
+		pkeState.load(lastState);
+		integrateKinetics(pkeState, DT_STEP);
+		pkeState.store(finalState);
+	}
+	else {
+		// The state a kinetics period ahead is integrated when the kinetics are due, the samples in
+		// between approach it geometrically (neutrons) and linearly (precursors)
+		if (due & subsystemBit(Kinetics)) {
+			pkeState.load(lastState);
+			integrateKinetics(pkeState, scheduler.getPeriod(Kinetics) * DT_STEP);
+			pkeState.store(kineticsTarget);
+			kineticsTarget[0] = std::max(kineticsTarget[0], 10.);
+			kineticsRemaining = scheduler.getPeriod(Kinetics);
 		}
-		if (fissionPoisoning_effects) {
-			negative_reactivity += Xe_conc * 1e5 * sigma_Xe_a / (nu_bar * Sigma_f);
-			/*
-			if (nextIndex % 5000 == 0) {
-				std::cout << "Xenon: " << Xe_conc << " Xenon negative reactivity ";
-				std::cout << Xe_conc * 1e5 * sigma_Xe_a / (nu_bar * Sigma_f) << " pcm conv ";
-				std::cout <<	sigma_Xe_a / (nu_bar * Sigma_f) << " flux " << getCurrentFlux() << std::endl;
-			}
-			*/
+		const double fraction = kineticsRemaining ? 1. / kineticsRemaining-- : 0.;
+		finalState[0] = lastState[0] * std::pow(kineticsTarget[0] / lastState[0], fraction);
+		for (int i = 1; i < 7; i++)
+			finalState[i] = lastState[i] + (kineticsTarget[i] - lastState[i]) * fraction;
+	}
+
+	// Check for overshooting and make neutron sum
+	finalState[0] = std::max(finalState[0], 10.);
+	finalState[7] = 0.;
+	for (int f = 0; f < 7; f++)
+		finalState[7] += finalState[f];
+
+	if ((finalState[0] - lastState[0]) * (lastState[0] - state_vector_[0][shiftIndex(currentIndex, -1)]) < 0.) 
+		resetAverage = iterations_total;
+
+	// Calculate power, temperature and reactivity extremes during pulsing
+	if (Pulsing) {
+		if (finalState[0] > pulse_maxP) {
+			time_at_peak = time_[nextIndex];
+			pulse_maxP = finalState[0];
 		}
+		pulse_energy += newPower * DT_STEP;
+		pulse_maxT = std::max(pulse_maxT, fuelTemperature);
+	}
 
-		// Substract total negative reactivity from insrted reactivity
-		reactivity_[nextIndex] = rodReactivity_[nextIndex] - (float)(negative_reactivity);
-		
-		n_source[nextIndex] = getNeutronSourceInserted() ? "IN" : "OUT";
-		safety_blades[nextIndex] = getSafetyBladesInserted() ? "IN" : "OUT";
-
-		// Get neutron source activity
-		ns_activity_temp = getCurrentSourceActivity();
-		advanceSourceTime(DT_STEP);
-
-		// RK4 koeficients
-		// arraySum(result, firstArray, secondArray)
-		// multiplyArray(result, firstArray, scalar)
-		getCurrentStateVector(lastState, false); // get neutron populations
-		rho = (reactivity_[nextIndex]) * 1e-5; // set variable for reactivity
-		neutronChange(kf[0], lastState, rho); // f(t0) -- change of population at t0
-		std::memcpy(kf[1], kf[0], 7 * sizeof(double));
-		multiplyArray(kf[1], 0.5 * DT_STEP);
-		arraySum(kf[1], lastState, true);
-		neutronChange(kf[1], kf[1], rho); // f(t0 + h/2) -- change of population at t0 + 1/2*h
-		std::memcpy(kf[2], kf[1], 7 * sizeof(double));
-		multiplyArray(kf[2], 0.5 * DT_STEP);
-		arraySum(kf[2], lastState, true);
-		neutronChange(kf[2], kf[2], rho); // f(t0 + 3h/4) -- change of population at t0 + 3/4*h
-		std::memcpy(kf[3], kf[2], 7 * sizeof(double));
-		multiplyArray(kf[3], DT_STEP);
-		arraySum(kf[3], lastState, true);
-		neutronChange(kf[3], kf[3], rho); // f(t0 + h) -- change of population at t0 + h
-
-		// RK4 final sum
-		// stateVector += (dt/6)*( (k1+k4) + 2*(k2+k3) )
-		arraySum(kf[0], kf[3]);
-		arraySum(kf[1], kf[2]);
-		multiplyArray(kf[1], 2.);
-		arraySum(kf[0], kf[1]);
-		multiplyArray(kf[0], DT_STEP / 6.);
-		arraySum(kf[0], lastState, true); // No negative values
-
-		// Check for overshooting and make neutron sum
-		std::memcpy(finalState, kf[0], 7 * sizeof(double));
-		finalState[0] = std::max(finalState[0], 10.);
-		finalState[7] = 0.;
-		for (int f = 0; f < 7; f++)
-			finalState[7] += finalState[f];
-
-		if ((finalState[0] - lastState[0]) * (lastState[0] - state_vector_[0][shiftIndex(currentIndex, -1)]) < 0.) 
-			resetAverage = iterations_total;
-
-		// Calculate power, temperature and reactivity extremes during pulsing
-		if (pulsing) {
-			if (finalState[0] > pulse_maxP) {
-				time_at_peak = time_[nextIndex];
-				pulse_maxP = finalState[0];
-			}
-			pulse_energy += newPower * DT_STEP;
-			pulse_maxT = std::max(pulse_maxT, temperature_[nextIndex]);
+	// Push new neutron concentrations
+	pushNewState(finalState, nextIndex);
+
+	if (due & subsystemBit(WaterThermal)) waterHeatingCycle(scheduler.getPeriod(WaterThermal) * DT_STEP);
+}
+
+void Simulator::moveAutomaticRod(double power, std::uint32_t steps)
+{
+	double powerToKeep = keepCurrentPower ? powerHold : keepSteadyPowerAt;
+	if (std::abs(powerToKeep - power) / powerToKeep > steadyDeviation) {
+		float move = rodAutoMove * *regulatingRod()->getRodSteps() * steps;
+		float newPos = *regulatingRod()->getExactPosition();
+		if (powerToKeep < power) {
+			newPos -= move;
+			newPos = std::max(0.f, newPos);
 		}
+		else {
+			newPos += move;
+			newPos = std::min((float)*regulatingRod()->getRodSteps(), newPos);
+		}
+		if ((avoidPeriodScram && (reactorPeriod > periodLimit * 1.1 || reactorPeriod < 0.)) || !avoidPeriodScram || (powerToKeep < power)) {
+			regulatingRod()->commandMove(newPos);
+		}
+		else {
+			regulatingRod()->clearCommands();
+		}
+	}
+}
 
-		// Push new neutron concentrations
-		pushNewState(finalState, nextIndex);
+/*
+	The slow mode step follows step() with dt = slowStepLength, except for the neutrons: the
+	precursors decay over the step with the neutrons of the prompt jump approximation, taken as the
+	mean of the values before and after a first pass (predictor-corrector). The period comes from
+	the change of the neutrons over the step instead of the moving average
+*/
+void Simulator::slowStep()
+{
+	const double dt = slowStepLength;
+	const size_t currentIndex = getCurrentIndex();
+	const size_t nextIndex = getNextIndex();
+	const double power = getCurrentPower();
+
+	// One move per slow step, the rod target stays as close as in the full kinetics
+	if (regulatingRod()->getOperationMode() == ControlRod::OperationModes::Automatic) moveAutomaticRod(power, 1);
+
+	// If the rods can bring the reactivity to PROMPT_JUMP_LIMIT times beta within the step, the slow
+	// mode ends before it and this sample is a single DT_STEP of step(), with its trips
+	double reachable = rods.getReachableReactivity() + core_excess_reactivity - (rodReactivity_[currentIndex] - reactivity_[currentIndex]);
+	if (safety_blades_inserted) reachable -= safety_blades_worth;
+	if (reachable * 1e-5 >= PROMPT_JUMP_LIMIT * pkeSystem.beta) {
+		cout << "Reactivity of up to " << reachable << " pcm, leaving the slow mode" << endl;
+		setSlowMode(0.);
+		(this->*stepFunction)();
+		return;
+	}
 
-		waterHeatingCycle(DT_STEP);
+	time_[nextIndex] = time_[currentIndex] + dt;
+	for (size_t r = 0; r < rods.size(); ++r) {
+		rodPositions_[r][nextIndex] = (*rods[r]->getExactPosition())/10;
+	}
+	detectors.step(power, nextIndex, dt);
 
-		// Increase number of iterations
-		iterations_total++;
+	// The fuel heats up with a time constant of about 45 s, an explicit step stays stable
+	double newTemperature = fuelTemperature;
+	newTemperature += (power - getCoolingFromTemperature(newTemperature)) * dt / getFuelCp(newTemperature);
+	newTemperature = std::max(newTemperature, 22.);
+	fuelTemperature = static_cast<float>(newTemperature);
+	if (temperature_->due(nextIndex)) temperature_->set(nextIndex, fuelTemperature);
 
-		checkOperationalLimits();
+	rodReactivity_[nextIndex] = rods.step(dt) + core_excess_reactivity;
+	if (safety_blades_inserted) {
+		rodReactivity_[nextIndex] -= safety_blades_worth;
 	}
+
+	recalculatePoisonConcentrations(dt);
+	if (scheduler.isDue(PoisonStorage)) {
+		xenon_->set(nextIndex, (float)(Xe_conc / AVOGADRO_NUM * XENON_MOLAR_MASS));
+		iodine_->set(nextIndex, (float)(I_conc / AVOGADRO_NUM * IODINE_MOLAR_MASS));
+	}
+
+	double negative_reactivity = 0.;
+	if (temperature_effects) {
+		negative_reactivity += getReactivityCoefficient(newTemperature) * (newTemperature - ENVIRONMENT_TEMPERATURE_DEFAULT);
+	}
+	if (fissionPoisoning_effects) {
+		negative_reactivity += Xe_conc * 1e5 * sigma_Xe_a / (nu_bar * Sigma_f);
+	}
+	reactivity_[nextIndex] = rodReactivity_[nextIndex] - (float)(negative_reactivity);
+
+	history->sourceInserted.set(nextIndex, getNeutronSourceInserted());
+	history->safetyBladesInserted.set(nextIndex, getSafetyBladesInserted());
+
+	ns_activity_temp = getCurrentSourceActivity();
+	advanceSourceTime(dt);
+
+	double lastState[7], finalState[8];
+	getCurrentStateVector(lastState, false);
+	PkeState<PKE_DELAYED_GROUPS> pkeState;
+	pkeState.load(lastState);
+	pkeSystem.rho = reactivity_[nextIndex] * 1e-5;
+	pkeSystem.externalSource = source_inserted ? ns_activity_temp : 0.;
+	PkeState<PKE_DELAYED_GROUPS> predicted = pkeState;
+	const double before = pkeSystem.promptJumpNeutrons(pkeState);
+	pkeSystem.decayPrecursors(predicted, before, dt);
+	pkeSystem.decayPrecursors(pkeState, (before + pkeSystem.promptJumpNeutrons(predicted)) / 2., dt);
+	pkeState[0] = pkeSystem.promptJumpNeutrons(pkeState);
+	pkeState.store(finalState);
+
+	finalState[0] = std::max(finalState[0], 10.);
+	finalState[7] = 0.;
+	for (int f = 0; f < 7; f++)
+		finalState[7] += finalState[f];
+
+	// The moving average of step() needs DT_STEP samples, it starts over when the slow mode ends
+	periodEstimator.clear();
+	resetAverage = iterations_total;
+	reactorPeriod = (finalState[0] != lastState[0]) ? dt / std::log(finalState[0] / lastState[0]) : PERIOD_UNDEFINED;
+	if (std::abs(reactorPeriod) > PERIOD_UNDEFINED) reactorPeriod = PERIOD_UNDEFINED;
+	reactorPeriod_[nextIndex] = (float)reactorPeriod;
+	doublingTime_[nextIndex] = (float)(reactorPeriod * std::log(2));
+
+	pushNewState(finalState, nextIndex);
+
+	waterHeatingCycle(dt);
+
+	// The feedback alone can still carry the reactivity past the limit, the next step is a DT_STEP
+	if (pkeSystem.rho >= PROMPT_JUMP_LIMIT * pkeSystem.beta) {
+		cout << "Reactivity of " << reactivity_[nextIndex] << " pcm, leaving the slow mode" << endl;
+		setSlowMode(0.);
+	}
+}
+
+bool Simulator::setSlowMode(double step)
+{
+	if (step > SLOW_MODE_STEP_MAX || step < 0.) {
+		cerr << "The slow mode step has to be between 0 and " << SLOW_MODE_STEP_MAX << " s, got " << step << endl;
+		return false;
+	}
+	if (step > 0. && pulsing) {
+		cerr << "No slow mode during a pulse" << endl;
+		return false;
+	}
+	if (step == slowStepLength) return true;
+	// The samples of the other mode do not belong to the period average
+	resetAverage = iterations_total;
+	slowStepLength = step;
+	selectStepFunction();
+	return true;
+}
+
+bool Simulator::setSubsystemRate(Subsystem subsystem, std::uint32_t period, std::uint32_t phase)
+{
+	const bool kineticsRefused = subsystem == Kinetics && period > 1
+		&& (period > KINETICS_PERIOD_MAX || integrator->type() == IntegratorType::RK4 || pulsing);
+	if (subsystem == PoisonStorage || kineticsRefused || !scheduler.setRate(subsystem, period, phase)) {
+		cerr << "Invalid rate for " << subsystemName(subsystem) << ": period " << period << ", phase " << phase << endl;
+		return false;
+	}
+	scheduler.sync(getNextIndex());
+	return true;
+}
+
+void Simulator::resetSubsystemRates()
+{
+	const std::uint64_t clock = scheduler.getClock();
+	scheduler = SubsystemScheduler();
+	scheduler.setClock(clock);
+	scheduler.setRingAligned(subsystemBit(PoisonStorage));
+	scheduler.setRate(Poisons, POISON_UPDATE_PERIOD);
+	scheduler.setRate(PoisonStorage, POISON_DATA_DEL_DIVISION);
+}
+
+void Simulator::setPoisonEquilibrium(double power)
+{
+	// The flux of getCurrentFlux at this power
+	const double flux = power / powerFromNeutrons(1.) * t_neutron_speed / getReactorCoreVolume() * 1e-4;
+	I_conc = gamma_I * Sigma_f * flux / lambda_I;
+	Xe_conc = (gamma_I + gamma_X) * Sigma_f * flux / (lambda_X + sigma_Xe_a * flux);
+}
+
+// Walks the flags one by one and returns the matching instantiation of Simulator::step
+template <int Remaining, bool... Flags>
+struct StepSelector {
+	static Simulator::StepFunction select(const bool* flags) {
+		return flags[0] ? StepSelector<Remaining - 1, Flags..., true>::select(flags + 1)
+			: StepSelector<Remaining - 1, Flags..., false>::select(flags + 1);
+	}
+};
+
+template <bool... Flags>
+struct StepSelector<0, Flags...> {
+	static Simulator::StepFunction select(const bool*) { return &Simulator::step<Flags...>; }
+};
+
+void Simulator::selectStepFunction()
+{
+	if (slowStepLength > 0.) {
+		stepFunction = &Simulator::slowStep;
+		return;
+	}
+	const bool flags[] = {
+		temperature_effects,
+		fissionPoisoning_effects,
+		source_inserted,
+		pulsing,
+		regulatingRod()->getOperationMode() == ControlRod::OperationModes::Automatic
+	};
+	stepFunction = StepSelector<5>::select(flags);
 }
 
 void Simulator::recalculateLambdaBetaEffective()
@@ -1215,6 +1627,7 @@ void Simulator::recalculateLambdaBetaEffective()
 		groupStability[i] = beta_neutrons[i] / (delayed_decay_time[i] * prompt_lifetime);
 		if (!delayed_enabled[i]) leftOver += groupStability[i];
 	}
+	updatePkeSystem();
 }
 
 //const double periodK = 0.95;
@@ -1222,6 +1635,7 @@ void Simulator::solvePerFrame() {
 	const size_t currentIdx = getCurrentIndex();
 	//if ()
 	doScriptCommands();
+	reapExports(false);
 	/* 
 	// calculate the reactor period from its definition - DT_STEP is the simulation step
 	double prevPower = powerFromNeutrons(state_vector_[0][shiftIndex(getCurrentIndex(), -1)]);
@@ -1263,64 +1677,40 @@ void Simulator::solvePerFrame() {
 	else {
 		reactorAsymPeriod = -6000.;
 	}
-
-	// Self explanatory
-	addPowerExtremes();
-
-	// Delete old data
-	if (this->delete_old_data_time > 0)
-	{
-		size_t deleteIndex = (dataPoints > iterations_total) ? (size_t)0 : (iterations_total - dataPoints);
-		if (deleteIndex > 0) {
-			// Delete power_extremes order changes that are old
-			if (powerExtremes->size()) {
-				while (powerExtremes->front().when < time_[getOldestIndex()]) {
-					trailingExtreme = powerExtremes->front();
-					powerExtremes->pop_front();
-					if (powerExtremes->size() == 0) break;
-				}
-			}
-		}
-	}
 }
 
-// Physically, this is the derivative of all neutron concentration groups
-// or the right side of the point kinetics equations
-void Simulator::neutronChange(double* new_state, double* prevState, double rho)
+// Physically, the point kinetics equations are dN/dt = (rho - beta)/l * N + sum(lambda_i * C_i) + S
+// and dC_i/dt = beta_i/l * N - lambda_i * C_i
+void Simulator::updatePkeSystem()
 {
-	fissionRate = prevState[0] / prompt_lifetime; // this is N(t)/l in PKE 
-	temp_state[0] = (rho - beta_/**1.15*/) * fissionRate; // New fission neutrons per second
-	temp_state[0] += spontaneous_fission_source;  // added neutrons generated by spontaneous fission of U235 + U238
-	if (source_inserted)
-		temp_state[0] += ns_activity_temp; // Neutron source neutrons per second
-
-	for (int i = 0; i < 6; i++)
-	{
-		delayed = delayed_decay_time[i] * prevState[i + 1]; // Delayed neutrons per second
-		if (delayed_enabled[i]) 
-			temp_state[0] += delayed;
-		temp_state[i + 1] = (beta_neutrons[i] * fissionRate) - delayed;
+	pkeSystem.beta = beta_;
+	pkeSystem.promptLifetime = prompt_lifetime;
+	pkeSystem.spontaneousSource = spontaneous_fission_source; // spontaneous fission of U235 + U238
+	for (int i = 0; i < PKE_DELAYED_GROUPS; i++) {
+		pkeSystem.betaGroup[i + 1] = beta_neutrons[i];
+		pkeSystem.lambda[i + 1] = delayed_decay_time[i];
+		pkeSystem.lambdaCoupled[i + 1] = delayed_enabled[i] ? delayed_decay_time[i] : 0.;
 	}
-
-	for (int i = 0; i < 7; i++) 
-		new_state[i] = temp_state[i];
 }
 
-void Simulator::multiplyArray(double* in_array, double scalar)
+void Simulator::setIntegrator(IntegratorType type)
 {
-	for (int i = 0; i < 7; i++)
-	{
-		in_array[i] *= scalar;
+	if (type == IntegratorType::RK4 && scheduler.getPeriod(Kinetics) > 1) {
+		cout << "RK4 needs the kinetics at every step" << endl;
+		scheduler.setRate(Kinetics, 1);
+		scheduler.sync(getNextIndex());
 	}
+	if (integrator && integrator->type() == type) return;
+	delete integrator;
+	integrator = createIntegrator<PKE_DELAYED_GROUPS>(type);
+	cout << "Point kinetics integrator: " << integratorName(type) << endl;
 }
 
-void Simulator::arraySum(double* sum_array1, double* sum_array2, bool posOnly)
+void Simulator::integrateKinetics(PkeState<PKE_DELAYED_GROUPS>& state, double dt)
 {
-	for (int i = 0; i < 7; i++)
-	{
-		sum_array1[i] += sum_array2[i];
-		if (posOnly) sum_array1[i] = std::max(0., sum_array1[i]);
-	}
+	if (integrator->step(pkeSystem, state, dt)) return;
+	if (incompleteKineticsSteps++ == 0)
+		cerr << "The " << integratorName(integrator->type()) << " integrator did not finish the step at " << getCurrentTime() << " s" << endl;
 }
 
 // This is a very slow process, an Euler scheme is used for time 
@@ -1362,6 +1752,8 @@ double Simulator::getReactivityCoefficient(double temp)
 
 void Simulator::pushStableState(double power)
 {
+	historyHead.store(iterations_total + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
 	size_t newIndex = getNextIndex();
 	size_t currentIndex = getCurrentIndex();
 
@@ -1385,23 +1777,25 @@ void Simulator::pushStableState(double power)
 		reactivityToInsert += safety_blades_worth;
 	}
 	if (temperature_effects) reactivityToInsert += getReactivityCoefficient(stableFuelTemp)*(stableFuelTemp - (float)ENVIRONMENT_TEMPERATURE_DEFAULT);
-	float rodPos[NUMBER_OF_CONTROL_RODS] = { safetyRod()->getPosFromPcm(reactivityToInsert) , 0.f, 0.f };
-	reactivityToInsert -= safetyRod()->getPCMat(rodPos[0]);
-	if (reactivityToInsert > 0.f) {
-		rodPos[2] = shimRod()->getPosFromPcm(reactivityToInsert);
-		reactivityToInsert -= shimRod()->getPCMat(rodPos[2]);
-		if (reactivityToInsert > 0.f) {
-			rodPos[1] = regulatingRod()->getPosFromPcm(reactivityToInsert);
-			reactivityToInsert -= regulatingRod()->getPCMat(rodPos[1]);
-		}
+	// The safety rod is withdrawn first, then the water level rises, the other absorbers come last
+	std::vector<size_t> order = { 0 };
+	for (size_t i = 1; i < rods.size(); i++)
+		if (rods[i]->getKind() == Settings::RodKind::WaterLevel) order.push_back(i);
+	for (size_t i = 1; i < rods.size(); i++)
+		if (rods[i]->getKind() != Settings::RodKind::WaterLevel) order.push_back(i);
+	std::vector<float> rodPos(rods.size(), 0.f);
+	for (size_t i : order) {
+		if (i != 0 && reactivityToInsert <= 0.f) break;
+		rodPos[i] = rods[i]->getPosFromPcm(reactivityToInsert);
+		reactivityToInsert -= rods[i]->getPCMat(rodPos[i]);
 	}
 	cout << "Set stable mode at " << power << "W" << endl << "Reactivity overkill: " << reactivityToInsert << "pcm" << endl;
 
-	for (int i = 0; i < NUMBER_OF_CONTROL_RODS; i++) {
+	for (size_t i = 0; i < rods.size(); i++) {
 		rods[i]->moveRodToStep(rodPos[i], true);
 		rods[i]->setEnabled(true, true);
 		rods[i]->clearCommands();
-		rods[i]->refreshRod(i, dt);
+		rods[i]->refreshRod(dt);
 	}
 	
 	time_[newIndex] = time_[currentIndex] + DT_STEP;
@@ -1410,7 +1804,8 @@ void Simulator::pushStableState(double power)
 		rodReactivity_[newIndex] -= safety_blades_worth;
 	}
 	reactivity_[newIndex] = 0.f;
-	temperature_[newIndex] = stableFuelTemp;
+	fuelTemperature = stableFuelTemp;
+	if (temperature_->due(newIndex)) temperature_->set(newIndex, fuelTemperature);
 	
 
 	// Calculating neutron populations
@@ -1425,7 +1820,8 @@ void Simulator::pushStableState(double power)
 	pushNewState(neuts, newIndex);
 
 	resetAverage = iterations_total;
-	iterations_total++;
+	advanceIteration();
+	updatePyramids();
 }
 
 void Simulator::setProperties(Settings * nodes)
@@ -1433,18 +1829,12 @@ void Simulator::setProperties(Settings * nodes)
 	source_inserted = nodes->neutronSourceInserted;
 	safety_blades_inserted = nodes->SafetyBladesInserted;
 
-	safetyRod()->setRodName(SAFETY_ROD_NAME_DEFAULT);
-	regulatingRod()->setRodName(REGULATORY_ROD_NAME_DEFAULT);
-	shimRod()->setRodName(SHIM_ROD_NAME_DEFAULT);
-	for (size_t rodIndex = 0; rodIndex < NUMBER_OF_CONTROL_RODS; rodIndex++) {
-		rods[rodIndex]->setRodSteps(nodes->rodSettings[rodIndex].rodSteps, rodIndex, false);
-		rods[rodIndex]->setRodSpeed(nodes->rodSettings[rodIndex].rodSpeed);
-		rods[rodIndex]->setRodWorth(nodes->rodSettings[rodIndex].rodWorth);
-		for (size_t i = 0; i < 2; i++) {
-			rods[rodIndex]->setParameter(i, nodes->rodSettings[rodIndex].rodCurve[i], rodIndex, false);
-		}
-		rods[rodIndex]->recalculateStepData(rodIndex);
-	}
+	std::ostringstream archive;
+	nodes->saveArchive(archive);
+	settingsJson = archive.str();
+
+	rods.configure(nodes->rodBank());
+	attachColumns();
 	rods[1]->squareWave()->setPeriod(nodes->squareWave.period);
 	rods[1]->squareWave()->setAmplitude(nodes->squareWave.amplitude);
 	for(int sqw = 0; sqw < 4; sqw++) rods[1]->squareWave()->xIndex[sqw] = nodes->squareWave.xIndex[sqw];
@@ -1475,6 +1865,7 @@ void Simulator::setProperties(Settings * nodes)
 	det1_convFactor = nodes->det1_convFactor;
 	det2_convFactor = nodes->det2_convFactor;
 	dwellTime = nodes->dwellTime;
+	syncSystemDetectors();
 
 	core_excess_reactivity = nodes->excessReactivity;
 	safety_blades_worth = nodes->SafetyBladesworth;
@@ -1490,6 +1881,7 @@ void Simulator::setProperties(Settings * nodes)
 		delayed_enabled[i] = nodes->groupsEnabled[i];
 	}
 	beta_ = sumBeta;
+	updatePkeSystem();
 	waterVolume = nodes->waterVolume;
 
 	w_cooling = nodes->waterCooling;
@@ -1523,6 +1915,7 @@ void Simulator::setProperties(Settings * nodes)
 	alphaK = nodes->alphaK;
 
 	autoScramAfterPulse = nodes->automaticPulseScram;
+	selectStepFunction();
 }
 
 void Simulator::resetSimulator()
@@ -1533,6 +1926,9 @@ void Simulator::resetSimulator()
 void Simulator::beginPulse()
 {
 	if (getScramStatus()) return; // Only fire if reactor isn't scrammed
+	// The pulse needs the full kinetics
+	setSlowMode(0.);
+	setSubsystemRate(Kinetics, 1);
 	// Fire regulating rod
 	regulatingRod()->fire(true);
 	// Reset pulse variables
@@ -1543,188 +1939,373 @@ void Simulator::beginPulse()
 	pulsing = true;
 	pulse_start = getCurrentIndex();
 	pulse_startP = getCurrentPower();
+	selectStepFunction();
 	//tempMode = TemperatureMode::FH;
 }
 void Simulator::doScriptCommands()
 {
 	if (!scriptCommands.empty()) {
-		std::pair<double, double> coefficients;
 		scriptTimer += DT_STEP;
-		for (auto i = scriptCommands.begin(); i != scriptCommands.end(); ) {
-			if (i->timed <= getCurrentTime()) {
-				switch (i->command) {
-					size_t dest;
-					size_t position;
-					//auto coefficients = getHeatCpConstants();
-					cout << "Running action number" << i->command << " name " << i->strCommand << endl;
-				case setRegulatingRod:
-					cout << "Pushing regulating rod to position" << i->value << endl;
-					if (sscanf(i->value.c_str(), "%zu", &dest))
-						regulatingRod()->commandMove(dest);
-					break;
-				case setRegulatingSteps:
-					cout << i->strCommand << " " << i->value << endl;
-					if (sscanf(i->value.c_str(), "%zu", &dest))
-						regulatingRod()->moveRodToStep(dest);
-					break;
-				case moveRegulatingRod:
-					position = regulatingRod()->getPosition();
-					if (sscanf(i->value.c_str(), "%zu", &dest)) {
-						position += dest;
-						cout << "Pushing regulating rod to position " << position << endl;
-						regulatingRod()->commandMove(position);
-					}
-					break;
-				case setShimRod:
-					cout << "Pushing shim rod to position " << i->value << endl;
-					if (sscanf(i->value.c_str(), "%zu", &dest))
-						shimRod()->commandMove(dest);
-					break;
-				case setSafetyRod:
-					cout << "Pushing safety rod to position " << i->value << endl;
-					if (sscanf(i->value.c_str(), "%zu", &dest))
-						safetyRod()->commandMove(dest);
-					break;
-				case commands::setAlpha0:
-					cout << i->strCommand << " " << i->value << endl;
-					setAlpha0(stod(i->value));
-					break;
-				case commands::setAlphaAtT1:
-					cout << i->strCommand << " " << i->value << endl;
-					setAlphaPeak(stod(i->value));
-					break;
-				case commands::setAlphaT1:
-					cout << i->strCommand << " " << i->value << endl;
-					setAlphaTempPeak(stod(i->value));
-					break;
-				case commands::setAlphaK:
-					cout << i->strCommand << " " << i->value << endl;
-					setAlphaSlope(stod(i->value));
-					break;
-				case setStablePower:
-					cout << "Pushing stable state ..." << i->value << endl;
-					pushStableState(stod(i->value));
-					regulatingRod()->setOperationMode(ControlRod::OperationModes::Manual);
-					scram(ScramSignals::None);
-					simulatorTime += DT_STEP;
-					last_sample_number = 1;
-					break;
-				case setSimulationSpeed:
-					cout << "Setting simulation speed to: " << i->value << endl;
-					setSpeedFactor(std::stod(i->value));
-					break;
-				case setSimulationMode:
-					cout << "Setting simulation mode to: " << i->value << endl;
-					if (i->value == "Manual")
-						regulatingRod()->setOperationMode(ControlRod::OperationModes::Manual);
-					if (i->value == "Automatic")
-						regulatingRod()->setOperationMode(ControlRod::OperationModes::Automatic);
-					if (i->value == "Pulse")
-						regulatingRod()->setOperationMode(ControlRod::OperationModes::Pulse);
-					if (i->value == "Simulation")
-						regulatingRod()->setOperationMode(ControlRod::OperationModes::Simulation);
-					break;
-				case holdPower:
-					cout << "Holding power at: " << i->value << endl;
-					regulatingRod()->setOperationMode(ControlRod::OperationModes::Automatic);
-					setPowerHold(stod(i->value));
-					break;
-				case saveToFile:
-					std::cout << "Saving data to file: " << i->value << endl;
-					dataToFile(i->value);
-					break;
-				case exitSimulator:
-					std::cout << "Exiting simulator" << endl;
-					std::exit(0);
-					break;
-				case firePulse:
-					std::cout << "Fireing pulse rod" << endl;
-					beginPulse();
-					break;
-				case setDataLogDivider:
-					cout << i->strCommand << " " << i->value << endl;
-					data_division = stod(i->value);
-					break;
-				case setCvCoeffPropA:
-					coefficients = getHeatCpConstants();
-					coefficients.first = stod(i->value);
-					setHeatCpConstants(coefficients);
-					break;
-				case setCvCoeffPropB:
-					coefficients = getHeatCpConstants();
-					coefficients.second = stod(i->value);
-					setHeatCpConstants(coefficients);
-					break;
-				}
-				i = scriptCommands.erase(i);
-			}
-			else {
-				++i;
-			}
-		}
+		// Removed first, so a checkpoint saved by the command does not hold it
+		while (scriptDue()) executeCommand(scriptCommands.pop());
 	}
+	loadPendingCheckpoint();
 }
-/*
-Processes pulse data and saves the results to a buffer called "powerExtremes
-*/
-void Simulator::addPowerExtremes()  // adapted to CPS instead of power for CROCUS
-{
-	try {
-		size_t cur_index = getCurrentIndex();
-		if (last_sample_number != 0) {
-			size_t dataStart = iterations_total - last_sample_number;
-			// Check if this is the first calculation
-			if (dataStart == 1) {
-				powerExtremes->push_back(PowerExtreme((int)std::floor(std::log10(getCurrentCPS(getDet1Factor()))), time_[getOldestIndex()])); //getcurrentflux instead of power
-				dataStart++;
-			}
-
-			// Iterate through the new data, searching for order changes
-			double NoisyCounts_i;   
-			for (int i = (int)last_sample_number - 1; i >= 0; i--) {
-				NoisyCounts_i = round(getdwellTime() * getDet1Factor() * powerFromNeutrons(state_vector_[0][shiftIndex(getCurrentIndex(), -i)]));  //including the conversion factor to get CPS
-				if (NoisyCounts_i == 0.) {
-					bool setZero = false;
-					if (powerExtremes->size()) {
-						setZero = !powerExtremes->back().isZero;
-					}
-					else {
-						setZero = !trailingExtreme.isZero;
-					}
-					if (setZero) {
-						PowerExtreme zero = PowerExtreme();
-						zero.when = time_[shiftIndex(cur_index, -i)];
-						powerExtremes->push_back(zero);
-					}
-				}
-				else if (NoisyCounts_i <= 1.)
-				{
-					int order = 0;
-					int lastOrder = powerExtremes->size() ? powerExtremes->back().order : trailingExtreme.order;
-					bool lastWasZero = powerExtremes->size() ? powerExtremes->back().isZero : trailingExtreme.isZero;
-			
-					// Push if different order
-					if (order != lastOrder  || lastWasZero) {
-						powerExtremes->push_back(PowerExtreme(order, time_[shiftIndex(getCurrentIndex(), -i)]));
-					}					
-
-				}
-				
-				else {
-					int order = (int)floor(log10(NoisyCounts_i * 2.2));
-					int lastOrder = powerExtremes->size() ? powerExtremes->back().order : trailingExtreme.order;
 
-					// If the order changed, save the index and new order
-					if (order != lastOrder) {
-						powerExtremes->push_back(PowerExtreme(order, time_[shiftIndex(getCurrentIndex(), -i)]));
-					}
-				}
+void Simulator::loadPendingCheckpoint()
+{
+	if (pendingCheckpoint.empty()) return;
+	// The rest of this script replaces the commands saved in the checkpoint, from the restored time on
+	ScriptQueue script = scriptCommands;
+	const double timeBefore = getCurrentTime();
+	if (loadCheckpoint(pendingCheckpoint)) {
+		script.shift(getCurrentTime() - timeBefore);
+		scriptCommands = script;
+	}
+	pendingCheckpoint.clear();
+}
 
+void Simulator::executeCommand(const Command& c)
+{
+	size_t position;
+	std::pair<double, double> coefficients;
+	if (recording) {
+		*recording << recordedIterations << '\t' << c.strCommand << '\t' << quoteValue(c.value);
+		if (c.rod >= 0) *recording << '\t' << c.rod;
+		*recording << endl;
+	}
+	// Operator commands target a single control rod
+	ControlRod* rod = (c.rod >= 0 && (size_t)c.rod < rods.size()) ? rods[c.rod] : nullptr;
+	if (c.command >= moveRod && c.command <= setRodCurve && !rod) {
+		cerr << "Command " << c.strCommand << " needs a valid control rod index, got " << c.rod << endl;
+		return;
+	}
+	// The value was parsed when the command was read
+	if (numericCommand(c.command) && !c.numeric) {
+		cerr << "Command " << c.strCommand << " needs a number, got " << c.value << endl;
+		return;
+	}
+	const double value = c.number;
+	const size_t dest = (size_t)std::max(value, 0.);
+	switch (c.command) {
+	case setRegulatingRod:
+		cout << "Pushing regulating rod to position" << c.value << endl;
+		regulatingRod()->commandMove(dest);
+		break;
+	case setRegulatingSteps:
+		cout << c.strCommand << " " << c.value << endl;
+		regulatingRod()->moveRodToStep(dest);
+		break;
+	case moveRegulatingRod:
+		// The value is a relative move, negative values move the rod down
+		position = (size_t)std::max(regulatingRod()->getPosition() + std::trunc(value), 0.);
+		cout << "Pushing regulating rod to position " << position << endl;
+		regulatingRod()->commandMove(position);
+		break;
+	case setShimRod:
+		cout << "Pushing shim rod to position " << c.value << endl;
+		shimRod()->commandMove(dest);
+		break;
+	case setSafetyRod:
+		cout << "Pushing safety rod to position " << c.value << endl;
+		safetyRod()->commandMove(dest);
+		break;
+	case commands::setAlpha0:
+		cout << c.strCommand << " " << c.value << endl;
+		setAlpha0(value);
+		break;
+	case commands::setAlphaAtT1:
+		cout << c.strCommand << " " << c.value << endl;
+		setAlphaPeak(value);
+		break;
+	case commands::setAlphaT1:
+		cout << c.strCommand << " " << c.value << endl;
+		setAlphaTempPeak(value);
+		break;
+	case commands::setAlphaK:
+		cout << c.strCommand << " " << c.value << endl;
+		setAlphaSlope(value);
+		break;
+	case setStablePower:
+		cout << "Pushing stable state ..." << c.value << endl;
+		pushStableState(value);
+		regulatingRod()->setOperationMode(ControlRod::OperationModes::Manual);
+		scram(ScramSignals::None);
+		simulatorTime += DT_STEP;
+		last_sample_number = 1;
+		break;
+	case setSimulationSpeed:
+		cout << "Setting simulation speed to: " << c.value << endl;
+		setSpeedFactor(value);
+		break;
+	case setSimulationMode:
+		cout << "Setting simulation mode to: " << c.value << endl;
+		if (c.value == "Manual")
+			regulatingRod()->setOperationMode(ControlRod::OperationModes::Manual);
+		if (c.value == "Automatic")
+			regulatingRod()->setOperationMode(ControlRod::OperationModes::Automatic);
+		if (c.value == "Pulse")
+			regulatingRod()->setOperationMode(ControlRod::OperationModes::Pulse);
+		if (c.value == "Simulation")
+			regulatingRod()->setOperationMode(ControlRod::OperationModes::Simulation);
+		break;
+	case holdPower:
+		cout << "Holding power at: " << c.value << endl;
+		regulatingRod()->setOperationMode(ControlRod::OperationModes::Automatic);
+		setPowerHold(value);
+		break;
+	case saveToFile:
+		std::cout << "Saving data to file: " << c.value << endl;
+		startExport(ExportFormat::Text, c.value);
+		break;
+	case saveToBinaryFile:
+		std::cout << "Saving binary data to file: " << c.value << endl;
+		startExport(ExportFormat::Binary, c.value);
+		break;
+	case startJournal:
+		std::cout << "Journaling the history to: " << c.value << endl;
+		setJournal(c.value);
+		break;
+	case saveJournalToBinaryFile:
+		std::cout << "Saving the journal to file: " << c.value << endl;
+		journalToBinaryFile(c.value, std::numeric_limits<double>::lowest(), std::numeric_limits<double>::max());
+		break;
+	case commands::saveCheckpoint:
+		std::cout << "Saving a checkpoint to: " << c.value << endl;
+		saveCheckpoint(c.value);
+		break;
+	case commands::loadCheckpoint:
+		std::cout << "Loading the checkpoint: " << c.value << endl;
+		pendingCheckpoint = c.value;
+		break;
+	case exitSimulator:
+		std::cout << "Exiting simulator" << endl;
+		exitRequested = true;
+		break;
+	case firePulse:
+		std::cout << "Fireing pulse rod" << endl;
+		beginPulse();
+		break;
+	case setDataLogDivider:
+		cout << c.strCommand << " " << c.value << endl;
+		data_division = value;
+		break;
+	case setCvCoeffPropA:
+		coefficients = getHeatCpConstants();
+		coefficients.first = value;
+		setHeatCpConstants(coefficients);
+		break;
+	case setCvCoeffPropB:
+		coefficients = getHeatCpConstants();
+		coefficients.second = value;
+		setHeatCpConstants(coefficients);
+		break;
+	case commands::setExcessReactivity:
+		cout << c.strCommand << " " << c.value << endl;
+		setExcessReactivity(value);
+		break;
+	case setSafetyBladesWorth:
+		cout << c.strCommand << " " << c.value << endl;
+		setSafetyBladesworth(value);
+		break;
+	case commands::setPromptNeutronLifetime:
+		cout << c.strCommand << " " << c.value << endl;
+		setPromptNeutronLifetime(value);
+		break;
+	case setCoreVolume:
+		cout << c.strCommand << " " << c.value << endl;
+		setReactorCoreVolume(value);
+		break;
+	case setSourceActivity:
+		cout << c.strCommand << " " << c.value << endl;
+		setNeutronSourceActivity(value);
+		break;
+	case commands::setPowerLimit:
+		cout << c.strCommand << " " << c.value << endl;
+		setPowerLimit(value);
+		break;
+	case commands::setPeriodLimit:
+		cout << c.strCommand << " " << c.value << endl;
+		setPeriodLimit(value);
+		break;
+	case commands::setWaterLevelLimit:
+		cout << c.strCommand << " " << c.value << endl;
+		setWaterLevelLimit(value);
+		break;
+	case setDetector1Factor:
+		cout << c.strCommand << " " << c.value << endl;
+		setDet1Factor(value);
+		break;
+	case setDetector2Factor:
+		cout << c.strCommand << " " << c.value << endl;
+		setDet2Factor(value);
+		break;
+	case setDwellTime:
+		cout << c.strCommand << " " << c.value << endl;
+		setdwellTime(value);
+		break;
+	case setGodMode:
+		godMode = (value != 0.);
+		cout << "God mode: " << godMode << endl;
+		break;
+	case commands::setDelayedGroupFraction:
+	case commands::setDelayedGroupDecay:
+	case commands::setDelayedGroupEnabled:
+	{
+		const std::vector<std::string> values = splitFields(c.value);
+		try {
+			if (values.size() != 2) throw std::invalid_argument(c.value);
+			const unsigned long group = std::stoul(values[0]);
+			const double groupValue = std::stod(values[1]);
+			if (group >= PKE_DELAYED_GROUPS) throw std::out_of_range(c.value);
+			cout << c.strCommand << " " << c.value << endl;
+			if (c.command == commands::setDelayedGroupFraction) setDelayedGroupFraction(group, groupValue);
+			else if (c.command == commands::setDelayedGroupDecay) setDelayedGroupDecay(group, groupValue);
+			else setDelayedGroupEnabled(group, groupValue != 0.);
+		}
+		catch (const std::exception&) {
+			cerr << "Invalid value " << c.value << " for " << c.strCommand << ", use <group 0 to " << PKE_DELAYED_GROUPS - 1 << ">:<value>" << endl;
+		}
+		break;
+	}
+	case commands::setScramEnabled:
+	{
+		const std::vector<std::string> values = splitFields(c.value);
+		try {
+			if (values.size() != 2) throw std::invalid_argument(c.value);
+			const int signal = std::stoi(values[0]);
+			const bool enabled = std::stod(values[1]) != 0.;
+			cout << c.strCommand << " " << c.value << endl;
+			setScramEnabled((ScramSignals)signal, enabled);
+		}
+		catch (const std::exception&) {
+			cerr << "Invalid SCRAM " << c.value << ", use <signal bit>:<1|0>" << endl;
+		}
+		break;
+	}
+	case moveRod:
+		rod->commandMove((float)value);
+		break;
+	case setRodPosition:
+		rod->moveRodToStep((float)value, true);
+		break;
+	case setRodSpeed:
+		rod->setRodSpeed((float)value);
+		break;
+	case setRodWorth:
+		rod->setRodWorth((float)value);
+		break;
+	case setRodEnabled:
+		rod->setEnabled(c.value != "0");
+		break;
+	case toggleRodEnabled:
+		rod->setEnabled(!*rod->isEnabled());
+		break;
+	case rodToTop:
+		rod->commandToTop();
+		break;
+	case rodToBottom:
+		rod->commandToBottom();
+		break;
+	case clearRodCommands:
+		// The value limits clearing to a single ControlRod::CommandType (0 clears everything)
+		rod->clearCommands((ControlRod::CommandType)dest);
+		break;
+	case setRodCurve:
+		if (c.value == "fit") {
+			rod->setMeasuredCurve(RodWorthCurve::Points());
+		}
+		else {
+			RodWorthCurve::Points points;
+			if (RodWorthCurve::loadPoints(c.value, points)) {
+				std::cout << "Using the worth curve " << c.value << " for " << rod->getRodName() << endl;
+				rod->setMeasuredCurve(points);
 			}
 		}
+		break;
+	case setNeutronSource:
+		setNeutronSourceInserted(c.value != "0");
+		break;
+	case setSafetyBlades:
+		setSafetyBladesInserted(c.value != "0");
+		break;
+	case scramReactor:
+		// The value is a mask of ScramSignals, 0 resets the SCRAM
+		scram((ScramSignals)dest);
+		break;
+	case commands::setIntegrator:
+	{
+		IntegratorType type;
+		if (integratorFromName(c.value, type))
+			setIntegrator(type);
+		else
+			cerr << "Unknown integrator " << c.value << ", use RK4, SDIRK2 or RK45" << endl;
+		break;
+	}
+	case commands::addDetector:
+	{
+		const std::vector<std::string> values = splitFields(c.value);
+		try {
+			if (values.size() < 2 || values.size() > 4) throw std::invalid_argument(c.value);
+			DetectorChannel channel(values[0], std::stod(values[1]));
+			if (values.size() > 2) channel.deadTime = std::stod(values[2]);
+			if (values.size() > 3) channel.dwellTime = std::stod(values[3]);
+			std::cout << "Adding detector " << channel.name << " as channel " << addDetector(channel) << endl;
+		}
+		catch (const std::exception&) {
+			cerr << "Invalid detector " << c.value << ", use <name>:<CPS/W>[:<dead time>[:<dwell time>]]" << endl;
+		}
+		break;
+	}
+	case commands::setSlowMode:
+		if (setSlowMode(value)) {
+			if (value > 0.) std::cout << "Slow mode with steps of " << value << " s" << endl;
+			else std::cout << "Full kinetics at " << DT_STEP << " s steps" << endl;
+		}
+		break;
+	case commands::setPoisonEquilibrium:
+		setPoisonEquilibrium(value);
+		std::cout << "Iodine and xenon at their equilibrium for " << value << " W" << endl;
+		break;
+	case commands::addTrip:
+	{
+		const std::vector<std::string> values = splitFields(c.value);
+		TripDefinition trip;
+		try {
+			if (values.size() < 4 || values.size() > 6 || !tripSignalFromName(values[1], trip.signal)
+				|| !tripComparatorFromName(values[2], trip.comparator)) throw std::invalid_argument(c.value);
+			trip.name = values[0];
+			trip.setpoint = std::stod(values[3]);
+			if (values.size() > 4) trip.delay = std::stod(values[4]);
+			if (values.size() > 5) trip.coincidence = (std::uint32_t)std::max(1, std::stoi(values[5]));
+			addTrip(trip);
+			std::cout << "Adding trip " << trip.name << " on " << values[1] << endl;
+		}
+		catch (const std::exception&) {
+			cerr << "Invalid trip " << c.value << ", use <name>:<signal>:<above|below|positiveBelow>:<setpoint>[:<delay in s>[:<coincidence>]]" << endl;
+		}
+		break;
+	}
+	case commands::setSubsystemRate:
+	{
+		const std::vector<std::string> values = splitFields(c.value);
+		Subsystem subsystem;
+		try {
+			if (values.size() < 2 || values.size() > 3 || !subsystemFromName(values[0], subsystem)) throw std::invalid_argument(c.value);
+			const unsigned long period = std::stoul(values[1]);
+			const unsigned long phase = (values.size() > 2) ? std::stoul(values[2]) : 0;
+			if (period > std::numeric_limits<std::uint32_t>::max()) throw std::out_of_range(c.value);
+			if (setSubsystemRate(subsystem, (std::uint32_t)period, (std::uint32_t)phase))
+				std::cout << "Running " << values[0] << " every " << period << " steps" << endl;
+		}
+		catch (const std::exception&) {
+			cerr << "Invalid subsystem rate " << c.value << ", use <subsystem>:<period in steps>[:<phase>]" << endl;
+		}
+		break;
 	}
-	catch (exception e) {
-		cerr << "Simulator.recalculatePowerExtremes() error" << endl;
+	default:
+		cerr << "Unknown command: " << c.strCommand << endl;
+		break;
 	}
 }
 
@@ -1734,24 +2315,19 @@ void Simulator::checkPulsingStatus() {
 		const size_t currentIdx = getCurrentIndex();
 		if (time_[currentIdx] - time_[pulse_start] >= 5.) { // check if pulse is finished
 			pulsing = false;
+			selectStepFunction();
 			if(autoScramAfterPulse) scram(User); // automatic SCRAM after 5 seconds
 
 			double currentPower = state_vector_[0][currentIdx];
-			// Calculate FWHM
-			int range[2] = { -1, -1 };
-			for (int i = 0; i < 5000; i++) {
-				if (range[0] < 0) {
-					if (state_vector_[0][shiftIndex(currentIdx, i - 4999)] > (pulse_maxP + currentPower) / 2.) 
-						range[0] = i - 1;
-				}
-				else {
-					if (state_vector_[0][shiftIndex(currentIdx, i - 4999)] < (pulse_maxP + currentPower) / 2.) {
-						range[1] = i - 1;
-						break;
-					}
-				}
-			}
-			pulse_FWHM = static_cast<double>(range[1] - range[0]) * DT_STEP;
+			// Calculate FWHM, from the first sample of the last 5 s above half the peak to the first one below it after that
+			ColumnPyramid<double>* neutrons = getPyramid(state_vector_[0]);
+			neutrons->update(iterations_total);
+			const size_t window = 5000;
+			const size_t windowStart = shiftIndex(currentIdx, 1 - (long)window);
+			const double halfMax = (pulse_maxP + currentPower) / 2.;
+			const size_t rise = neutrons->find(windowStart, window, halfMax, true);
+			const size_t fall = (rise < window) ? rise + neutrons->find(windowStart + rise, window - rise, halfMax, false) : window;
+			pulse_FWHM = static_cast<double>(fall - rise) * DT_STEP;
 			// Calculate final power
 			pulse_maxP = powerFromNeutrons(pulse_maxP);
 
@@ -0,0 +1,317 @@
+/*
+	SimulatorBench.cpp times the hot paths of the simulator core and prints
+	the results as JSON (same layout as Google Benchmark's --benchmark_format=json),
+	so runs of different releases can be compared.
+
+	Usage: simulator_bench [--filter <substring>] [--min-time <s>] [--out <file.json>]
+*/
+#include <Simulator.h>
+#include <Settings.h>
+#include <ControlRod.h>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <ctime>
+#include <cstdio>
+#ifdef SIMULATOR_BENCH_GRAPH
+#include <nanogui/graph.h>
+#include <nanovg.h>
+#endif
+
+// Swallows the simulator log while the benchmarks run
+class NullBuffer : public std::streambuf {
+protected:
+	int overflow(int c) override { return c; }
+};
+
+struct BenchResult {
+	std::string name;
+	size_t iterations = 0;
+	double realTime = 0.;		// ns per iteration
+	double cpuTime = 0.;		// ns per iteration
+	double itemsPerSecond = 0.;
+	double bytesPerSecond = 0.;
+	std::string label;
+};
+
+static double minTime = 0.5;
+static std::string filter;
+static std::vector<BenchResult> results;
+
+static bool selected(const std::string& name) {
+	return filter.empty() || name.find(filter) != std::string::npos;
+}
+
+/*
+	Runs body(n) with a growing n until one batch takes at least minTime, like Google Benchmark.
+	body returns the number of items it processed (0 for one item per iteration).
+*/
+template <class Body>
+static BenchResult& run(const std::string& name, Body body, size_t maxIterations = std::numeric_limits<size_t>::max()) {
+	BenchResult result;
+	result.name = name;
+	size_t n = 1;
+	while (true) {
+		std::clock_t cpuStart = std::clock();
+		auto start = std::chrono::steady_clock::now();
+		size_t items = body(n);
+		double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		double cpu = (double)(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+		if (elapsed >= minTime || n >= maxIterations) {
+			result.iterations = n;
+			result.realTime = elapsed * 1e9 / n;
+			result.cpuTime = cpu * 1e9 / n;
+			result.itemsPerSecond = (items ? items : n) / std::max(elapsed, 1e-12);
+			break;
+		}
+		// Aim a bit above minTime, but never grow more than 10x per round
+		double factor = (elapsed > 0.) ? std::min(10., 1.4 * minTime / elapsed) : 10.;
+		n = std::min(maxIterations, std::max(n + 1, (size_t)(n * factor)));
+	}
+	std::cerr << name << ": " << result.realTime << " ns/iteration (" << result.iterations << " iterations)" << std::endl;
+	results.push_back(result);
+	return results.back();
+}
+
+static std::string jsonEscape(const std::string& s) {
+	std::string out;
+	for (char c : s) {
+		if (c == '"' || c == '\\') out += '\\';
+		out += c;
+	}
+	return out;
+}
+
+static void writeJson(std::ostream& os) {
+	char date[64];
+	time_t now = time(0);
+	strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+	os << "{\n  \"context\": {\n";
+	os << "    \"date\": \"" << date << "\",\n";
+	os << "    \"executable\": \"simulator_bench\",\n";
+#ifdef NDEBUG
+	os << "    \"library_build_type\": \"release\",\n";
+#else
+	os << "    \"library_build_type\": \"debug\",\n";
+#endif
+	os << "    \"dt_step\": " << DT_STEP << ",\n";
+	os << "    \"history_samples\": " << (size_t)std::round(DELETE_OLD_DATA_TIME_DEFAULT / DT_STEP) + 1 << "\n";
+	os << "  },\n  \"benchmarks\": [\n";
+	for (size_t i = 0; i < results.size(); i++) {
+		const BenchResult& r = results[i];
+		os << "    {\n";
+		os << "      \"name\": \"" << jsonEscape(r.name) << "\",\n";
+		os << "      \"run_type\": \"iteration\",\n";
+		os << "      \"iterations\": " << r.iterations << ",\n";
+		os << "      \"real_time\": " << r.realTime << ",\n";
+		os << "      \"cpu_time\": " << r.cpuTime << ",\n";
+		os << "      \"time_unit\": \"ns\",\n";
+		if (r.bytesPerSecond > 0.) os << "      \"bytes_per_second\": " << r.bytesPerSecond << ",\n";
+		if (!r.label.empty()) os << "      \"label\": \"" << jsonEscape(r.label) << "\",\n";
+		os << "      \"items_per_second\": " << r.itemsPerSecond << "\n";
+		os << "    }" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+	os << "  ]\n}\n";
+}
+
+/* Simulator core */
+
+static void benchMainLoop(Settings& settings) {
+	for (int flags = 0; flags < 16; flags++) {
+		const bool temperature = flags & 1, xenon = flags & 2, source = flags & 4, automatic = flags & 8;
+		std::string name = std::string("BM_MainLoopStep/temperature:") + (temperature ? "1" : "0")
+			+ "/xenon:" + (xenon ? "1" : "0") + "/source:" + (source ? "1" : "0") + "/automatic:" + (automatic ? "1" : "0");
+		if (!selected(name)) continue;
+		Simulator reactor(&settings);
+		reactor.pushStableState(100.);
+		reactor.setTemperatureEffectsEnabled(temperature);
+		reactor.setFissionPoisoningEffectsEnabled(xenon);
+		reactor.setNeutronSourceInserted(source);
+		if (automatic) {
+			reactor.setPowerHold(100.);
+			reactor.regulatingRod()->setOperationMode(ControlRod::OperationModes::Automatic);
+		}
+		run(name, [&](size_t n) {
+			reactor.runIterations(n);
+			return n;
+		}).label = "ns per DT_STEP";
+	}
+}
+
+static void benchPushStableState(Settings& settings) {
+	if (!selected("BM_PushStableState")) return;
+	Simulator reactor(&settings);
+	run("BM_PushStableState", [&](size_t n) {
+		for (size_t i = 0; i < n; i++) reactor.pushStableState(i % 2 ? 100. : 1000.);
+		return n;
+	});
+}
+
+static void benchDataToFile(Settings& settings) {
+	if (!selected("BM_DataToFile")) return;
+	Simulator reactor(&settings);
+	reactor.pushStableState(100.);
+	// Fill the whole ring buffer
+	std::cerr << "Filling " << reactor.getDataLength() << " samples for BM_DataToFile..." << std::endl;
+	reactor.runIterations(reactor.getDataLength());
+	const std::string fileName = "simulator_bench_data.tmp";
+	size_t bytes = 0;
+	BenchResult& r = run("BM_DataToFile/full_buffer", [&](size_t n) {
+		for (size_t i = 0; i < n; i++) reactor.dataToFile(fileName);
+		std::ifstream written(fileName, std::ios::binary | std::ios::ate);
+		bytes = (size_t)written.tellg();
+		return n * reactor.getDataLength();
+	}, 5);
+	r.bytesPerSecond = bytes * r.iterations / (r.realTime * r.iterations * 1e-9);
+	r.label = "items are history samples";
+	std::remove(fileName.c_str());
+}
+
+static void benchHistoryStats(Settings& settings) {
+	Simulator reactor(&settings);
+	reactor.pushStableState(100.);
+	reactor.runIterations(100000);
+	reactor.historyStats(reactor.counts_detector1_noisy_, 0., 0.);
+	for (double window : { 1., 10., 100. }) {
+		std::string name = "BM_HistoryStats/" + std::to_string((int)window) + "s";
+		if (!selected(name)) continue;
+		const double end = reactor.getCurrentTime();
+		double sink = 0.;
+		run(name, [&](size_t n) {
+			for (size_t i = 0; i < n; i++) sink += reactor.historyStats(reactor.counts_detector1_noisy_, end - window, end).max;
+			return n;
+		}).label = "ns per window";
+		if (sink < 0.) std::cerr << sink;
+	}
+}
+
+static void benchControlRod(Settings& settings) {
+	ControlRod rod;
+	rod.setRodSteps(settings.rodSettings[1].rodSteps, false);
+	rod.setRodWorth(settings.rodSettings[1].rodWorth);
+	for (size_t i = 0; i < 2; i++) rod.setParameter(i, settings.rodSettings[1].rodCurve[i], false);
+	rod.recalculateStepData();
+
+	if (selected("BM_RecalculateStepData")) {
+		run("BM_RecalculateStepData", [&](size_t n) {
+			for (size_t i = 0; i < n; i++) rod.recalculateStepData();
+			return n;
+		});
+	}
+	if (selected("BM_GetPosFromPcm")) {
+		const float worth = settings.rodSettings[1].rodWorth;
+		volatile float sink = 0.f;
+		run("BM_GetPosFromPcm", [&](size_t n) {
+			for (size_t i = 0; i < n; i++) sink = rod.getPosFromPcm(worth * (float)(i % 1000) / 1000.f);
+			return n;
+		});
+	}
+}
+
+#ifdef SIMULATOR_BENCH_GRAPH
+/* Graph path generation, nanovg runs with a render back-end that draws nothing */
+
+static int nullCreate(void*) { return 1; }
+static int nullCreateTexture(void*, int, int, int, int, const unsigned char*) { return 1; }
+static int nullDeleteTexture(void*, int) { return 1; }
+static int nullUpdateTexture(void*, int, int, int, int, int, const unsigned char*) { return 1; }
+static int nullGetTextureSize(void*, int, int* w, int* h) { *w = *h = 512; return 1; }
+static void nullViewport(void*, float, float, float) {}
+static void nullCancel(void*) {}
+static void nullFlush(void*) {}
+static void nullFill(void*, NVGpaint*, NVGcompositeOperationState, NVGscissor*, float, const float*, const NVGpath*, int) {}
+static void nullStroke(void*, NVGpaint*, NVGcompositeOperationState, NVGscissor*, float, float, const NVGpath*, int) {}
+static void nullTriangles(void*, NVGpaint*, NVGcompositeOperationState, NVGscissor*, const NVGvertex*, int) {}
+static void nullDelete(void*) {}
+
+static void benchGraph() {
+	NVGparams params;
+	memset(&params, 0, sizeof(params));
+	params.edgeAntiAlias = 1;
+	params.renderCreate = nullCreate;
+	params.renderCreateTexture = nullCreateTexture;
+	params.renderDeleteTexture = nullDeleteTexture;
+	params.renderUpdateTexture = nullUpdateTexture;
+	params.renderGetTextureSize = nullGetTextureSize;
+	params.renderViewport = nullViewport;
+	params.renderCancel = nullCancel;
+	params.renderFlush = nullFlush;
+	params.renderFill = nullFill;
+	params.renderStroke = nullStroke;
+	params.renderTriangles = nullTriangles;
+	params.renderDelete = nullDelete;
+	NVGcontext* ctx = nvgCreateInternal(&params);
+
+	for (bool withEnvelope : { false, true })
+	for (size_t points : { (size_t)1000, (size_t)100000, (size_t)10000000 }) {
+		std::string name = (withEnvelope ? "BM_GraphDrawEnvelope/" : "BM_GraphDraw/") + std::to_string(points);
+		if (!selected(name)) continue;
+		float* data = new float[points];
+		for (size_t i = 0; i < points; i++) data[i] = (float)(0.5 + 0.4 * std::sin(i * 1e-3));
+		HistoryPyramid pyramid(data, points);
+		pyramid.update(points);
+
+		nanogui::Graph graph(nullptr, 1);
+		graph.setPosition(nanogui::Vector2i(0, 0));
+		graph.setSize(nanogui::Vector2i(1280, 400));
+		Plot* plot = graph.addPlot(points);
+		plot->setYdata(data);
+		plot->setXdataLin(0);
+		plot->setPlotRange(0, points - 1);
+		plot->setLimits(0., 1., 0., 1.);
+		if (withEnvelope) plot->setEnvelope(&pyramid);
+
+		run(name, [&](size_t n) {
+			for (size_t i = 0; i < n; i++) {
+				nvgBeginFrame(ctx, 1280.f, 400.f, 1.f);
+				graph.draw(ctx);
+				nvgEndFrame(ctx);
+			}
+			return n;
+		}).label = "ns per frame";
+		delete plot;
+		delete[] data;
+	}
+	nvgDeleteInternal(ctx);
+}
+#endif
+
+int main(int argc, char** argv) {
+	std::string outFile;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--filter" && i + 1 < argc) filter = argv[++i];
+		else if (arg == "--min-time" && i + 1 < argc) minTime = std::stod(argv[++i]);
+		else if (arg == "--out" && i + 1 < argc) outFile = argv[++i];
+		else {
+			std::cerr << "Usage: " << argv[0] << " [--filter <substring>] [--min-time <s>] [--out <file.json>]" << std::endl;
+			return 1;
+		}
+	}
+
+	// The benchmarks only print their progress to cerr, the simulator log is dropped
+	NullBuffer nullBuffer;
+	std::streambuf* coutBuffer = std::cout.rdbuf(&nullBuffer);
+
+	Settings settings;
+	benchMainLoop(settings);
+	benchPushStableState(settings);
+	benchHistoryStats(settings);
+	benchControlRod(settings);
+	benchDataToFile(settings);
+#ifdef SIMULATOR_BENCH_GRAPH
+	benchGraph();
+#endif
+
+	std::cout.rdbuf(coutBuffer);
+	if (outFile.empty()) {
+		writeJson(std::cout);
+	}
+	else {
+		std::ofstream os(outFile);
+		writeJson(os);
+	}
+	return 0;
+}
@@ -0,0 +1,226 @@
+#include <Simulator.h>
+#include <cereal/archives/portable_binary.hpp>
+#include <cereal/types/deque.hpp>
+#include <cereal/types/string.hpp>
+#include <cereal/types/utility.hpp>
+#include <cereal/types/vector.hpp>
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+/*
+	A checkpoint is a portable binary cereal archive: a magic string and the format version,
+	the settings JSON, every member in serializeState (the detector noise included), the integrator,
+	then a window of the history so the plots, the period average and a pulse in progress
+	continue where they were. The restored window starts at iteration 0 of the ring.
+	A file of another format version is refused
+*/
+static const std::string CHECKPOINT_MAGIC = "CROCUS checkpoint";
+constexpr std::uint32_t CHECKPOINT_VERSION = 1;
+
+template <class Archive>
+void Simulator::serializeState(Archive& archive)
+{
+	// Configuration, it may have been changed by commands since the settings were applied
+	archive(temperature_effects, fissionPoisoning_effects,
+		power_scram_enabled, fuel_temp_scram_enabled, water_temp_scram_enabled, period_scram_enabled, water_level_scram_enabled,
+		Sigma_f, cp_const_a, cp_const_b, waterLevel_delta, reactor_vessel_radius,
+		keepCurrentPower, keepSteadyPowerAt, avoidPeriodScram, steadyDeviation,
+		alpha0, alphaAtT1, alphaT1, alphaK);
+	archive(source_inserted, safety_blades_inserted, data_division, core_volume,
+		beta_neutrons, delayed_decay_time, delayed_enabled, prompt_lifetime,
+		core_excess_reactivity, safety_blades_worth, core_excess_reactivity_initial,
+		ns_modulation, ns_base_activity, source_mode, *source_sqw, *source_sinMode, *source_saw,
+		delete_old_data_time, godMode, w_cooling, cooling_p, waterVolume,
+		det1_convFactor, det2_convFactor, speedFactor);
+	archive(periodLimit, powerLimit, fuelTemperatureLimit, waterTemperatureLimit, waterLevelLimit, dwellTime,
+		tempMode, autoScramAfterPulse, acquisitionStartTime);
+
+	// Dynamic state
+	archive(Xe_conc, I_conc, waterTemperature, powerHold,
+		pulsing, pulse_maxP, pulse_energy, pulse_FWHM, pulse_maxT, time_at_peak, pulse_startP,
+		last_sample_number, calc_performed, frames_total);
+	archive(doseRate, status, reactorPeriod, reactorAsymPeriod, ns_activity_temp, scriptStart, scriptTimer);
+	archive(fuelTemperature, noiseSeed, detectors, slowStepLength, kineticsTarget, kineticsRemaining);
+	archive(rods, periodEstimator, scriptCommands, scheduler, extraTrips);
+	// The state of the trips goes to the rows of the same name
+	if (Archive::is_loading::value) compileTrips();
+	archive(trips);
+}
+
+// Calls f with every full rate history column, the flags and the decimated columns are handled by the caller
+template <class F>
+static void forEachColumn(HistoryStore* history, F f)
+{
+	f(history->time);
+	for (int i = 0; i < 8; i++) f(history->neutrons[i]);
+	f(history->reactivity);
+	f(history->rodReactivity);
+	for (size_t i = 0; i < history->rodPositions.size(); i++) f(history->rodPositions[i]);
+	f(history->period);
+	f(history->doublingTime);
+	for (size_t i = 0; i < history->cps.size(); i++) {
+		f(history->cps[i]);
+		f(history->noisyCounts[i]);
+	}
+}
+
+// The values of a decimated column for the window of 'samples' ending at iteration 'end', one per stored sample after loading
+static std::vector<float> decimatedWindow(const HistoryStore* history, const DecimatedColumn& column, size_t end, size_t samples)
+{
+	std::vector<float> values;
+	for (size_t i = 0; i < samples; i += column.getDivision())
+		values.push_back(column.get((end - samples + i) % history->size()));
+	return values;
+}
+
+static void restoreDecimated(DecimatedColumn& column, const std::vector<float>& values, size_t samples)
+{
+	for (size_t i = 0, k = 0; i < samples && k < values.size(); i += column.getDivision(), k++)
+		column.set(i, values[k]);
+}
+
+void Simulator::writeCheckpoint(std::ostream& os, double historyTime)
+{
+	cereal::PortableBinaryOutputArchive archive(os);
+	archive(CHECKPOINT_MAGIC, CHECKPOINT_VERSION, settingsJson);
+	serializeState(archive);
+
+	archive((std::uint8_t)integrator->type(), integrator->getSubstep());
+
+	// The window keeps the period average and the start of a pulse in progress
+	const size_t end = iterations_total;
+	const size_t available = std::min(end, dataPoints);
+	const size_t currentIndex = getCurrentIndex();
+	const size_t pulseBack = pulsing ? (currentIndex + dataPoints - pulse_start) % dataPoints : 0;
+	size_t samples = end - getIterationFromTime(getCurrentTime() - std::max(historyTime, 0.));
+	samples = std::max(samples, std::max(PERIOD_AVERAGE_SAMPLES + 1, pulseBack + 1));
+	// Same ring index phase as now, so the decimated samples keep their ring positions after loading
+	const size_t phase = end % dataPoints % POISON_DATA_DEL_DIVISION;
+	samples += (phase + POISON_DATA_DEL_DIVISION - samples % POISON_DATA_DEL_DIVISION) % POISON_DATA_DEL_DIVISION;
+	while (samples > available) samples -= POISON_DATA_DEL_DIVISION;
+	const std::uint64_t sinceReset = std::min(end - resetAverage, samples);
+	archive((std::uint64_t)samples, sinceReset, (std::uint64_t)pulseBack);
+
+	// Oldest sample first, in two pieces if the window wraps around the ring
+	forEachColumn(history, [&](auto* column) {
+		const auto s = history->spans(column, end - samples, samples);
+		archive(cereal::binary_data(s.first, s.firstLength * sizeof(*column)));
+		archive(cereal::binary_data(s.second, s.secondLength * sizeof(*column)));
+	});
+	std::vector<std::uint8_t> flags(samples);
+	history->copySamples(history->sourceInserted, end - samples, samples, flags.data());
+	archive(flags);
+	history->copySamples(history->safetyBladesInserted, end - samples, samples, flags.data());
+	archive(flags);
+	for (const DecimatedColumn* column : { &history->temperature, &history->xenon, &history->iodine })
+		archive(decimatedWindow(history, *column, end, samples));
+}
+
+void Simulator::readCheckpoint(std::istream& is)
+{
+	cereal::PortableBinaryInputArchive archive(is);
+	std::string magic;
+	std::uint32_t version = 0;
+	archive(magic);
+	if (magic != CHECKPOINT_MAGIC) throw std::runtime_error("not a simulator checkpoint");
+	archive(version);
+	if (version != CHECKPOINT_VERSION) throw std::runtime_error("unsupported checkpoint version " + std::to_string(version));
+	archive(settingsJson);
+	serializeState(archive);
+	if (detectors.size() < 2) throw std::runtime_error("missing detector channels");
+	if (rods.size() < NUMBER_OF_CONTROL_RODS) throw std::runtime_error("missing control rods");
+	if (!scheduler.valid()) throw std::runtime_error("invalid subsystem rates");
+	attachColumns();
+
+	std::uint8_t integratorType = 0;
+	double substep = 0.;
+	archive(integratorType, substep);
+	setIntegrator((IntegratorType)integratorType);
+	integrator->reset();
+	integrator->setSubstep(substep);
+
+	std::uint64_t samples = 0, sinceReset = 0, pulseBack = 0;
+	archive(samples, sinceReset, pulseBack);
+	if (samples == 0 || samples > dataPoints || pulseBack >= samples) throw std::runtime_error("invalid history window");
+
+	// Background exports of the old history stop at their next chunk
+	historyResets++;
+	historyHead.store((size_t)samples, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	if (journal) journal->restart(0);
+	restartPyramids();
+
+	// The two pieces of a wrapped window follow each other in the file
+	forEachColumn(history, [&](auto* column) {
+		archive(cereal::binary_data(column, (size_t)samples * sizeof(*column)));
+	});
+	std::vector<std::uint8_t> flags;
+	archive(flags);
+	for (size_t i = 0; i < flags.size() && i < samples; i++) history->sourceInserted.set(i, flags[i] != 0);
+	archive(flags);
+	for (size_t i = 0; i < flags.size() && i < samples; i++) history->safetyBladesInserted.set(i, flags[i] != 0);
+	std::vector<float> values;
+	for (DecimatedColumn* column : { &history->temperature, &history->xenon, &history->iodine }) {
+		archive(values);
+		restoreDecimated(*column, values, (size_t)samples);
+	}
+
+	setIterationsTotal((size_t)samples);
+	resetAverage = (size_t)(samples - sinceReset);
+	pulse_start = (size_t)(samples - 1 - pulseBack);
+
+	// runLoop paces the restored simulation from the next call on
+	startTime = -1.;
+	simulatorTime = getCurrentTime();
+	lastTime = 0.;
+	actualTime = 0.;
+	exitRequested = false;
+
+	rods.recalculateStepData();
+	recalculateLambdaBetaEffective();
+	selectStepFunction();
+	updatePyramids();
+	appendToJournal();
+}
+
+bool Simulator::saveCheckpoint(const std::string& fileName, double historyTime)
+{
+	std::ofstream ofs(fileName, std::ios::binary);
+	if (ofs) writeCheckpoint(ofs, historyTime);
+	ofs.close();
+	if (!ofs) {
+		cerr << "Error writing checkpoint: " << fileName << endl;
+		return false;
+	}
+	return true;
+}
+
+bool Simulator::loadCheckpoint(const std::string& fileName)
+{
+	std::ifstream ifs(fileName, std::ios::binary);
+	if (!ifs) {
+		cerr << "Error opening checkpoint: " << fileName << endl;
+		return false;
+	}
+	// A file that turns out to be damaged halfway is replaced by the state from before
+	std::stringstream backup;
+	writeCheckpoint(backup, 0.);
+	try {
+		readCheckpoint(ifs);
+	}
+	catch (const std::exception& e) {
+		cerr << "Error reading checkpoint " << fileName << ": " << e.what() << endl;
+		try {
+			readCheckpoint(backup);
+		}
+		catch (const std::exception& e) {
+			// Only possible if the simulator cannot read its own files, the state is then undefined
+			cerr << "Error restoring the state from before the checkpoint: " << e.what() << endl;
+			attachColumns();
+			init();
+		}
+		return false;
+	}
+	return true;
+}
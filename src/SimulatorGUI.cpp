@@ -25,6 +25,7 @@
 #include <nanogui/graph.h>
 #include <nanogui/tabwidget.h>
 #include <Simulator.h>
+#include <SimulationThread.h>
 #include <nanogui/DataDisplay.h>
 #include <nanogui/pieChart.h>
 #include <nanogui/controlRodDisplay.h>
@@ -255,6 +256,8 @@ public:
 	Serial* theBox;
 #endif
 	Simulator* reactor;
+	// Steps the reactor, the GUI only touches it from input events and draw() while holding simThread->acquire()
+	SimulationThread* simThread;
 	Graph* canvas;
 	Graph* canvasFlux;  // for neutron flux
 	// Graph* delayedGroupsGraph;
@@ -274,7 +277,14 @@ public:
 	ToolButton* slowDown;
 	ToolButton* playPause;
 	ToolButton* speedUp;
+	ToolButton* slowModeButton;
+	// Slow mode step of the last frame, the button follows the simulation when it changes
+	double shownSlowStep = 0.;
 	Button* startAcqBtn = nullptr;
+	// Progress of the background exports on the Save data tab
+	Label* exportLabel = nullptr;
+	Button* cancelExportBtn = nullptr;
+	Button* recordBtn = nullptr;
 	size_t selectedTime = 8;
 	Plot* rodCurves[NUMBER_OF_CONTROL_RODS];
 	Plot* rodDerivatives[NUMBER_OF_CONTROL_RODS];
@@ -302,6 +312,8 @@ public:
 	PeriodDisplay* periodDisplay;
 	ComboBox* rodMode;
 	FloatBox<float>* rodBox[NUMBER_OF_CONTROL_RODS];
+	// Positions of the extra rods of the bank, read only
+	std::vector<FloatBox<float>*> extraRodBoxes;
 	FloatBox<float>* removed_reactivity;
 	SliderCheckBox* neutronSourceCB;
 	SliderCheckBox* SafetyBladesCB;
@@ -452,105 +464,127 @@ public:
 		// Create the Simulator object, set initial properties
 		reactor = new Simulator(properties);
 		reactor->setDebugMode(debugMode);
+		simThread = new SimulationThread(reactor);
+		// The callbacks fire on the simulation thread, widgets are only updated from the GUI thread
 		reactor->setScramCallback([this](int signal) {
-			if (signal > 0) LEDstatus += (uint16_t)1 << 13;
-			std::string reason = "";
-			if ((signal & Simulator::ScramSignals::Period) != 0) {
-				reason = "SCRAM: Period too low | " + std::to_string(*reactor->getReactorPeriod()) + " s | asymptotic | " + std::to_string(*reactor->getReactorAsymPeriod()) + " s";
-				periodScram->setGlow(true);
-				periodScram->setBackgroundColor(Color(255, 0, 0, 255));
-				LEDstatus |= SCRAM_PER;
-			}
-			if ((signal & Simulator::ScramSignals::FuelTemperature) != 0) {
-				reason = "Fuel temperature too high | " + std::to_string(reactor->getCurrentTemperature()) + " C";
-				fuelTemperatureScram->setGlow(true);
-				fuelTemperatureScram->setBackgroundColor(Color(255, 0, 0, 255));
-				LEDstatus |= SCRAM_FT;
-			}
-			if ((signal & Simulator::ScramSignals::WaterTemperature) != 0) {
-				reason = "Water temperature too high | " + std::to_string(reactor->waterTemperature) + " C";
-				waterTemperatureScram->setGlow(true);
-				waterTemperatureScram->setBackgroundColor(Color(255, 0, 0, 255));
-				LEDstatus |= SCRAM_WT;
-			}
-			if ((signal & Simulator::ScramSignals::WaterLevel) != 0) {
-				reason = "Water level too low | " + std::to_string(*reactor->getWaterLevel()) + " m";
-				waterLevelScram->setGlow(true);
-				waterLevelScram->setBackgroundColor(Color(255, 0, 0, 255));
-				// LEDstatus |= ALARM3;
-				// NOT SUPPORTED BY THE BOX
-			}
-			if ((signal & Simulator::ScramSignals::Power) != 0) {
-				reason = "SCRAM: Power too high | " + std::to_string(reactor->getCurrentPower()) + " W";
-				powerScram->setGlow(true);
-				powerScram->setBackgroundColor(Color(255, 0, 0, 255));
-				LEDstatus |= SCRAM_POW;
-			}
-			if ((signal & Simulator::ScramSignals::User) != 0) {
-				reason = "SCRAM: the Operator pressed the SCRAM button";
-				userScram->setGlow(true);
-				userScram->setBackgroundColor(Color(255, 0, 0, 255));
-				LEDstatus |= SCRAM_MAN;
-			}
-			if ((signal & Simulator::ScramSignals::ARRET) != 0) {
-				reason = "ARRET requested by the operator";
-			}
-			
-			if ((signal & Simulator::ScramSignals::URGENCE) != 0) {
-				reason = "URGENCE: the operator pressed the URGENCE button";
-			}			
-			cout << "==========================" << endl;
-			cout << reason << endl;
-			neutronSourceCB->setChecked(false);
-			SafetyBladesCB->setChecked(true);
-			emergency_scram = true;
-			scram_reset = true;					// No SCRAM KEY needed if the SCRAM is automatic
-			modeButtonClickable[1] = true;
-			modeButtons[1]->callback()();  // index 1 = ARRET
-			emergency_scram = false;
-			
+			simThread->postToGui([this, signal] { onScram(signal); });
 		});
 		reactor->setResetScramCallback([this] {
-			LEDstatus &= RESET_ALARM_KEY;
-			userScram->setGlow(false);
-			userScram->setBackgroundColor(Color(120, 120));
-			powerScram->setGlow(false);
-			powerScram->setBackgroundColor(Color(120, 120));
-			periodScram->setGlow(false);
-			periodScram->setBackgroundColor(Color(120, 120));
-			waterTemperatureScram->setGlow(false);
-			waterTemperatureScram->setBackgroundColor(Color(120, 120));
-			waterLevelScram->setGlow(false);
-			waterLevelScram->setBackgroundColor(Color(120, 120));
-			fuelTemperatureScram->setGlow(false);
-			fuelTemperatureScram->setBackgroundColor(Color(120, 120));
+			simThread->postToGui([this] { onResetScram(); });
 		});
 		reactor->setPulseCallback([this](Simulator::PulseData data) {
-			// Format pulse graph
-			pulsePerformed = true;
-			pulseTimer->setEnabled(true);
-			standInCover->setVisible(false);
-
-			lastPulseData = data;
-			updatePulseTrack(true);
+			simThread->postToGui([this, data] { onPulse(data); });
 		});
 		reactor->setSevereErrorCallback([this](int reason) {
-			toggleBaseWindow(false);
-			std::string msgTxt;
-			switch (reason) {
-			case 0:
-				msgTxt = "Power exceeded 10GW - an absurd limit. The reactor will SCRAM, since the simulator can't work with infinite numbers (assuming the power is still rising)"; break;
-			case 1:
-				msgTxt = "Since the Research reactor simulator can't simulate an explosion,\n the reactor will SCRAM. Information: Fuel temperature exceeded 950" + degCelsiusUnit + " (the uranium isotope melted)!"; break;
-			default:
-				msgTxt = "An unknown error has occured. An automatic SCRAM is mandatory."; break;
-			}
-			MessageDialog* msg = new MessageDialog(this, MessageDialog::Type::Warning, "Severe error", msgTxt);
-			msg->setPosition(Vector2i((this->size().x() - msg->size().x()) / 2, (this->size().y() - msg->size().y()) / 2));
-			msg->setCallback([this, msg](int /*choice*/) {
-				toggleBaseWindow(true);
-				msg->dispose();
-			});
+			simThread->postToGui([this, reason] { onSevereError(reason); });
+		});
+	}
+
+	// Queues an operator command for the simulation thread
+	void send(commands command, const std::string& value = "0", int rod = -1) {
+		simThread->send(makeCommand(command, value, rod));
+	}
+
+	void onScram(int signal) {
+		if (signal > 0) LEDstatus += (uint16_t)1 << 13;
+		std::string reason = "";
+		if ((signal & Simulator::ScramSignals::Period) != 0) {
+			reason = "SCRAM: Period too low | " + std::to_string(*reactor->getReactorPeriod()) + " s | asymptotic | " + std::to_string(*reactor->getReactorAsymPeriod()) + " s";
+			periodScram->setGlow(true);
+			periodScram->setBackgroundColor(Color(255, 0, 0, 255));
+			LEDstatus |= SCRAM_PER;
+		}
+		if ((signal & Simulator::ScramSignals::FuelTemperature) != 0) {
+			reason = "Fuel temperature too high | " + std::to_string(reactor->getCurrentTemperature()) + " C";
+			fuelTemperatureScram->setGlow(true);
+			fuelTemperatureScram->setBackgroundColor(Color(255, 0, 0, 255));
+			LEDstatus |= SCRAM_FT;
+		}
+		if ((signal & Simulator::ScramSignals::WaterTemperature) != 0) {
+			reason = "Water temperature too high | " + std::to_string(reactor->waterTemperature) + " C";
+			waterTemperatureScram->setGlow(true);
+			waterTemperatureScram->setBackgroundColor(Color(255, 0, 0, 255));
+			LEDstatus |= SCRAM_WT;
+		}
+		if ((signal & Simulator::ScramSignals::WaterLevel) != 0) {
+			reason = "Water level too low | " + std::to_string(*reactor->getWaterLevel()) + " m";
+			waterLevelScram->setGlow(true);
+			waterLevelScram->setBackgroundColor(Color(255, 0, 0, 255));
+			// LEDstatus |= ALARM3;
+			// NOT SUPPORTED BY THE BOX
+		}
+		if ((signal & Simulator::ScramSignals::Power) != 0) {
+			reason = "SCRAM: Power too high | " + std::to_string(reactor->getCurrentPower()) + " W";
+			powerScram->setGlow(true);
+			powerScram->setBackgroundColor(Color(255, 0, 0, 255));
+			LEDstatus |= SCRAM_POW;
+		}
+		if ((signal & Simulator::ScramSignals::User) != 0) {
+			reason = "SCRAM: the Operator pressed the SCRAM button";
+			userScram->setGlow(true);
+			userScram->setBackgroundColor(Color(255, 0, 0, 255));
+			LEDstatus |= SCRAM_MAN;
+		}
+		if ((signal & Simulator::ScramSignals::ARRET) != 0) {
+			reason = "ARRET requested by the operator";
+		}
+		
+		if ((signal & Simulator::ScramSignals::URGENCE) != 0) {
+			reason = "URGENCE: the operator pressed the URGENCE button";
+		}			
+		cout << "==========================" << endl;
+		cout << reason << endl;
+		neutronSourceCB->setChecked(false);
+		SafetyBladesCB->setChecked(true);
+		emergency_scram = true;
+		scram_reset = true;					// No SCRAM KEY needed if the SCRAM is automatic
+		modeButtonClickable[1] = true;
+		modeButtons[1]->callback()();  // index 1 = ARRET
+		emergency_scram = false;
+	}
+
+	void onResetScram() {
+		LEDstatus &= RESET_ALARM_KEY;
+		userScram->setGlow(false);
+		userScram->setBackgroundColor(Color(120, 120));
+		powerScram->setGlow(false);
+		powerScram->setBackgroundColor(Color(120, 120));
+		periodScram->setGlow(false);
+		periodScram->setBackgroundColor(Color(120, 120));
+		waterTemperatureScram->setGlow(false);
+		waterTemperatureScram->setBackgroundColor(Color(120, 120));
+		waterLevelScram->setGlow(false);
+		waterLevelScram->setBackgroundColor(Color(120, 120));
+		fuelTemperatureScram->setGlow(false);
+		fuelTemperatureScram->setBackgroundColor(Color(120, 120));
+	}
+
+	void onPulse(Simulator::PulseData data) {
+		// Format pulse graph
+		pulsePerformed = true;
+		pulseTimer->setEnabled(true);
+		standInCover->setVisible(false);
+
+		lastPulseData = data;
+		updatePulseTrack(true);
+	}
+
+	void onSevereError(int reason) {
+		toggleBaseWindow(false);
+		std::string msgTxt;
+		switch (reason) {
+		case 0:
+			msgTxt = "Power exceeded 10GW - an absurd limit. The reactor will SCRAM, since the simulator can't work with infinite numbers (assuming the power is still rising)"; break;
+		case 1:
+			msgTxt = "Since the Research reactor simulator can't simulate an explosion,\n the reactor will SCRAM. Information: Fuel temperature exceeded 950" + degCelsiusUnit + " (the uranium isotope melted)!"; break;
+		default:
+			msgTxt = "An unknown error has occured. An automatic SCRAM is mandatory."; break;
+		}
+		MessageDialog* msg = new MessageDialog(this, MessageDialog::Type::Warning, "Severe error", msgTxt);
+		msg->setPosition(Vector2i((this->size().x() - msg->size().x()) / 2, (this->size().y() - msg->size().y()) / 2));
+		msg->setCallback([this, msg](int /*choice*/) {
+			toggleBaseWindow(true);
+			msg->dispose();
 		});
 	}
 
@@ -601,9 +635,11 @@ public:
 
 	void viewingIntervalChanged(bool firstChanged) {
 		const double timeElapsed = reactor->getCurrentTime();
-		const double range = std::min(timeElapsed, DELETE_OLD_DATA_TIME_DEFAULT);
+		// The slider spans the history, which covers more than DELETE_OLD_DATA_TIME_DEFAULT after a slow mode
+		const double oldestTime = reactor->time_[reactor->getOldestIndex()];
+		const double range = timeElapsed - oldestTime;
 		if (firstChanged) {
-			viewStart = std::max(0., timeElapsed - DELETE_OLD_DATA_TIME_DEFAULT) + std::round(1000 * displayTimeSlider->value(0) * range) * 1e-3;
+			viewStart = oldestTime + std::round(1000 * displayTimeSlider->value(0) * range) * 1e-3;
 			timeAtLastChange = timeElapsed;
 		}
 		{ // update range
@@ -880,6 +916,8 @@ public:
 		} else{
 			powerPlot->setYdata(reactor->counts_detector1_noisy_);
 		}
+		// Zoomed out count rates show the min/max envelope, the doubling time mapping is not monotonic so it keeps the samples
+		powerPlot->setEnvelope(reactor->getPyramid(det2_state ? reactor->counts_detector2_noisy_ : reactor->counts_detector1_noisy_));
 
 /* 		temperaturePlot->setXdata(reactor->time_);
 		temperaturePlot->setYdata(reactor->temperature_); */
@@ -1152,6 +1190,8 @@ public:
 		// Activate OFF mode on startup
 		initializing = false;
 		modeButtons[0]->callback()();
+
+		simThread->start();
 	}
 
 	// Bottom panel initialization
@@ -1225,6 +1265,13 @@ public:
 				this->setSimulationTime(std::min((int)selectedTime + 1, SIM_TIME_FACTOR_NUMBER - 1));
 			}
 		});
+		// Poisons and temperatures over hours, the neutrons by the prompt jump approximation
+		slowModeButton = speedToolPanel->add<ToolButton>(ENTYPO_ICON_HOURGLASS);
+		slowModeButton->setFlags(Button::Flags::ToggleButton);
+		slowModeButton->setTooltip("Slow mode: " + formatDecimals(SLOW_MODE_STEP_DEFAULT, 0, false) + " s steps");
+		slowModeButton->setChangeCallback([this](bool value) {
+			send(commands::setSlowMode, value ? std::to_string(SLOW_MODE_STEP_DEFAULT) : "0");
+		});
 
 		simFactorLabel = bottomPanel->add<Label>("real-time");
 		simFactorLabel->setColor(Color(255, 255));
@@ -1353,7 +1400,7 @@ public:
 		scram->setTextColor(Color(255, 255));
 		scram->setFontSize(15);
 		scram->setCallback([this]
-						   { reactor->scram(Simulator::ScramSignals::User); 
+						   { send(scramReactor, to_string(Simulator::ScramSignals::User)); 
 							emergency_scram = true;
 							scram_reset = false;
 							modeButtons[1]->callback()();
@@ -1365,7 +1412,7 @@ public:
 		fire->setTextColor(Color(255, 255));
 		fire->setFontSize(15);
 		fire->setCallback([this]
-						  { reactor->scram(Simulator::ScramSignals::URGENCE);  
+						  { send(scramReactor, to_string(Simulator::ScramSignals::URGENCE));  
 							emergency_scram = true;
 							modeButtons[1]->callback()();
 							emergency_scram = false;
@@ -1467,7 +1514,7 @@ public:
 				off_state = true;
 				inter_state = false;
 				if (scram_reset){								    // to avoid segfault when starting the simulator
-					reactor->scram(Simulator::ScramSignals::None); 	// Needed to reset the SCRAM after ARRET without needing to click "SCRAM KEY" (otherwise PER and POW automatic scrams don't get triggered)
+					send(scramReactor, to_string(Simulator::ScramSignals::None)); 	// Needed to reset the SCRAM after ARRET without needing to click "SCRAM KEY" (otherwise PER and POW automatic scrams don't get triggered)
 				}
 				setWidgetsEnabled(off_state, manuel_state, inter_state, acquisition_state);
 
@@ -1478,12 +1525,12 @@ public:
 			off_state = false;
 			inter_state = false;
 			if (!emergency_scram){			// ARRET only if we press ARRET (SCRAMs lead to the ARRET state)
-				reactor->scram(Simulator::ScramSignals::ARRET);
+				send(scramReactor, to_string(Simulator::ScramSignals::ARRET));
 				scram_reset = true;			// it is not a SCRAM
 			}
-			reactor->rods[2]->setEnabled(true);
-			reactor->rods[2]->setRodSpeed(wl_speed_nonmanuel);
-			reactor->rods[2]->commandMove((size_t) 0);
+			send(setRodEnabled, "1", 2);
+			send(commands::setRodSpeed, to_string(wl_speed_nonmanuel), 2);
+			send(moveRod, "0", 2);
 
 			setWidgetsEnabled(off_state, manuel_state, inter_state, acquisition_state);
 
@@ -1495,12 +1542,12 @@ public:
 			inter_state = false;
 			attenteClickTime = reactor->getCurrentTime();
 			if (!reactor->safety_blades_inserted){
-				reactor->safety_blades_inserted = true;
+				send(setSafetyBlades, "1");
 				SafetyBladesCB->setChecked(true);
-				reactor->rods[2]->setEnabled(true);
-				reactor->rods[2]->setRodSpeed(wl_speed_nonmanuel);
-				reactor->rods[2]->moveRodToStep(6170, true);
-				reactor->rods[2]->commandMove((size_t)5000);
+				send(setRodEnabled, "1", 2);
+				send(commands::setRodSpeed, to_string(wl_speed_nonmanuel), 2);
+				send(setRodPosition, to_string(WATER_LEVEL_SCRAM_STEPS_DEFAULT), 2);
+				send(moveRod, "5000", 2);
 			}
 			if (reactor->getNeutronSourceInserted()){
 				properties->neutronSourceInserted = false;
@@ -1516,16 +1563,16 @@ public:
 			interClickTime = reactor->getCurrentTime();
 			
 			if (!reactor->safety_blades_inserted){
-				reactor->safety_blades_inserted = true;
+				send(setSafetyBlades, "1");
 				SafetyBladesCB->setChecked(true);
-				reactor->rods[2]->setEnabled(true);
-				reactor->rods[2]->moveRodToStep(6170, true);
-				reactor->rods[2]->commandMove((size_t)5000);
+				send(setRodEnabled, "1", 2);
+				send(setRodPosition, to_string(WATER_LEVEL_SCRAM_STEPS_DEFAULT), 2);
+				send(moveRod, "5000", 2);
 			}
 			else{
-				reactor->rods[2]->setEnabled(true);
-				reactor->rods[2]->setRodSpeed(wl_speed_nonmanuel);
-				reactor->rods[2]->commandMove((size_t)5000);
+				send(setRodEnabled, "1", 2);
+				send(commands::setRodSpeed, to_string(wl_speed_nonmanuel), 2);
+				send(moveRod, "5000", 2);
 			}
 			if (reactor->getNeutronSourceInserted()){
 				properties->neutronSourceInserted = false;
@@ -1540,13 +1587,13 @@ public:
 				manuel_state = true;
 				off_state = false;
 				inter_state = false;
-					reactor->regulatingRod()->setOperationMode(ControlRod::OperationModes::Manual);
-					reactor->rods[2]->setRodSpeed(10);
-					reactor->rods[2]->commandMove((size_t) 8000);
-					reactor->safety_blades_inserted = false;
+					send(setSimulationMode, "Manual");
+					send(commands::setRodSpeed, "10", 2);
+					send(moveRod, "8000", 2);
+					send(setSafetyBlades, "0");
 					SafetyBladesCB->setChecked(false);
 					for (int r = 0; r < 3; r++) {
-						if (reactor->rods[r]) reactor->rods[r]->setEnabled(true);
+						if (reactor->rods[r]) send(setRodEnabled, "1", r);
 					}
 					setWidgetsEnabled(off_state, manuel_state, inter_state, acquisition_state);
 				}
@@ -1568,7 +1615,7 @@ public:
 		unscram->setTextColor(Color(255, 255));
 		unscram->setFixedWidth(150);
 		unscram->setCallback([this] { if (scram_reset) return;
-			reactor->scram(Simulator::ScramSignals::None);
+			send(scramReactor, to_string(Simulator::ScramSignals::None));
 			scram_reset = true;
 			activeModeIndex = -1;
 			modeButtons[1]->callback()();
@@ -1681,7 +1728,7 @@ public:
 									if (*reactor->rods[2]->getActualPosition() < 8000) return true;			// modifiable only after we reach 8000mm and we're actually in manuel
 									if (change < 0 || change > 1000) return true;
 					try {
-						this->reactor->rods[i]->commandMove((size_t)(change*10));
+						send(moveRod, to_string((size_t)(change*10)), i);
 					}
 					catch (exception e) {
 						return false;
@@ -1705,7 +1752,7 @@ public:
 									if (*reactor->rods[2]->getActualPosition() < 8000) return true;			// modifiable only after we reach 8000mm and we're actually in manuel
 									if (change < 0 || change > 1000) return true;
 					try {
-						this->reactor->rods[i]->commandMove((size_t)(change*10));
+						send(moveRod, to_string((size_t)(change*10)), i);
 					}
 					catch (exception e) {
 						return false;
@@ -1728,16 +1775,22 @@ public:
 									if (*reactor->rods[2]->getActualPosition() < 8000) return true;			// modifiable only after we reach 8000mm and we're actually in manuel
 									if (change < 800 || change > 1000) return true; 		    // in MANUEL mode we can adjust the WL from 800 to 1000mm only
 					try {
-						this->reactor->rods[i]->commandMove((size_t)(change*10));
+						send(moveRod, to_string((size_t)(change*10)), i);
 					}
 					catch (exception e) {
 						return false;
 					}
 					return true; });
 
-			
-			
-			
+			// EXTRA RODS of the settings, shown but moved by scripts only
+			for (size_t r = NUMBER_OF_CONTROL_RODS; r < reactor->rods.size() && r < SNAPSHOT_MAX_RODS; r++) {
+				FloatBox<float>* box = makeSettingLabel<FloatBox<float>>(main_right, reactor->rods[r]->getRodName() + " position: ", 200);
+				box->setFixedSize(Vector2i(100, 20));
+				box->setUnits("mm");
+				box->setFontSize(16);
+				box->setEditable(false);
+				extraRodBoxes.push_back(box);
+			}
 		}
 
 		// Checkboxes
@@ -1749,7 +1802,7 @@ public:
 			neutronSourceCB->setFontSize(16);
 			neutronSourceCB->setChecked(reactor->getNeutronSourceInserted());
 			neutronSourceCB->setCallback([this](bool value) {
-				reactor->setNeutronSourceInserted(value);
+				send(setNeutronSource, value ? "1" : "0");
 				properties->neutronSourceInserted = value;
 			});
 
@@ -2219,7 +2272,7 @@ public:
 					relPhysics->setAnchor(delayedGroupsEnabledBoxes[i], RelativeGridLayout::makeAnchor(2 * (i + 1) + 1, 7, 1, 1, Alignment::Middle, Alignment::Middle));
 					delayedGroupsEnabledBoxes[i]->setCallback([this, i](bool change) {
 						properties->groupsEnabled[i] = change;
-						reactor->setDelayedGroupEnabled(i, change);
+						send(setDelayedGroupEnabled, to_string(i) + (change ? ":1" : ":0"));
 					});
 				}
 				break;
@@ -2247,11 +2300,11 @@ public:
 					delayedGroupBoxes[index]->setCallback([this, row, i](double change) {
 						if (row) {
 							properties->lambdas[i] = change;
-							reactor->setDelayedGroupDecay(i, change);
+							send(setDelayedGroupDecay, to_string(i) + ":" + numberValue(change));
 						}
 						else {
 							properties->betas[i] = change;
-							reactor->setDelayedGroupFraction(i, change);
+							send(setDelayedGroupFraction, to_string(i) + ":" + numberValue(change));
 						}
 					});
 				}
@@ -2279,7 +2332,7 @@ public:
 		coreVolumeBox->setFormat(SCI_NUMBER_FORMAT);
 		coreVolumeBox->setUnits("L");
 		coreVolumeBox->setCallback([this](double change) {
-			reactor->setReactorCoreVolume(change * 1e-03);
+			send(setCoreVolume, numberValue(change * 1e-03));
 			properties->coreVolume = change * 1e-03;
 		});
 
@@ -2356,7 +2409,7 @@ public:
 		excessReactivityBox->setCallback([this](float change) {
 			properties->excessReactivity = change;
 			properties->excessReactivity_initial = change;
-			reactor->setExcessReactivity(change);
+			send(setExcessReactivity, numberValue(change));
 		});
 
 		SafetyBladesPanel->add<Label>("Safety blades' worth: ", "sans-bold");
@@ -2371,7 +2424,7 @@ public:
 		SafetyBladesBox->setValueIncrement(10.);
 		SafetyBladesBox->setCallback([this](float change) {
 			properties->SafetyBladesworth = change;
-			reactor->setSafetyBladesworth(change);
+			send(setSafetyBladesWorth, numberValue(change));
 		});
 
 		// Water cooling power
@@ -2403,7 +2456,7 @@ public:
 		promptNeutronLifetimeBox->setUnits("s");
 		promptNeutronLifetimeBox->setCallback([this](double change) {
 			properties->promptNeutronLifetime = change;
-			reactor->setPromptNeutronLifetime(change);
+			send(setPromptNeutronLifetime, numberValue(change));
 		});
 
 		sourcePanel->add<Label>("Neutron source intensity: ", "sans-bold");
@@ -2418,7 +2471,7 @@ public:
 		sourceActivityBox->setUnits("n/s");
 		sourceActivityBox->setCallback([this](double change) {
 			properties->neutronSourceActivity = change;
-			reactor->setNeutronSourceActivity(change);
+			send(setSourceActivity, numberValue(change));
 		});
 
 		// Alpha panel
@@ -2590,7 +2643,7 @@ public:
 		rodWorthBox[i]->setCallback([useRod, i, this](float change)
 									{
 				properties->rodSettings[i].rodWorth = change;
-				useRod->setRodWorth(change); });
+				send(setRodWorth, numberValue(change), i); });
 
 		// Rod speed setting
 		tempLabel = rod_settings->add<Label>("Rod speed:", "sans-bold");
@@ -2611,7 +2664,7 @@ public:
 											return;
 										} 
 										properties->rodSettings[i].rodSpeed = change * 10.0f;
-										useRod->setRodSpeed(change * 10.0f);
+										send(commands::setRodSpeed, numberValue(change * 10.0f), i);
 										// if (i == 1)
 										// 	reactor->regulatingRod()->sine()->fillXYaxis(operationModesPlots[0][1], operationModesPlots[1][1]); // Update SQW graph
 									});
@@ -2726,7 +2779,7 @@ public:
 		rodWorthBox[i]->setCallback([useRod, i, this](float change)
 									{
 													 properties->rodSettings[i].rodWorth = change;
-													 useRod->setRodWorth(change); });
+													 send(setRodWorth, numberValue(change), i); });
 
 		// Rod speed setting
 		tempLabel = rod_settings->add<Label>("Rod speed:", "sans-bold");
@@ -2747,7 +2800,7 @@ public:
 											return;
 										} 
 										properties->rodSettings[i].rodSpeed = change * 10.0f;
-										useRod->setRodSpeed(change * 10.0f);
+										send(commands::setRodSpeed, numberValue(change * 10.0f), i);
 										// if (i == 1)
 										// 	reactor->regulatingRod()->sine()->fillXYaxis(operationModesPlots[0][1], operationModesPlots[1][1]); // Update SQW graph
 									});
@@ -2863,7 +2916,7 @@ public:
 		rodWorthBox[i]->setCallback([useRod, i, this](float change)
 									{
 													 properties->rodSettings[i].rodWorth = change;
-													 useRod->setRodWorth(change); });
+													 send(setRodWorth, numberValue(change), i); });
 
 		// Rod speed setting
 		tempLabel = rod_settings->add<Label>("Blade speed:", "sans-bold");
@@ -2884,7 +2937,7 @@ public:
 											return;
 										} 
 										properties->rodSettings[i].rodSpeed = change * 10.f;
-										useRod->setRodSpeed(change * 10.f);
+										send(commands::setRodSpeed, numberValue(change * 10.f), i);
 										// if (i == 1)
 										// 	reactor->regulatingRod()->sine()->fillXYaxis(operationModesPlots[0][1], operationModesPlots[1][1]); // Update SQW graph
 									});
@@ -3369,7 +3422,7 @@ rodDerivatives[i]->setRoundFloating(true);
 			rel->setAnchor(scramEnabledBoxes[i], a);
 			scramEnabledBoxes[i]->setChecked(reactor->getScramEnabled(reasons[i]));
 			scramEnabledBoxes[i]->setCallback([this, i](bool checked) {
-				reactor->setScramEnabled(reasons[i], checked);
+				send(setScramEnabled, to_string((int)reasons[i]) + (checked ? ":1" : ":0"));
 				switch (i) {
 				case 0: properties->periodScram = checked; break;
 				case 1: properties->powerScram = checked; break;
@@ -3390,7 +3443,7 @@ rodDerivatives[i]->setRoundFloating(true);
 		periodLimBox->setValueIncrement(0.1f);
 		periodLimBox->setCallback([this](float a) {
 			properties->periodLimit = a / std::log(2); // The user chooses the doubling time for CROCUS
-			reactor->setPeriodLimit(a);
+			send(setPeriodLimit, numberValue(a));
 		});
 
 		// Create the power limit
@@ -3405,7 +3458,7 @@ rodDerivatives[i]->setRoundFloating(true);
 		powerLimBox->setValueIncrement(1e2);
 		powerLimBox->setCallback([this](double a) {
 			properties->powerLimit = a;
-			reactor->setPowerLimit(a);
+			send(setPowerLimit, numberValue(a));
 		});
 
 		// create a panel for the removed reactivity 
@@ -3426,7 +3479,7 @@ rodDerivatives[i]->setRoundFloating(true);
 		
 		
 			properties->excessReactivity = properties->excessReactivity_initial - change;
-			reactor->setExcessReactivity(properties->excessReactivity_initial - change);
+			send(setExcessReactivity, numberValue(properties->excessReactivity_initial - change));
 		
 			std::ostringstream ss;
 			ss << std::fixed << std::setprecision(1) << properties->excessReactivity_initial - change;
@@ -3448,7 +3501,7 @@ rodDerivatives[i]->setRoundFloating(true);
 		det1_factorBox->setFormat(SCI_NUMBER_FORMAT);
 		det1_factorBox->setUnits("CPS/W");
 		det1_factorBox->setCallback([this](double change) {
-			reactor->setDet1Factor(change); // CHANGE
+			send(setDetector1Factor, numberValue(change));
 			properties->det1_convFactor = change;
 		});
 
@@ -3466,7 +3519,7 @@ rodDerivatives[i]->setRoundFloating(true);
 		det2_factorBox->setFormat(SCI_NUMBER_FORMAT);
 		det2_factorBox->setUnits("CPS/W");
 		det2_factorBox->setCallback([this](double change) {
-			reactor->setDet2Factor(change); // CHANGE
+			send(setDetector2Factor, numberValue(change));
 			properties->det2_convFactor = change;
 		});
 
@@ -3483,7 +3536,7 @@ rodDerivatives[i]->setRoundFloating(true);
 		dwellTimeBox->setFormat(SCI_NUMBER_FORMAT);
 		dwellTimeBox->setUnits("s");
 		dwellTimeBox->setCallback([this](double change) {
-			reactor->setdwellTime(change); // CHANGE
+			send(setDwellTime, numberValue(change));
 			properties->dwellTime = change;
 		});
 
@@ -3508,9 +3561,11 @@ rodDerivatives[i]->setRoundFloating(true);
 
 			if (det2_state) {
 				powerPlot->setYdata( reactor->counts_detector2_noisy_ );
+				powerPlot->setEnvelope(reactor->getPyramid(reactor->counts_detector2_noisy_));
 				canvasFlux->setCaption("Counts from detector 2");
 			} else {
 				powerPlot->setYdata( reactor->counts_detector1_noisy_ );
+				powerPlot->setEnvelope(reactor->getPyramid(reactor->counts_detector1_noisy_));
 				canvasFlux->setCaption("Counts from detector 1");
 			}
 		});
@@ -3726,6 +3781,10 @@ rodDerivatives[i]->setRoundFloating(true);
 		rel->appendRow(RelativeGridLayout::Size(30.f, RelativeGridLayout::SizeType::Fixed));   // 1: row 1
 		rel->appendRow(RelativeGridLayout::Size(15.f, RelativeGridLayout::SizeType::Fixed));   // 2: spacing
 		rel->appendRow(RelativeGridLayout::Size(30.f, RelativeGridLayout::SizeType::Fixed));   // 3: row 2
+		rel->appendRow(RelativeGridLayout::Size(15.f, RelativeGridLayout::SizeType::Fixed));   // 4: spacing
+		rel->appendRow(RelativeGridLayout::Size(30.f, RelativeGridLayout::SizeType::Fixed));   // 5: row 3
+		rel->appendRow(RelativeGridLayout::Size(15.f, RelativeGridLayout::SizeType::Fixed));   // 6: spacing
+		rel->appendRow(RelativeGridLayout::Size(30.f, RelativeGridLayout::SizeType::Fixed));   // 7: row 4
 	
 		other_tab->setLayout(rel);
 	
@@ -3734,7 +3793,7 @@ rodDerivatives[i]->setRoundFloating(true);
 		rel->setAnchor(saveLogBtn, RelativeGridLayout::makeAnchor(1, 1));
 		saveLogBtn->setCallback([this]() {
 			std::string logFileName = file_dialog({ { "dat", "Data file" },{ "txt", "Text file" } }, true);
-			reactor->dataToFile(logFileName);
+			reactor->startExport(ExportFormat::Text, logFileName);
 		});
 	
 		// Row 1 right: horizontal box containing label + input
@@ -3778,12 +3837,58 @@ rodDerivatives[i]->setRoundFloating(true);
 			acquisition_state = false;
 			setWidgetsEnabled(off_state, manuel_state, inter_state, acquisition_state);
 			std::string logFileName = file_dialog({ { "dat", "Data file" },{ "txt", "Text file" } }, true);
-			reactor->CountsToFile(logFileName);
+			reactor->startExport(ExportFormat::Counts, logFileName);
 			if (startAcqBtn) {
 				startAcqBtn->setBackgroundColor(Color(68, 68, 68, 255));
 				startAcqBtn->setTextColor(Color(255, 255, 255, 255));
 			}
 		});
+
+		// Row 3 left: every sample in the binary format (HistoryFile.h), for analysis scripts
+		Button* saveBinaryBtn = other_tab->add<Button>("Binary data");
+		rel->setAnchor(saveBinaryBtn, RelativeGridLayout::makeAnchor(1, 5));
+		saveBinaryBtn->setCallback([this]() {
+			std::string logFileName = file_dialog({ { "bin", "Binary data file" } }, true);
+			reactor->startExport(ExportFormat::Binary, logFileName);
+		});
+
+		// Row 3 right: progress of the exports, the files are written while the simulation runs
+		Widget* exportBox = other_tab->add<Widget>();
+		exportBox->setLayout(new BoxLayout(Orientation::Horizontal, Alignment::Middle, 5));
+		exportLabel = exportBox->add<Label>("");
+		exportLabel->setFixedWidth(110);
+		cancelExportBtn = exportBox->add<Button>("Cancel");
+		cancelExportBtn->setEnabled(false);
+		cancelExportBtn->setCallback([this]() {
+			for (HistoryExport* e : reactor->getExports()) e->cancel();
+		});
+		rel->setAnchor(exportBox, RelativeGridLayout::makeAnchor(3, 5));
+
+		// Row 4 left: logs the operator commands, SimulatorHeadless --replay plays the session back
+		recordBtn = other_tab->add<Button>("Record session");
+		recordBtn->setFlags(Button::Flags::ToggleButton);
+		rel->setAnchor(recordBtn, RelativeGridLayout::makeAnchor(1, 7));
+		recordBtn->setChangeCallback([this](bool pushed) {
+			if (!pushed) {
+				reactor->setRecording("");
+				return;
+			}
+			std::string sessionFileName = file_dialog({ { "txt", "Session file" } }, true);
+			if (sessionFileName.empty() || !reactor->setRecording(sessionFileName)) recordBtn->setPushed(false);
+		});
+	}
+
+	void updateExportProgress() {
+		if (!exportLabel) return;
+		double progress = 0.;
+		size_t running = 0;
+		for (const HistoryExport* e : reactor->getExports()) {
+			if (e->isDone()) continue;
+			progress += e->progress();
+			running++;
+		}
+		exportLabel->setCaption(running ? "Exporting " + to_string((int)(100. * progress / running)) + "%" : "");
+		cancelExportBtn->setEnabled(running > 0);
 	}
 	
 	
@@ -3793,6 +3898,8 @@ rodDerivatives[i]->setRoundFloating(true);
 
 	void resetSimToStart() {
 		reactor->reset(properties);
+		// The reset ended the recording
+		if (recordBtn) recordBtn->setPushed(false);
 		updateSettings(false);
 		setSimulationTime(8); // 1x speed
 		playPauseSimulation(true);
@@ -3857,6 +3964,7 @@ rodDerivatives[i]->setRoundFloating(true);
 	}
 
 	~SimulatorGUI() {
+		delete simThread;
 		delete reactor;
 		for (int i = 0; i < 2; i++) {
 			for (int j = 0; j < 3; j++) {
@@ -3868,6 +3976,32 @@ rodDerivatives[i]->setRoundFloating(true);
 #endif
 	}
 
+	// Input events change the simulator, so they are processed while the simulation thread is held back
+	virtual bool cursorPosCallbackEvent(double x, double y) {
+		auto lock = simThread->acquire();
+		return Screen::cursorPosCallbackEvent(x, y);
+	}
+	virtual bool mouseButtonCallbackEvent(int button, int action, int modifiers) {
+		auto lock = simThread->acquire();
+		return Screen::mouseButtonCallbackEvent(button, action, modifiers);
+	}
+	virtual bool keyCallbackEvent(int key, int scancode, int action, int mods) {
+		auto lock = simThread->acquire();
+		return Screen::keyCallbackEvent(key, scancode, action, mods);
+	}
+	virtual bool charCallbackEvent(unsigned int codepoint) {
+		auto lock = simThread->acquire();
+		return Screen::charCallbackEvent(codepoint);
+	}
+	virtual bool dropCallbackEvent(int count, const char **filenames) {
+		auto lock = simThread->acquire();
+		return Screen::dropCallbackEvent(count, filenames);
+	}
+	virtual bool scrollCallbackEvent(double x, double y) {
+		auto lock = simThread->acquire();
+		return Screen::scrollCallbackEvent(x, y);
+	}
+
 	virtual bool keyboardEvent(int key, int scancode, int action, int modifiers) {
 		if (Screen::keyboardEvent(key, scancode, action, modifiers))
 			return true;
@@ -3896,8 +4030,7 @@ rodDerivatives[i]->setRoundFloating(true);
 			}
 
 			if (isGodMode) {
-				reactor->godMode = !reactor->godMode;
-				cout << "God mode: " << reactor->godMode << endl;
+				send(setGodMode, reactor->godMode ? "0" : "1");
 				return true;
 			}
 			if (isDebug) {
@@ -3915,68 +4048,68 @@ rodDerivatives[i]->setRoundFloating(true);
 		if (key == safetyRodControl) {
 			if (action == GLFW_RELEASE) {
 				lastKeyPressed[0] = false;
-				reactor->safetyRod()->clearCommands();
+				send(clearRodCommands, "0", 0);
 			}
 			else {
 				if (properties->allRodsAtOnce || !(lastKeyPressed[1] || lastKeyPressed[2])) lastKeyPressed[0] = true;
 			}
 		}
 		else if (key == enableSafetyCommand && action == GLFW_PRESS) {
-			reactor->safetyRod()->setEnabled(!reactor->safetyRod()->isEnabled());
+			send(toggleRodEnabled, "0", 0);
 		} // Regulation rod
 		else if (key == regulatoryRodControl) {
 			if (action == GLFW_RELEASE) {
 				lastKeyPressed[1] = false;
-				reactor->regulatingRod()->clearCommands();
+				send(clearRodCommands, "0", 1);
 			}
 			else {
 				if (properties->allRodsAtOnce || !(lastKeyPressed[0] || lastKeyPressed[2])) lastKeyPressed[1] = true;
 			}
 		}
 		else if (key == enableRegCommand && action == GLFW_PRESS) {
-			reactor->regulatingRod()->setEnabled(!reactor->regulatingRod()->isEnabled());
+			send(toggleRodEnabled, "0", 1);
 		} // Shim rod
 		else if (key == shimRodControl) {
 			if (action == GLFW_RELEASE) {
 				lastKeyPressed[2] = false;
-				reactor->shimRod()->clearCommands();
+				send(clearRodCommands, "0", 2);
 			}
 			else {
 				if (properties->allRodsAtOnce || !(lastKeyPressed[0] || lastKeyPressed[1])) lastKeyPressed[2] = true;
 			}
 		}
 		else if (key == enableShimCommand && action == GLFW_PRESS) {
-			reactor->shimRod()->setEnabled(!reactor->shimRod()->isEnabled());
+			send(toggleRodEnabled, "0", 2);
 		} // Move rod up
 		else if (key == rodUpCommand && action != GLFW_REPEAT) {
 			if (action == GLFW_RELEASE) {
-				reactor->safetyRod()->clearCommands(ControlRod::CommandType::Top);
-				reactor->regulatingRod()->clearCommands(ControlRod::CommandType::Top);
-				reactor->shimRod()->clearCommands(ControlRod::CommandType::Top);
+				send(clearRodCommands, to_string(ControlRod::CommandType::Top), 0);
+				send(clearRodCommands, to_string(ControlRod::CommandType::Top), 1);
+				send(clearRodCommands, to_string(ControlRod::CommandType::Top), 2);
 			}
 			else {
 				for (int i = 0; i < NUMBER_OF_CONTROL_RODS; i++) {
-					if (lastKeyPressed[i]) reactor->rods[i]->commandToTop();
+					if (lastKeyPressed[i]) send(rodToTop, "0", i);
 				}
 			}
 		} // Move rod down
 		else if (key == rodDownCommand && action != GLFW_REPEAT) {
 			if (action == GLFW_RELEASE) {
-				reactor->safetyRod()->clearCommands(ControlRod::CommandType::Bottom);
-				reactor->regulatingRod()->clearCommands(ControlRod::CommandType::Bottom);
-				reactor->shimRod()->clearCommands(ControlRod::CommandType::Bottom);
+				send(clearRodCommands, to_string(ControlRod::CommandType::Bottom), 0);
+				send(clearRodCommands, to_string(ControlRod::CommandType::Bottom), 1);
+				send(clearRodCommands, to_string(ControlRod::CommandType::Bottom), 2);
 			}
 			else {
 				for (int i = 0; i < NUMBER_OF_CONTROL_RODS; i++) {
-					if (lastKeyPressed[i]) reactor->rods[i]->commandToBottom();
+					if (lastKeyPressed[i]) send(rodToBottom, "0", i);
 				}
 			}
 		} // SCRAM
 		else if (key == scramCommand && action == GLFW_PRESS) {
-			reactor->scram(Simulator::ScramSignals::User);
+			send(scramReactor, to_string(Simulator::ScramSignals::User));
 		} // reset scram
 		else if (key == resetScramCommand && action == GLFW_PRESS) {
-			reactor->scram(Simulator::ScramSignals::None);
+			send(scramReactor, to_string(Simulator::ScramSignals::None));
 		} // pause
 		else if (key == pauseCommand && action == GLFW_PRESS) {
 			playPauseSimulation(reactor->isPaused());
@@ -4008,20 +4141,19 @@ rodDerivatives[i]->setRoundFloating(true);
 			}
 		} // fire
 		else if (key == firePulseCommand && action == GLFW_PRESS){
-			reactor->beginPulse();
+			send(firePulse);
 		} // toogle neutron source
 		else if (key == sourceToggleCommand && action == GLFW_PRESS) {
-			reactor->setNeutronSourceInserted(!reactor->getNeutronSourceInserted());
-			neutronSourceCB->setChecked(reactor->getNeutronSourceInserted());
+			bool inserted = !reactor->getNeutronSourceInserted();
+			send(setNeutronSource, inserted ? "1" : "0");
+			neutronSourceCB->setChecked(inserted);
 		}
 		else if (action == GLFW_PRESS && key == demoModeCommand && modifiers & GLFW_MOD_CONTROL) {
-			reactor->setDemoMode();
-			reactor->regulatingRod()->setOperationMode(ControlRod::OperationModes::Manual);
+			send(setStablePower, "0.5");
 			rodMode->setSelectedIndex(0);
 		}
 		else if (action == GLFW_PRESS && key == demoModeHighPowerCommand && modifiers & GLFW_MOD_CONTROL) {
-			reactor->setHighPowerDemoMode();
-			reactor->regulatingRod()->setOperationMode(ControlRod::OperationModes::Manual);
+			send(setStablePower, "12000");
 			rodMode->setSelectedIndex(0);
 		}
 		else {
@@ -4106,27 +4238,31 @@ public:
 	double lastTime = nanogui::get_seconds_since_epoch();
 
 	virtual void draw(NVGcontext *ctx) {
-		double reactorElapsed = reactor->getCurrentTime();
+		// The simulation thread runs the calculation, hold it back while the widgets are updated and drawn
+		std::unique_lock<std::mutex> simLock = simThread->acquire();
+		simThread->processGuiEvents();
+		// The exitSimulator command closes the window instead of ending the process
+		if (reactor->isExitRequested()) setVisible(false);
+		updateExportProgress();
+		const FrameSnapshot& frame = simThread->snapshot();
+		double reactorElapsed = frame.time;
 		if (startScript.size()) {
 			loadScriptFromFile(startScript);
 			startScript = "";
 		}
-			
-		// Run new calculation
-		reactor->runLoop();
 
 
 		// Get from which index to which index the data will be drawn and update view slider
-		const double sliderRange = std::min(DELETE_OLD_DATA_TIME_DEFAULT, reactorElapsed);
+		const double sliderRange = reactorElapsed - frame.oldestTime;
 		double sliderStart = displayTimeSlider->value(0) * sliderRange;
 		if (viewStart >= 0.) {
 			if (!timeLockedBox->checked()) {
 				double diff = reactorElapsed - timeAtLastChange;
-				sliderStart = viewStart + diff - max(0., reactorElapsed - DELETE_OLD_DATA_TIME_DEFAULT);
+				sliderStart = viewStart + diff - frame.oldestTime;
 				reculculateDisplayInterval(max(viewStart + diff, 0.), viewStart + diff + properties->displayTime);
 			}
 			else {
-				sliderStart = viewStart - max(0., reactorElapsed - DELETE_OLD_DATA_TIME_DEFAULT);
+				sliderStart = viewStart - frame.oldestTime;
 				reculculateDisplayInterval(max(viewStart, 0.), viewStart + properties->displayTime);
 			}
 		}
@@ -4227,18 +4363,17 @@ public:
 		}
 
 		// Show data
-		powerShow->setData(reactor->getCurrentPower());
-		fluxShow->setData(reactor->getCurrentFlux());   // added to display flux value for CROCUS
-		size_t curIndx = reactor->getCurrentIndex();
-		reactivityShow->setData(reactor->reactivity_[curIndx]);
-		rodReactivityShow->setData(reactor->rodReactivity_[curIndx]);
-		temperatureShow->setData(reactor->temperature_[curIndx]);
-		waterTemperatureShow->setData(*reactor->getWaterTemperature());
-		waterLevelShow->setData(*reactor->getWaterLevel() * 100.);
-		periodShow->setData(*reactor->getReactorPeriod());
+		powerShow->setData(frame.power);
+		fluxShow->setData(frame.flux);   // added to display flux value for CROCUS
+		reactivityShow->setData(frame.reactivity);
+		rodReactivityShow->setData(frame.rodReactivity);
+		temperatureShow->setData(frame.temperature);
+		waterTemperatureShow->setData(frame.waterTemperature);
+		waterLevelShow->setData(frame.waterLevel * 100.);
+		periodShow->setData(frame.period);
 
 		//Data for graphical reactor period display
-		periodDisplay->setPeriod(*reactor->getReactorPeriod());
+		periodDisplay->setPeriod(frame.period);
 
 		double newTime = nanogui::get_seconds_since_epoch();
 		float thisFps = powf((float)(newTime - lastTime), -1.f);
@@ -4252,7 +4387,7 @@ public:
 		lastTime = newTime;
 
 		// Update alpha plot
-		float tempNow = reactor->getCurrentTemperature();
+		float tempNow = frame.temperature;
 		alphaPlot->setHorizontalPointerPosition(tempNow / 1000.f);
 		alphaPlot->setPointerPosition((float)((reactor->getReactivityCoefficient(tempNow) - alphaPlot->limits()[2]) / (alphaPlot->limits()[3] -  alphaPlot->limits()[2])));
 
@@ -4260,21 +4395,31 @@ public:
 		for (int i = 0; i < NUMBER_OF_CONTROL_RODS; i++){
 			if (i != 2){
 				std::ostringstream ss;
-				ss << std::fixed << std::setprecision(1) << ((float)*reactor->rods[i]->getExactPosition() / 10.0f);
+				ss << std::fixed << std::setprecision(1) << (frame.rodExactPosition[i] / 10.0f);
 				rodBox[i]->setText(ss.str());
 			}
 			else {
 				std::ostringstream ss;
-				ss << std::fixed << std::setprecision(1) << ((float)*reactor->rods[i]->getExactPosition() / 10.0f);
+				ss << std::fixed << std::setprecision(1) << (frame.rodExactPosition[i] / 10.0f);
 				rodBox[i]->setText(ss.str());
 			}
 		}
+		for (size_t r = 0; r < extraRodBoxes.size() && NUMBER_OF_CONTROL_RODS + r < frame.rodCount; r++) {
+			std::ostringstream ss;
+			ss << std::fixed << std::setprecision(1) << (frame.rodExactPosition[NUMBER_OF_CONTROL_RODS + r] / 10.0f);
+			extraRodBoxes[r]->setText(ss.str());
+		}
 
 		// Update time
 		timeLabel->setCaption(getTimeSinceStart());
+		// The slow mode ends by itself at a pulse or close to prompt critical
+		if (frame.slowStep != shownSlowStep) {
+			shownSlowStep = frame.slowStep;
+			slowModeButton->setPushed(frame.slowStep > 0.);
+		}
 
-		if (!reactor->getScramStatus()) {
-			if ((*reactor->getReactorPeriod() < 1.1 * properties->periodLimit) && (*reactor->getReactorPeriod() > 0.)) {
+		if (!frame.scramStatus) {
+			if ((frame.period < 1.1 * properties->periodLimit) && (frame.period > 0.)) {
 				periodScram->setBackgroundColor(Color(175, 100, 0, 255));
 			}
 			else {
@@ -4286,13 +4431,13 @@ public:
 			else {
 				fuelTemperatureScram->setBackgroundColor(Color(120, 120));
 			}
-			if (*reactor->getWaterTemperature() > 0.9 * properties->waterTempLimit) {
+			if (frame.waterTemperature > 0.9 * properties->waterTempLimit) {
 				waterTemperatureScram->setBackgroundColor(Color(175, 100, 0, 255));
 			}
 			else {
 				waterTemperatureScram->setBackgroundColor(Color(120, 120));
 			}
-			if (reactor->getCurrentPower() > 0.9 * properties->powerLimit) {
+			if (frame.power > 0.9 * properties->powerLimit) {
 				powerScram->setBackgroundColor(Color(175, 100, 0, 255));
 			}
 			else {
@@ -4306,9 +4451,8 @@ public:
 		}
 		
 		for (int i = 0; i < NUMBER_OF_CONTROL_RODS; ++i) {
-			if (!*reactor->rods[i]->isEnabled()) {
-				float* pos = reactor->rods[i]->getActualPosition();
-				rodBox[i]->setValue(*pos / 10.f);  // Update only during SCRAM
+			if (!frame.rodEnabled[i]) {
+				rodBox[i]->setValue(frame.rodActualPosition[i] / 10.f);  // Update only during SCRAM
 			}
 		}
 
@@ -4335,7 +4479,7 @@ public:
 		}
 
 		if (activeModeIndex == 1) {
-			float wl_position = *reactor->rods[2]->getActualPosition();
+			float wl_position = frame.rodActualPosition[2];
 			bool wl_0 = wl_position == 0;
 		
 			if (modeButtonClickable[0] != wl_0 && scram_reset) {
@@ -4351,12 +4495,15 @@ public:
 			);
 		}
 
-		if (*reactor->rods[2]->getActualPosition() >= 8000){
-			reactor->rods[2]->setRodSpeed(rodSpeedBox[2]->value() * 10.0f);
+		if (*reactor->rods[2]->getActualPosition() >= 8000 && reactor->rods[2]->getRodSpeed() != rodSpeedBox[2]->value() * 10.0f){
+			send(commands::setRodSpeed, to_string(rodSpeedBox[2]->value() * 10.0f), 2);
 		}
 		
 		
-		/* Draw the user interface */
+		/* Draw the user interface. The plots read the history columns, the pyramids and the rod worth
+		tables while the simulation thread would overwrite the oldest samples of a full ring, refill
+		them from a checkpoint or reallocate them, so it waits until the frame is drawn. It catches up
+		on the missed steps in its next loop */
 		Screen::draw(ctx);
 		
 		// Send dickbut PNG bits over serial
@@ -4529,63 +4676,63 @@ public:
 		bool rodsMoving[NUMBER_OF_CONTROL_RODS];
 		for (int i = 0; i < NUMBER_OF_CONTROL_RODS; i++) rodsMoving[i] = (reactor->rods[i]->getCommandType() == ControlRod::CommandType::None);
 		if (box_data & SCRAM_BTN) {
-			if (!btns[0]) reactor->scram(Simulator::ScramSignals::User);
+			if (!btns[0]) send(scramReactor, to_string(Simulator::ScramSignals::User));
 		}
 		if (box_data & FIRE_BTN) {
 			if (!btns[1]) {
-				if (reactor->getScramStatus() == 0)reactor->beginPulse();
+				if (reactor->getScramStatus() == 0)send(firePulse);
 			}
 		}
 		if (box_data & ENABLE_SAFETY_BTN) {
 			if (!btns[2]) {
-				if (reactor->getScramStatus() == 0) reactor->safetyRod()->setEnabled(!reactor->safetyRod()->isEnabled());
+				if (reactor->getScramStatus() == 0) send(toggleRodEnabled, "0", 0);
 			}
 		}
 		if (box_data & UP_SAFETY_BTN) {
-			if (!btns[3] && ((rodsMoving[1] && rodsMoving[2]) || properties->allRodsAtOnce)) reactor->safetyRod()->commandToTop();
+			if (!btns[3] && ((rodsMoving[1] && rodsMoving[2]) || properties->allRodsAtOnce)) send(rodToTop, "0", 0);
 		}
 		else {
-			if (btns[3]) reactor->safetyRod()->clearCommands(ControlRod::CommandType::Top);
+			if (btns[3]) send(clearRodCommands, to_string(ControlRod::CommandType::Top), 0);
 		}
 		if (box_data & DOWN_SAFETY_BTN) {
-			if (!btns[4] && ((rodsMoving[1] && rodsMoving[2]) || properties->allRodsAtOnce)) reactor->safetyRod()->commandToBottom();
+			if (!btns[4] && ((rodsMoving[1] && rodsMoving[2]) || properties->allRodsAtOnce)) send(rodToBottom, "0", 0);
 		}
 		else {
-			if (btns[4]) reactor->safetyRod()->clearCommands(ControlRod::CommandType::Bottom);
+			if (btns[4]) send(clearRodCommands, to_string(ControlRod::CommandType::Bottom), 0);
 		}
 		if (box_data & ENABLE_REG_BTN) {
 			if (!btns[5]) {
-				if (reactor->getScramStatus() == 0) reactor->regulatingRod()->setEnabled(!reactor->regulatingRod()->isEnabled());
+				if (reactor->getScramStatus() == 0) send(toggleRodEnabled, "0", 1);
 			}
 		}
 		if (box_data & UP_REG_BTN) {
-			if (!btns[6] && ((rodsMoving[0] && rodsMoving[2]) || properties->allRodsAtOnce)) reactor->regulatingRod()->commandToTop();
+			if (!btns[6] && ((rodsMoving[0] && rodsMoving[2]) || properties->allRodsAtOnce)) send(rodToTop, "0", 1);
 		}
 		else {
-			if (btns[6]) reactor->regulatingRod()->clearCommands(ControlRod::CommandType::Top);
+			if (btns[6]) send(clearRodCommands, to_string(ControlRod::CommandType::Top), 1);
 		}
 		if (box_data & DOWN_REG_BTN) {
-			if (!btns[7] && ((rodsMoving[0] && rodsMoving[2]) || properties->allRodsAtOnce)) reactor->regulatingRod()->commandToBottom();
+			if (!btns[7] && ((rodsMoving[0] && rodsMoving[2]) || properties->allRodsAtOnce)) send(rodToBottom, "0", 1);
 		}
 		else {
-			if (btns[7]) reactor->regulatingRod()->clearCommands(ControlRod::CommandType::Bottom);
+			if (btns[7]) send(clearRodCommands, to_string(ControlRod::CommandType::Bottom), 1);
 		}
 		if (box_data & ENABLE_SHIM_BTN) {
 			if (!btns[8]) {
-				if (reactor->getScramStatus() == 0) reactor->shimRod()->setEnabled(!reactor->shimRod()->isEnabled());
+				if (reactor->getScramStatus() == 0) send(toggleRodEnabled, "0", 2);
 			}
 		}
 		if (box_data & UP_SHIM_BTN) {
-			if (!btns[9] && ((rodsMoving[0] && rodsMoving[1]) || properties->allRodsAtOnce)) reactor->shimRod()->commandToTop();
+			if (!btns[9] && ((rodsMoving[0] && rodsMoving[1]) || properties->allRodsAtOnce)) send(rodToTop, "0", 2);
 		}
 		else {
-			if (btns[9]) reactor->shimRod()->clearCommands(ControlRod::CommandType::Top);
+			if (btns[9]) send(clearRodCommands, to_string(ControlRod::CommandType::Top), 2);
 		}
 		if (box_data & DOWN_SHIM_BTN) {
-			if (!btns[10] && ((rodsMoving[0] && rodsMoving[1]) || properties->allRodsAtOnce)) reactor->shimRod()->commandToBottom();
+			if (!btns[10] && ((rodsMoving[0] && rodsMoving[1]) || properties->allRodsAtOnce)) send(rodToBottom, "0", 2);
 		}
 		else {
-			if (btns[10]) reactor->shimRod()->clearCommands(ControlRod::CommandType::Bottom);
+			if (btns[10]) send(clearRodCommands, to_string(ControlRod::CommandType::Bottom), 2);
 		}
 		btns[0] = (box_data & SCRAM_BTN) != 0;
 		btns[1] = (box_data & FIRE_BTN) != 0;
@@ -4626,73 +4773,28 @@ public:
 		displayInterval[1] = reactor->getIndexFromTime(toTime);
 	}
 
-	// Method for calculating autoscale factors
+	// Order of magnitude of a count shown on the power plot, 0 for a count of one or less
+	static int countOrder(double counts) {
+		return (counts <= 1.) ? 0 : (int)floor(log10(counts * 2.2));
+	}
+
+	// Method for calculating autoscale factors, from the smallest and largest count of the plotted detector in the window
 	pair<int, int> recalculatePowerExtremes(double fromTime = 0., double toTime = 0.) {
-		int err = 0;
 		if (fromTime + toTime == 0.) {
 			fromTime = reactor->time_[displayInterval[0]];
 			toTime = reactor->time_[displayInterval[1]];
 		}
-		try {
-			// Find the last change since the graph begin time
-			size_t startIndex = 0;
-			for (; startIndex < reactor->getOrderChanges(); startIndex++) {
-				if (reactor->getExtremeAt(startIndex).when >= fromTime) break;
-			}
-			Simulator::PowerExtreme* firstExtreme;
-			if (startIndex) {
-				startIndex--;
-				firstExtreme = &reactor->getExtremeAt(startIndex);
-			}
-			else {
-				firstExtreme = &reactor->trailingExtreme;
-			}
-			err = 1;
-			// Find the last change before the graph end time
-			size_t endIndex = startIndex;
-			for (; endIndex < reactor->getOrderChanges(); endIndex++) {
-				if (reactor->getExtremeAt(endIndex).when > toTime) break;
-			}
-			if (endIndex != 0) endIndex--;
-			err = 2;
-			// If there is only one order change, return the order
-			if (startIndex == endIndex) {
-				isZero.first = firstExtreme->isZero;
-				isZero.second = firstExtreme->isZero;
-				return pair<int, int>(firstExtreme->order, firstExtreme->order + 1);
-			}
-			else {
-				// Iterate through the order changes and find the smallest and largest order
-				int minOrder = firstExtreme->order;
-				int maxOrder = minOrder;
-				isZero.first = firstExtreme->isZero;
-				isZero.second = firstExtreme->isZero;
-				for (size_t i = startIndex + 1; i <= endIndex; i++) {
-					Simulator::PowerExtreme current = reactor->getExtremeAt(i);
-					if (current.isZero) {
-						isZero.first = true;
-					}
-					else {
-						if (isZero.second) {
-							maxOrder = current.order;
-							isZero.second = false;
-						}
-						else {
-							maxOrder = max(maxOrder, current.order);
-						}
-						minOrder = min(minOrder, current.order);
-					}
-				}
-				isZero.first = isZero.first || minOrder < -7;
-				return pair<int, int>(minOrder, ++maxOrder);
-			}
-		}
-		catch (exception e) {
-			cerr << "recalculatePowerExtremes(): error code " << err << endl;
+		HistoryPyramid::Envelope e = reactor->historyStats(det2_state ? reactor->counts_detector2_noisy_ : reactor->counts_detector1_noisy_, fromTime, toTime);
+		if (e.count == 0) {
 			isZero.first = true;
-			return pair<int, int>(0, 10);
+			isZero.second = true;
+			return pair<int, int>(0, 1);
 		}
-
+		const int minOrder = countOrder(e.min);
+		const int maxOrder = countOrder(e.max);
+		isZero.first = e.min <= 0.f || minOrder < -7;
+		isZero.second = e.max <= 0.f;
+		return pair<int, int>(minOrder, maxOrder + 1);
 	}
 
 	std::vector<string> getCOMports() {
@@ -4729,26 +4831,8 @@ public:
 	}   
 
 	void loadScriptFromFile(std::string path) {
-		double time0 = reactor->getCurrentTime();
-		std::ifstream ifs;
 		if (path.length()) {
-			ifs.open(path);
-
-			if (!ifs)
-			{
-				std::cerr << "Error opening input file: " << path << std::endl;
-				return;
-			}
-			std::istream& is = static_cast<std::istream&>(ifs);
-
-			Command cmd;
-
-			while (is >> cmd) {
-				cmd.timed += time0;
-				cout << cmd;
-				reactor->scriptCommands.push_back(cmd);
-			}
-
+			if (!reactor->loadScriptFromFile(path)) return;
 
 			MessageDialog* msg = new MessageDialog(this, MessageDialog::Type::Warning, "Load script", "Loaded.");
 			msg->setPosition(Vector2i((this->size().x() - msg->size().x()) / 2, (this->size().y() - msg->size().y()) / 2));
@@ -0,0 +1,68 @@
+/*
+	SimulatorHeadless.cpp runs the simulator without a window,
+	stepping the kinetics as fast as the CPU allows
+*/
+#include <Simulator.h>
+#include <Settings.h>
+#include <ScriptCommand.h>
+#include <iostream>
+#include <string>
+#include <chrono>
+
+// Number of DT_STEP iterations between two per frame calculations (script commands, finished exports, asymptotic period)
+constexpr size_t HEADLESS_FRAME_ITERATIONS = 10;
+
+static void printUsage(const char* name) {
+	std::cerr << "Usage: " << name << " <settings.json> <script.txt> [duration in s]" << std::endl;
+	std::cerr << "       " << name << " --replay <session.txt>" << std::endl;
+	std::cerr << "Without a duration the simulation runs until every script command has been executed." << std::endl;
+	std::cerr << "A replay runs a recorded session (Simulator::setRecording) from its start to its end." << std::endl;
+}
+
+int main(int argc, char** argv) {
+	if (argc == 3 && std::string(argv[1]) == "--replay") {
+		Simulator reactor;
+		auto wallStart = std::chrono::steady_clock::now();
+		if (!reactor.replaySession(argv[2])) return 1;
+		double wallTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+		std::cout << "Replayed up to " << reactor.getCurrentTime() << " s in " << wallTime << " s" << std::endl;
+		return 0;
+	}
+	if (argc < 3 || argc > 4) {
+		printUsage(argv[0]);
+		return 1;
+	}
+
+	Settings properties;
+	try {
+		properties.restoreArchive(argv[1]);
+	}
+	catch (const std::exception& e) {
+		std::cerr << "Error reading settings file " << argv[1] << ": " << e.what() << std::endl;
+		return 1;
+	}
+
+	double duration = -1.;
+	if (argc == 4) {
+		try {
+			duration = std::stod(argv[3]);
+		}
+		catch (const std::exception&) {
+			printUsage(argv[0]);
+			return 1;
+		}
+	}
+
+	Simulator reactor(&properties);
+	if (!reactor.loadScriptFromFile(argv[2])) return 1;
+
+	auto wallStart = std::chrono::steady_clock::now();
+	while (!reactor.isExitRequested() && (duration >= 0. ? reactor.getCurrentTime() < duration : !reactor.scriptCommands.empty())) {
+		reactor.runIterations(HEADLESS_FRAME_ITERATIONS);
+	}
+	double wallTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+
+	std::cout << "Simulated " << reactor.getCurrentTime() << " s in " << wallTime << " s ("
+		<< reactor.getCurrentTime() / std::max(wallTime, 1e-9) << "x real-time)" << std::endl;
+	return 0;
+}
@@ -0,0 +1,71 @@
+/*
+	SimulatorSweep.cpp runs a script on a grid or Latin hypercube of Settings,
+	one headless simulator per core, and writes the per-run summary
+*/
+#include <ParameterSweep.h>
+#include <Settings.h>
+#include <iostream>
+#include <streambuf>
+#include <string>
+#include <chrono>
+
+// Swallows the log of the simulators, the runs would interleave it anyway
+class NullBuffer : public std::streambuf {
+protected:
+	int overflow(int c) override { return c; }
+	std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+static void printUsage(const char* name) {
+	std::cerr << "Usage: " << name << " <settings.json> <sweep.txt> <script.txt> <duration in s> <summary file> [threads]" << std::endl;
+	std::cerr << "The sweep file holds 'grid' or 'lhs <runs> [seed]' and one '<parameter> <from> <to> [points]' per line." << std::endl;
+	std::cerr << "Parameters: betas[i], lambdas[i], promptNeutronLifetime, excessReactivity, rodWorth[i]" << std::endl;
+}
+
+int main(int argc, char** argv) {
+	if (argc < 6 || argc > 7) {
+		printUsage(argv[0]);
+		return 1;
+	}
+
+	Settings properties;
+	try {
+		properties.restoreArchive(argv[1]);
+	}
+	catch (const std::exception& e) {
+		std::cerr << "Error reading settings file " << argv[1] << ": " << e.what() << std::endl;
+		return 1;
+	}
+
+	double duration = 0.;
+	size_t threads = 0;
+	try {
+		duration = std::stod(argv[4]);
+		if (argc == 7) threads = std::stoul(argv[6]);
+	}
+	catch (const std::exception&) {
+		printUsage(argv[0]);
+		return 1;
+	}
+
+	ParameterSweep sweep(properties);
+	if (!sweep.loadSpecFromFile(argv[2])) return 1;
+	if (!sweep.loadScriptFromFile(argv[3])) return 1;
+	sweep.setDuration(duration);
+	sweep.setThreads(threads);
+
+	std::cerr << "Running " << sweep.runCount() << " runs of " << duration << " s" << std::endl;
+	NullBuffer nullBuffer;
+	std::streambuf* coutBuffer = std::cout.rdbuf(&nullBuffer);
+	auto wallStart = std::chrono::steady_clock::now();
+	const auto& runs = sweep.run();
+	double wallTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+	std::cout.rdbuf(coutBuffer);
+
+	sweep.summaryToFile(argv[5]);
+	size_t completed = 0;
+	for (const auto& r : runs) completed += r.completed;
+	std::cout << "Finished " << completed << " of " << runs.size() << " runs in " << wallTime << " s, summary in "
+		<< argv[5] << ".dat" << std::endl;
+	return completed == runs.size() ? 0 : 1;
+}
@@ -108,9 +108,27 @@ void Graph::draw(NVGcontext *ctx) {
 						double step = (double)current->getPlotRange() / (pixels * current->getPixelDrawRatio());
 						double a = (double)plotStartIndex;
 						double vx, vy;
+						// With a pyramid every pixel shows the minimum and maximum of its samples, not one of them
+						const HistoryPyramid* envelope = (step >= 1.) ? current->getEnvelope() : nullptr;
+						size_t envelopeFrom = plotStartIndex;
+						float lastY = y1;
 						for (size_t i = 1; i < pixels; i++) {
 							a += step;
-							if (step >= 1.) {
+							if (envelope) {
+								rounda = std::min(cap, (size_t)round(a));
+								if (rounda < envelopeFrom) continue;
+								HistoryPyramid::Envelope e = envelope->query(envelopeFrom, rounda + 1 - envelopeFrom);
+								envelopeFrom = rounda + 1;
+								vx = xPos + graphRangeX * current->getXat(rounda);
+								float yFirst = yPos + (1 - current->getYfor(e.min, rounda)) * graphRangeY;
+								float ySecond = yPos + (1 - current->getYfor(e.max, rounda)) * graphRangeY;
+								// Start with the extreme closer to the previous pixel
+								if (std::abs(yFirst - lastY) > std::abs(ySecond - lastY)) std::swap(yFirst, ySecond);
+								nvgLineTo(ctx, vx, yFirst);
+								if (ySecond != yFirst) nvgLineTo(ctx, vx, ySecond);
+								lastY = ySecond;
+							}
+							else if (step >= 1.) {
 								rounda = std::min(cap, (size_t)round(a));
 								nvgLineTo(ctx, xPos + graphRangeX * current->getXat(rounda), yPos + (1 - current->getYat(rounda)) * graphRangeY);
 							}
@@ -0,0 +1,62 @@
+"""
+Reader for the binary history files written by Simulator::dataToBinaryFile
+(the "Binary data" button or the saveToBinaryFile script command).
+
+    from history_file import read_history
+    header, channels = read_history("run.bin")
+    power = channels["neutrons"] * header["powerPerNeutron"]
+
+With numpy the columns are memory mapped arrays, so only the channels that are
+used are read from disk. Without numpy they are loaded as array.array. The
+layout is described in include/HistoryFile.h.
+"""
+import array
+import json
+import struct
+import sys
+
+try:
+    import numpy as np
+except ImportError:
+    np = None
+
+MAGIC = b"CRHIST01"
+VERSION = 1
+# Channel type -> (numpy dtype, array.array typecode)
+TYPES = {"f64": ("<f8", "d"), "f32": ("<f4", "f"), "u8": ("u1", "B")}
+
+
+def read_history(path):
+    """Returns (header, channels): the JSON header as a dict and a dict of channel name -> array."""
+    with open(path, "rb") as f:
+        magic, version, header_length = struct.unpack("<8sII", f.read(16))
+        if magic != MAGIC or version != VERSION:
+            raise ValueError("%s is not a version %d history file" % (path, VERSION))
+        header = json.loads(f.read(header_length).decode("utf-8"))
+    data_start = 16 + header_length
+    samples = header["samples"]
+    channels = {}
+    for channel in header["channels"]:
+        dtype, typecode = TYPES[channel["type"]]
+        offset = data_start + channel["offset"]
+        if np is not None:
+            channels[channel["name"]] = np.memmap(path, dtype=dtype, mode="r", offset=offset, shape=(samples,))
+        else:
+            values = array.array(typecode)
+            with open(path, "rb") as f:
+                f.seek(offset)
+                values.fromfile(f, samples)
+            channels[channel["name"]] = values
+    return header, channels
+
+
+if __name__ == "__main__":
+    # Prints the channels of a file, e.g. python3 tools/history_file.py run.bin
+    header, channels = read_history(sys.argv[1])
+    # dt is 0 when the samples are not evenly spaced (slow mode), the time channel has every sample
+    spacing = "dt = %g s" % header["dt"] if header["dt"] else "variable dt"
+    print("%d samples, %s, start at %g s" % (header["samples"], spacing, header["startTime"]))
+    for channel in header["channels"]:
+        values = channels[channel["name"]]
+        if len(values):
+            print("%-22s %-7s %-4s %g .. %g" % (channel["name"], channel["unit"], channel["type"], min(values), max(values)))